@@ -2,6 +2,8 @@
 
 #include "GLCommon.h"
 
+#include <cfloat>
+
 AABB::AABB(const glm::vec3& min, const glm::vec3 max) : min(min), max(max)
 {
 
@@ -22,6 +24,20 @@ void AABB::Draw(const glm::vec3& position, const glm::vec3& scale) const
 	delete[] vertexData;
 }
 
+AABB AABB::Transform(const glm::mat4& transform) const
+{
+	AABB result(glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX), glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+	for (int i = 0; i < 8; i++) // Transform all 8 corners, the min/max corners alone aren't enough once rotation is involved
+	{
+		glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+		glm::vec3 transformed = glm::vec3(transform * glm::vec4(corner, 1.0f));
+		result.min = glm::min(result.min, transformed);
+		result.max = glm::max(result.max, transformed);
+	}
+
+	return result;
+}
+
 float* AABB::GetVertices(const glm::vec3& position, const glm::vec3& scale) const
 {
 	float* vertexData = new float[72];
@@ -10,6 +10,9 @@ public:
 
 	void Draw(const glm::vec3& position, const glm::vec3& scale) const;
 
+	// Returns the box that encloses this box after being transformed by the given matrix
+	AABB Transform(const glm::mat4& transform) const;
+
 	glm::vec3 min;
 	glm::vec3 max;
 
@@ -0,0 +1,48 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 6; i++)
+	{
+		this->planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// Gribb & Hartmann: every plane is the last row of the matrix plus or minus one of the others. glm is column major, so rows are gathered by hand.
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	this->planes[0] = rows[3] + rows[0];
+	this->planes[1] = rows[3] - rows[0];
+	this->planes[2] = rows[3] + rows[1];
+	this->planes[3] = rows[3] - rows[1];
+	this->planes[4] = rows[3] + rows[2];
+	this->planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++)
+	{
+		this->planes[i] /= glm::length(glm::vec3(this->planes[i]));
+	}
+}
+
+bool Frustum::Intersects(const AABB& box) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4& plane = this->planes[i];
+
+		// Only the corner furthest along the plane's normal matters, if that one is behind the plane the whole box is
+		glm::vec3 corner(plane.x > 0.0f ? box.max.x : box.min.x, plane.y > 0.0f ? box.max.y : box.min.y, plane.z > 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
\ No newline at end of file
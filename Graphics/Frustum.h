@@ -0,0 +1,18 @@
+#pragma once
+
+#include "AABB.h"
+
+#include <glm/glm.hpp>
+
+// The six planes bounding what a camera can see, pulled straight out of its view projection matrix
+class Frustum
+{
+public:
+	Frustum(); // Contains everything
+	Frustum(const glm::mat4& viewProjection);
+
+	// Conservative, a box sitting just outside a corner of the frustum can still pass
+	bool Intersects(const AABB& box) const;
+
+	glm::vec4 planes[6]; // Left, right, bottom, top, near, far. xyz is the inward facing normal and w the distance from the origin.
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+FrustumCuller::FrustumCuller()
+	: visibleCount(0), culledCount(0)
+{
+
+}
+
+void FrustumCuller::Cull(const Frustum& frustum)
+{
+	uint32_t count = TransformComponent::GetCount();
+	this->visible.resize(count);
+
+	ThreadPool& pool = ThreadPool::Get();
+	uint32_t taskCount = std::min(count / MinBoxesPerTask, pool.GetThreadCount() + 1); // The calling thread takes a chunk too
+	if (taskCount <= 1)
+	{
+		Counts counts = CullRange(frustum, 0, count);
+		this->visibleCount = counts.visible;
+		this->culledCount = counts.culled;
+		return;
+	}
+
+	uint32_t chunkSize = ((count + taskCount - 1) / taskCount + 63) & ~63u; // Whole cache lines of results per chunk so workers never write next to each other
+	std::vector<std::future<Counts>> futures;
+	for (uint32_t begin = chunkSize; begin < count; begin += chunkSize)
+	{
+		uint32_t end = std::min(begin + chunkSize, count);
+		futures.push_back(pool.Submit([this, &frustum, begin, end]() { return CullRange(frustum, begin, end); }));
+	}
+
+	Counts counts = CullRange(frustum, 0, std::min(chunkSize, count));
+	for (std::future<Counts>& future : futures)
+	{
+		Counts chunkCounts = future.get();
+		counts.visible += chunkCounts.visible;
+		counts.culled += chunkCounts.culled;
+	}
+
+	this->visibleCount = counts.visible;
+	this->culledCount = counts.culled;
+}
+
+FrustumCuller::Counts FrustumCuller::CullRange(const Frustum& frustum, uint32_t begin, uint32_t end)
+{
+	const BoundsArrays& bounds = TransformComponent::GetWorldBoundsArrays();
+
+	// A box is outside a plane when even its furthest point along the normal is behind it: dot(n, center) + w + dot(|n|, extent) < 0
+	__m128 normalX[6], normalY[6], normalZ[6], absNormalX[6], absNormalY[6], absNormalZ[6], planeW[6];
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4& plane = frustum.planes[i];
+		normalX[i] = _mm_set1_ps(plane.x); normalY[i] = _mm_set1_ps(plane.y); normalZ[i] = _mm_set1_ps(plane.z);
+		absNormalX[i] = _mm_set1_ps(std::abs(plane.x)); absNormalY[i] = _mm_set1_ps(std::abs(plane.y)); absNormalZ[i] = _mm_set1_ps(std::abs(plane.z));
+		planeW[i] = _mm_set1_ps(plane.w);
+	}
+
+	uint32_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 centerX = _mm_loadu_ps(&bounds.centerX[i]), centerY = _mm_loadu_ps(&bounds.centerY[i]), centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 extentX = _mm_loadu_ps(&bounds.extentX[i]), extentY = _mm_loadu_ps(&bounds.extentY[i]), extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (int plane = 0; plane < 6; plane++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[plane], centerX), _mm_mul_ps(normalY[plane], centerY)), _mm_add_ps(_mm_mul_ps(normalZ[plane], centerZ), planeW[plane]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormalX[plane], extentX), _mm_mul_ps(absNormalY[plane], extentY)), _mm_mul_ps(absNormalZ[plane], extentZ));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int outsideMask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			this->visible[i + lane] = (outsideMask & (1 << lane)) ? 0 : 1;
+		}
+	}
+
+	for (; i < end; i++) // Leftovers past the last group of four
+	{
+		glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+		glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+		this->visible[i] = frustum.Intersects(AABB(center - extent, center + extent)) ? 1 : 0;
+	}
+
+	Counts counts;
+	for (uint32_t id = begin; id < end; id++)
+	{
+		if (TransformComponent::IsAlive(id))
+		{
+			(this->visible[id] ? counts.visible : counts.culled)++;
+		}
+	}
+	return counts;
+}
\ No newline at end of file
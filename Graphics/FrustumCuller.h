@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.h"
+#include "Frustum.h"
+#include "TransformComponent.h"
+
+#include <vector>
+
+// Tests the world bounds of every TransformComponent entity against a frustum in one pass.
+// Boxes go through SSE four at a time straight out of the SoA bounds arrays, and big scenes are split into chunks across the thread pool.
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	// Culls against the bounds as of the last TransformComponent::UpdateDirty()
+	void Cull(const Frustum& frustum);
+
+	// Entities created after the last Cull() count as visible
+	inline bool IsVisible(TransformID id) const { return id >= this->visible.size() || this->visible[id] != 0; }
+
+	// Live entities only, free ids aren't counted
+	inline uint32_t GetVisibleCount() const { return this->visibleCount; }
+	inline uint32_t GetCulledCount() const { return this->culledCount; }
+
+	static const uint32_t MinBoxesPerTask = 8192; // Below this a worker costs more to wake up than the culling it takes over
+
+private:
+	struct Counts
+	{
+		uint32_t visible = 0;
+		uint32_t culled = 0;
+	};
+
+	// Culls [begin, end) and writes the results into visible. begin has to be a multiple of 4.
+	Counts CullRange(const Frustum& frustum, uint32_t begin, uint32_t end);
+
+	std::vector<uint8_t> visible; // Indexed by TransformID
+	uint32_t visibleCount;
+	uint32_t culledCount;
+};
\ No newline at end of file
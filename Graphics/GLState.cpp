@@ -0,0 +1,259 @@
+#include "GLState.h"
+
+GLuint GLState::program = GLState::Unknown;
+GLuint GLState::vertexArray = GLState::Unknown;
+GLuint GLState::textureUnits[GLState::MaxTextureUnits];
+GLuint GLState::samplerUnits[GLState::MaxTextureUnits];
+
+int GLState::blend = -1;
+GLenum GLState::blendSourceFactor = GLState::Unknown;
+GLenum GLState::blendDestinationFactor = GLState::Unknown;
+
+int GLState::depthTest = -1;
+int GLState::depthMask = -1;
+GLenum GLState::depthFunc = GLState::Unknown;
+
+GLenum GLState::polygonMode = GLState::Unknown;
+
+GLStateStatistics GLState::statistics;
+
+void GLState::Invalidate()
+{
+	program = Unknown;
+	vertexArray = Unknown;
+	for (uint32_t i = 0; i < MaxTextureUnits; i++)
+	{
+		textureUnits[i] = Unknown;
+		samplerUnits[i] = Unknown;
+	}
+
+	blend = -1;
+	blendSourceFactor = Unknown;
+	blendDestinationFactor = Unknown;
+
+	depthTest = -1;
+	depthMask = -1;
+	depthFunc = Unknown;
+
+	polygonMode = Unknown;
+}
+
+bool GLState::UseProgram(GLuint program)
+{
+	if (!Changed(GLState::program != program))
+	{
+		return false;
+	}
+
+	glUseProgram(program);
+	GLState::program = program;
+	return true;
+}
+
+bool GLState::BindVertexArray(GLuint vertexArray)
+{
+	if (!Changed(GLState::vertexArray != vertexArray))
+	{
+		return false;
+	}
+
+	glBindVertexArray(vertexArray);
+	GLState::vertexArray = vertexArray;
+	return true;
+}
+
+bool GLState::BindTextureUnit(GLuint unit, GLuint texture)
+{
+	if (unit >= MaxTextureUnits)
+	{
+		glBindTextureUnit(unit, texture);
+		return Changed(true);
+	}
+
+	if (!Changed(textureUnits[unit] != texture))
+	{
+		return false;
+	}
+
+	glBindTextureUnit(unit, texture);
+	textureUnits[unit] = texture;
+	return true;
+}
+
+bool GLState::BindTexture(GLenum target, GLuint texture)
+{
+	// A unit holds one texture per target so this can't tell whether the other target's binding is still there, don't skip anything
+	glBindTexture(target, texture);
+	textureUnits[0] = texture;
+	return Changed(true);
+}
+
+bool GLState::BindSampler(GLuint unit, GLuint sampler)
+{
+	if (unit >= MaxTextureUnits)
+	{
+		glBindSampler(unit, sampler);
+		return Changed(true);
+	}
+
+	if (!Changed(samplerUnits[unit] != sampler))
+	{
+		return false;
+	}
+
+	glBindSampler(unit, sampler);
+	samplerUnits[unit] = sampler;
+	return true;
+}
+
+bool GLState::SetBlend(bool enabled)
+{
+	if (!Changed(blend != (int)enabled))
+	{
+		return false;
+	}
+
+	if (enabled)
+	{
+		glEnable(GL_BLEND);
+	}
+	else
+	{
+		glDisable(GL_BLEND);
+	}
+	blend = (int)enabled;
+	return true;
+}
+
+bool GLState::SetBlendFunc(GLenum sourceFactor, GLenum destinationFactor)
+{
+	if (!Changed(blendSourceFactor != sourceFactor || blendDestinationFactor != destinationFactor))
+	{
+		return false;
+	}
+
+	glBlendFunc(sourceFactor, destinationFactor);
+	blendSourceFactor = sourceFactor;
+	blendDestinationFactor = destinationFactor;
+	return true;
+}
+
+bool GLState::SetBlendFunci(GLuint buffer, GLenum sourceFactor, GLenum destinationFactor)
+{
+	Changed(true);
+	glBlendFunci(buffer, sourceFactor, destinationFactor);
+	blendSourceFactor = Unknown;
+	blendDestinationFactor = Unknown;
+	return true;
+}
+
+bool GLState::SetDepthTest(bool enabled)
+{
+	if (!Changed(depthTest != (int)enabled))
+	{
+		return false;
+	}
+
+	if (enabled)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+	else
+	{
+		glDisable(GL_DEPTH_TEST);
+	}
+	depthTest = (int)enabled;
+	return true;
+}
+
+bool GLState::SetDepthMask(bool enabled)
+{
+	if (!Changed(depthMask != (int)enabled))
+	{
+		return false;
+	}
+
+	glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	depthMask = (int)enabled;
+	return true;
+}
+
+bool GLState::SetDepthFunc(GLenum func)
+{
+	if (!Changed(depthFunc != func))
+	{
+		return false;
+	}
+
+	glDepthFunc(func);
+	depthFunc = func;
+	return true;
+}
+
+bool GLState::SetPolygonMode(GLenum mode)
+{
+	if (!Changed(polygonMode != mode))
+	{
+		return false;
+	}
+
+	glPolygonMode(GL_FRONT_AND_BACK, mode);
+	polygonMode = mode;
+	return true;
+}
+
+void GLState::ForgetProgram(GLuint program)
+{
+	if (GLState::program == program)
+	{
+		GLState::program = Unknown;
+	}
+}
+
+void GLState::ForgetVertexArray(GLuint vertexArray)
+{
+	if (GLState::vertexArray == vertexArray)
+	{
+		GLState::vertexArray = Unknown;
+	}
+}
+
+void GLState::ForgetTexture(GLuint texture)
+{
+	for (uint32_t i = 0; i < MaxTextureUnits; i++)
+	{
+		if (textureUnits[i] == texture)
+		{
+			textureUnits[i] = Unknown;
+		}
+	}
+}
+
+void GLState::ForgetSampler(GLuint sampler)
+{
+	for (uint32_t i = 0; i < MaxTextureUnits; i++)
+	{
+		if (samplerUnits[i] == sampler)
+		{
+			samplerUnits[i] = Unknown;
+		}
+	}
+}
+
+void GLState::ResetStatistics()
+{
+	statistics = GLStateStatistics();
+}
+
+bool GLState::Changed(bool changed)
+{
+	if (changed)
+	{
+		statistics.issuedCalls++;
+	}
+	else
+	{
+		statistics.droppedCalls++;
+	}
+	return changed;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "GLCommon.h"
+
+#include <cstdint>
+
+// How many state calls went through to GL and how many were dropped because GL already had that state, reset in Renderer::BeginFrame
+struct GLStateStatistics
+{
+	uint32_t issuedCalls = 0;
+	uint32_t droppedCalls = 0;
+};
+
+// Shadow copy of the GL state the renderer touches. Every setter compares against what it last sent and only calls into GL when something changes.
+// State changed without going through here makes the shadow copy wrong, so call Invalidate() after handing the context to anything else.
+// The setters return whether the call was issued.
+class GLState
+{
+public:
+	// Forgets everything so the next call of each kind goes through
+	static void Invalidate();
+
+	static bool UseProgram(GLuint program);
+	static bool BindVertexArray(GLuint vertexArray);
+
+	// Binds to the given unit (glBindTextureUnit)
+	static bool BindTextureUnit(GLuint unit, GLuint texture);
+
+	// Binds to the active texture unit, for code that still edits textures through the non DSA calls. The active unit is never changed so this is unit 0.
+	static bool BindTexture(GLenum target, GLuint texture);
+
+	static bool BindSampler(GLuint unit, GLuint sampler);
+
+	static bool SetBlend(bool enabled);
+	static bool SetBlendFunc(GLenum sourceFactor, GLenum destinationFactor);
+
+	// Blend factors of a single draw buffer (glBlendFunci). Always goes through, and leaves the shadow copy of the shared factors unknown so the next SetBlendFunc() does too.
+	static bool SetBlendFunci(GLuint buffer, GLenum sourceFactor, GLenum destinationFactor);
+
+	static bool SetDepthTest(bool enabled);
+	static bool SetDepthMask(bool enabled);
+	static bool SetDepthFunc(GLenum func);
+
+	// Always applies to GL_FRONT_AND_BACK, the only face mode core profiles accept
+	static bool SetPolygonMode(GLenum mode);
+
+	// GL unbinds deleted objects, and the name can be handed out again afterwards
+	static void ForgetProgram(GLuint program);
+	static void ForgetVertexArray(GLuint vertexArray);
+	static void ForgetTexture(GLuint texture);
+	static void ForgetSampler(GLuint sampler);
+
+	inline static const GLStateStatistics& GetStatistics() { return statistics; }
+	static void ResetStatistics();
+
+	static const uint32_t MaxTextureUnits = 48; // Units past this aren't tracked and always go through
+
+private:
+	static bool Changed(bool changed);
+
+	static const GLuint Unknown = 0xFFFFFFFF;
+
+	static GLuint program;
+	static GLuint vertexArray;
+	static GLuint textureUnits[MaxTextureUnits];
+	static GLuint samplerUnits[MaxTextureUnits];
+
+	static int blend; // -1 while unknown
+	static GLenum blendSourceFactor;
+	static GLenum blendDestinationFactor;
+
+	static int depthTest;
+	static int depthMask;
+	static GLenum depthFunc;
+
+	static GLenum polygonMode;
+
+	static GLStateStatistics statistics;
+};
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+
+GeometryAllocation::GeometryAllocation(GeometryArena* arena, uint32_t baseVertex, uint32_t vertexCount, uint32_t firstIndex, uint32_t indexCount)
+	: arena(arena), 
+	baseVertex(baseVertex), 
+	vertexCount(vertexCount), 
+	firstIndex(firstIndex), 
+	indexCount(indexCount)
+{
+
+}
+
+GeometryAllocation::~GeometryAllocation()
+{
+	this->arena->Free(*this);
+}
+
+GeometryArena::GeometryArena(const BufferLayout& layout, uint32_t indexSize, uint32_t vertexCapacity, uint32_t indexCapacity)
+	: layout(layout), 
+	vertexAllocator(vertexCapacity), 
+	indexAllocator(indexCapacity)
+{
+	this->vertexArray = CreateRef<VertexArrayObject>();
+
+	this->vertexBuffer = CreateRef<VertexBuffer>(nullptr, vertexCapacity * layout.GetStride(), true);
+	this->vertexBuffer->SetLayout(layout);
+
+	this->indexBuffer = CreateRef<IndexBuffer>(nullptr, indexCapacity, indexSize, true);
+
+	this->vertexArray->AddVertexBuffer(this->vertexBuffer);
+	this->vertexArray->SetIndexBuffer(this->indexBuffer);
+}
+
+GeometryArena::~GeometryArena()
+{
+
+}
+
+Ref<GeometryAllocation> GeometryArena::Allocate(const void* vertexData, uint32_t vertexCount, const void* indexData, uint32_t indexCount)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	uint32_t baseVertex = 0;
+	if (!this->vertexAllocator.Allocate(vertexCount, baseVertex))
+	{
+		GrowVertexBuffer(std::max(GetVertexCapacity() * 2, GetVertexCapacity() + vertexCount));
+		this->vertexAllocator.Allocate(vertexCount, baseVertex); // The new space at the end is always big enough
+	}
+
+	uint32_t firstIndex = 0;
+	if (!this->indexAllocator.Allocate(indexCount, firstIndex))
+	{
+		GrowIndexBuffer(std::max(GetIndexCapacity() * 2, GetIndexCapacity() + indexCount));
+		this->indexAllocator.Allocate(indexCount, firstIndex);
+	}
+
+	this->vertexBuffer->SetData(vertexData, vertexCount * this->layout.GetStride(), baseVertex * this->layout.GetStride());
+	this->indexBuffer->SetData(indexData, indexCount, firstIndex);
+
+	return CreateRef<GeometryAllocation>(this, baseVertex, vertexCount, firstIndex, indexCount);
+}
+
+void GeometryArena::GetVertexData(void* data, uint32_t vertexCount, uint32_t baseVertex) const
+{
+	this->vertexBuffer->GetData(data, vertexCount * this->layout.GetStride(), baseVertex * this->layout.GetStride());
+}
+
+void GeometryArena::GetIndexData(void* data, uint32_t indexCount, uint32_t firstIndex) const
+{
+	this->indexBuffer->GetData(data, indexCount, firstIndex);
+}
+
+void GeometryArena::Free(const GeometryAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->vertexAllocator.Free(allocation.GetBaseVertex(), allocation.GetVertexCount());
+	this->indexAllocator.Free(allocation.GetFirstIndex(), allocation.GetIndexCount());
+}
+
+void GeometryArena::GrowVertexBuffer(uint32_t vertexCapacity)
+{
+	// Copy everything over on the GPU, then point the VAO at the new buffer. Meshes keep their offsets so nothing else has to know.
+	Ref<VertexBuffer> grownBuffer = CreateRef<VertexBuffer>(nullptr, vertexCapacity * this->layout.GetStride(), true);
+	grownBuffer->SetLayout(this->layout);
+	glCopyNamedBufferSubData(this->vertexBuffer->GetID(), grownBuffer->GetID(), 0, 0, this->vertexBuffer->GetSize());
+
+	this->vertexBuffer = grownBuffer;
+	this->vertexArray->ReplaceVertexBuffer(0, this->vertexBuffer);
+	this->vertexAllocator.Grow(vertexCapacity);
+}
+
+void GeometryArena::GrowIndexBuffer(uint32_t indexCapacity)
+{
+	Ref<IndexBuffer> grownBuffer = CreateRef<IndexBuffer>(nullptr, indexCapacity, this->indexBuffer->GetIndexSize(), true);
+	glCopyNamedBufferSubData(this->indexBuffer->GetID(), grownBuffer->GetID(), 0, 0, this->indexBuffer->GetCount() * this->indexBuffer->GetIndexSize());
+
+	this->indexBuffer = grownBuffer;
+	this->vertexArray->SetIndexBuffer(this->indexBuffer);
+	this->indexAllocator.Grow(indexCapacity);
+}
\ No newline at end of file
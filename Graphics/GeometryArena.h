@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch.h"
+#include "VertexArrayObject.h"
+#include "FreeListAllocator.h"
+
+#include <mutex>
+
+class GeometryArena;
+
+// A mesh's slice of a GeometryArena. The ranges go back to the arena once the last reference to this is gone.
+class GeometryAllocation
+{
+public:
+	GeometryAllocation(GeometryArena* arena, uint32_t baseVertex, uint32_t vertexCount, uint32_t firstIndex, uint32_t indexCount);
+	virtual ~GeometryAllocation();
+
+	inline GeometryArena* GetArena() const { return this->arena; }
+
+	// Where the mesh's vertices and indices start in the arena's buffers
+	inline uint32_t GetBaseVertex() const { return this->baseVertex; }
+	inline uint32_t GetFirstIndex() const { return this->firstIndex; }
+
+	inline uint32_t GetVertexCount() const { return this->vertexCount; }
+	inline uint32_t GetIndexCount() const { return this->indexCount; }
+
+private:
+	GeometryArena* arena;
+	uint32_t baseVertex;
+	uint32_t vertexCount;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// One large vertex buffer and index buffer shared by every mesh with the same vertex layout and index size, all behind a single VAO.
+// Meshes are suballocated out of it with a free list and drawn with a base vertex and first index, so drawing different meshes doesn't need a VAO switch.
+// The buffers double in size when they run out of room. Arenas are expected to outlive every allocation made from them (see MeshManager).
+class GeometryArena
+{
+public:
+	GeometryArena(const BufferLayout& layout, uint32_t indexSize, uint32_t vertexCapacity = 1 << 16, uint32_t indexCapacity = 1 << 18);
+	virtual ~GeometryArena();
+
+	// Copies the geometry into the arena. Must be called on the GL thread.
+	Ref<GeometryAllocation> Allocate(const void* vertexData, uint32_t vertexCount, const void* indexData, uint32_t indexCount);
+
+	// Reads part of the arena back from the GPU. Must be called on the GL thread.
+	void GetVertexData(void* data, uint32_t vertexCount, uint32_t baseVertex) const;
+	void GetIndexData(void* data, uint32_t indexCount, uint32_t firstIndex) const;
+
+	inline const Ref<VertexArrayObject>& GetVertexArray() const { return this->vertexArray; }
+	inline const Ref<VertexBuffer>& GetVertexBuffer() const { return this->vertexBuffer; }
+	inline const Ref<IndexBuffer>& GetIndexBuffer() const { return this->indexBuffer; }
+
+	inline uint32_t GetIndexSize() const { return this->indexBuffer->GetIndexSize(); }
+	inline GLenum GetIndexType() const { return this->indexBuffer->GetIndexType(); }
+
+	inline uint32_t GetVertexCapacity() const { return this->vertexAllocator.GetCapacity(); }
+	inline uint32_t GetIndexCapacity() const { return this->indexAllocator.GetCapacity(); }
+	inline uint32_t GetUsedVertices() const { return this->vertexAllocator.GetUsed(); }
+	inline uint32_t GetUsedIndices() const { return this->indexAllocator.GetUsed(); }
+
+private:
+	friend class GeometryAllocation;
+	void Free(const GeometryAllocation& allocation);
+
+	void GrowVertexBuffer(uint32_t vertexCapacity);
+	void GrowIndexBuffer(uint32_t indexCapacity);
+
+	Ref<VertexArrayObject> vertexArray;
+	Ref<VertexBuffer> vertexBuffer;
+	Ref<IndexBuffer> indexBuffer;
+	BufferLayout layout;
+
+	FreeListAllocator vertexAllocator;
+	FreeListAllocator indexAllocator;
+	std::mutex mutex; // Allocations can be released from any thread
+};
\ No newline at end of file
@@ -2,9 +2,13 @@
 #include "YAMLOverloads.h"
 
 #include <iostream>
-#include <sstream>
+#include <algorithm>
+#include <cmath>
 
-std::vector<LightUniform> Light::lightUniforms;
+std::vector<LightUniformData> Light::lightData;
+uint32_t Light::dirtyBegin = 0;
+uint32_t Light::dirtyEnd = 0;
+Ref<StorageBuffer> Light::lightBuffer;
 
 Light::Light(int index) :
 	index(index), 
@@ -18,6 +22,7 @@ Light::Light(int index) :
 	state(true)
 {
 	this->lightType = POINT;
+	this->influenceRadius = std::min(CalcDistFromAtten(InfluenceCutoff, this->attenuation.x, this->attenuation.y, this->attenuation.z), this->attenuation.w);
 }
 
 Light::~Light()
@@ -28,31 +33,32 @@ Light::~Light()
 void Light::EditPosition(float x, float y, float z, float w)
 {
 	this->position = glm::vec4(x, y, z, w);
-	glUniform4f(lightUniforms[this->index].positionLocation, this->position.x, this->position.y, this->position.z, this->position.w);
+	SendToShader();
 }
 
 void Light::EditDiffuse(float x, float y, float z, float w)
 {
 	this->diffuse = glm::vec4(x, y, z, w);
-	glUniform4f(lightUniforms[this->index].diffuseLocation, this->diffuse.x, this->diffuse.y, this->diffuse.z, this->diffuse.w);
+	SendToShader();
 }
 
 void Light::EditSpecular(float r, float g, float b, float power)
 {
 	this->specular = glm::vec4(r, g, b, power);
-	glUniform4f(lightUniforms[this->index].specularLocation, this->specular.x, this->specular.y, this->specular.z, this->specular.w);
+	SendToShader();
 }
 
 void Light::EditAttenuation(float constant, float linear, float quadratic, float distanceCutOff)
 {
 	this->attenuation = glm::vec4(constant, linear, quadratic, distanceCutOff);
-	glUniform4f(lightUniforms[this->index].attenuationLocation, this->attenuation.x, this->attenuation.y, this->attenuation.z, this->attenuation.w);
+	this->influenceRadius = std::min(CalcDistFromAtten(InfluenceCutoff, constant, linear, quadratic), distanceCutOff); // The shader ignores anything past the cutoff distance
+	SendToShader();
 }
 
 void Light::EditDirection(float x, float y, float z, float w)
 {
 	this->direction = glm::vec4(x, y, z, w);
-	glUniform4f(lightUniforms[this->index].directionLocation, this->direction.x, this->direction.y, this->direction.z, this->direction.w);
+	SendToShader();
 }
 
 void Light::EditLightType(LightType lightType, float innerAngle, float outerAngle)
@@ -60,32 +66,59 @@ void Light::EditLightType(LightType lightType, float innerAngle, float outerAngl
 	this->lightType = lightType;
 	this->innerAngle = innerAngle;
 	this->outerAngle = outerAngle;
-	glUniform4f(lightUniforms[this->index].param1Location, (float)this->lightType, this->innerAngle, this->outerAngle, 1.0f);
+	SendToShader();
 }
 
 void Light::EditState(bool on)
 {
 	this->state = on;
-	glUniform4f(lightUniforms[this->index].param2Location, on ? (float) GL_TRUE : (float) GL_FALSE, 1.0f, 1.0f, 1.0f);
+	SendToShader();
 }
 
 void Light::SendToShader()
 {	
-	glUniform4f(lightUniforms[this->index].positionLocation, this->position.x, this->position.y, this->position.z, this->position.w);
-	glUniform4f(lightUniforms[this->index].diffuseLocation, this->diffuse.x, this->diffuse.y, this->diffuse.z, this->diffuse.w);
-	glUniform4f(lightUniforms[this->index].specularLocation, this->specular.x, this->specular.y, this->specular.z, this->specular.w);
-	glUniform4f(lightUniforms[this->index].attenuationLocation, this->attenuation.x, this->attenuation.y, this->attenuation.z, this->attenuation.w);
-	glUniform4f(lightUniforms[this->index].directionLocation, this->direction.x, this->direction.y, this->direction.z, this->direction.w);
-	glUniform4f(lightUniforms[this->index].param1Location, (float)this->lightType, this->innerAngle, this->outerAngle, 1.0f);
-
-	if (this->state)
+	if (this->index >= lightData.size())
 	{
-		glUniform4f(lightUniforms[this->index].param2Location, (float) GL_TRUE, 1.0f, 1.0f, 1.0f);
+		lightData.resize(std::max((size_t)this->index + 1, lightData.size() * 2), LightUniformData()); // Zeroed lights are off
 	}
-	else
+
+	lightData[this->index] = ToUniformData();
+	dirtyBegin = std::min(dirtyBegin, this->index);
+	dirtyEnd = std::max(dirtyEnd, this->index + 1);
+}
+
+LightUniformData Light::ToUniformData() const
+{
+	LightUniformData data;
+	data.position = this->position;
+	data.diffuse = this->diffuse;
+	data.specular = this->specular;
+	data.attenuation = this->attenuation;
+	data.direction = this->direction;
+	data.param1 = glm::vec4((float)this->lightType, this->innerAngle, this->outerAngle, 1.0f);
+	data.param2 = glm::vec4(this->state ? (float)GL_TRUE : (float)GL_FALSE, 1.0f, 1.0f, 1.0f);
+	return data;
+}
+
+void Light::UploadLights()
+{
+	uint32_t requiredSize = (uint32_t)(lightData.size() * sizeof(LightUniformData));
+	if (lightBuffer->GetSize() < requiredSize)
+	{
+		lightBuffer = CreateRef<StorageBuffer>(requiredSize, StorageBinding);
+		lightBuffer->Bind();
+		dirtyBegin = 0; // The new buffer starts out empty
+		dirtyEnd = (uint32_t)lightData.size();
+	}
+
+	if (dirtyBegin >= dirtyEnd)
 	{
-		glUniform4f(lightUniforms[this->index].param2Location, (float) GL_FALSE, 1.0f, 1.0f, 1.0f);
+		return;
 	}
+
+	lightBuffer->SetData(&lightData[dirtyBegin], (dirtyEnd - dirtyBegin) * sizeof(LightUniformData), dirtyBegin * sizeof(LightUniformData));
+	dirtyBegin = (uint32_t)lightData.size();
+	dirtyEnd = 0;
 }
 
 void Light::Save(YAML::Emitter& emitter) const
@@ -121,127 +154,49 @@ Ref<Light> Light::StaticLoad(YAML::Node& node)
 	light->position = position;
 	light->diffuse = diffuse;
 	light->specular = specular;
-	light->attenuation = attenuation;
 	light->direction = direction;
 	light->lightType = lightType;
 	light->outerAngle = outerAngle;
 	light->innerAngle = innerAngle;
 	light->state = state;
+	light->EditAttenuation(attenuation.x, attenuation.y, attenuation.z, attenuation.w);
 
 	return light;
 }
 
 void Light::InitializeUniforms(Ref<Shader> shader)
 {
-	GLuint shaderID = shader->GetID();
-
-	Light::lightUniforms.resize(Light::numOfLights);
+	Light::lightData.assign(Light::initialLightCount, LightUniformData()); // Zeroed lights are off
+	Light::dirtyBegin = 0;
+	Light::dirtyEnd = Light::initialLightCount;
 
-	for (int i = 0; i < numOfLights; i++)
-	{
-		LightUniform& lightUniform = Light::lightUniforms[i];
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].position";
-			lightUniform.positionLocation = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].diffuse";
-			lightUniform.diffuseLocation = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].specular";
-			lightUniform.specularLocation = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].attenuation";
-			lightUniform.attenuationLocation = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].direction";
-			lightUniform.directionLocation = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].param1";
-			lightUniform.param1Location = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-		{
-			std::stringstream ss;
-			ss << "lightArray[" << i << "].param2";
-			lightUniform.param2Location = glGetUniformLocation(shaderID, ss.str().c_str());
-		}
-	}
+	Light::lightBuffer = CreateRef<StorageBuffer>(Light::initialLightCount * (uint32_t)sizeof(LightUniformData), StorageBinding);
+	Light::lightBuffer->Bind();
+	shader->SetStorageBlockBinding("LightData", StorageBinding);
 }
 
-float Light::CalcApproxDistFromAtten(float targetLightLevel, float accuracy, float infiniteDistance,
-	float constAttenuation,
-	float linearAttenuation,
-	float quadraticAttenuation,
-	unsigned int maxIterations)
+float Light::CalcDistFromAtten(float targetLightLevel, float constAttenuation, float linearAttenuation, float quadraticAttenuation, float infiniteDistance)
 {
-	// See if the accuracy being set it too big for the targetLightLevel, unless targetLightLevel is actually zero (0.0f)
-	// If it's actually zero, then adjusting the accuracy to a tenth of zero would give... wait for it...
-	//	zero, and we would max out the iterations
-	if (targetLightLevel != 0.0f)
+	if (targetLightLevel <= 0.0f)
 	{
-		if ((accuracy * 10.0f) >= targetLightLevel * 10.0f)
-		{	// Adjust the accuracy by a hundreth
-			accuracy = targetLightLevel / 10.0f;
-		}
+		return infiniteDistance;
 	}
 
-	float targetLightLevelLow = targetLightLevel - accuracy;
-	float targetLightLevelHigh = targetLightLevel + accuracy;
-
-	constexpr float defaultInfiniteDistance = 10000.0f;
-	// See if we're getting a value at infinite. i.e. at 'infinite distance', is the light level too high already
-	if (CalcDiffuseFromAttenByDistance(defaultInfiniteDistance,
-		constAttenuation, linearAttenuation, quadraticAttenuation,
-		accuracy) > targetLightLevelHigh)
-	{	// Yes, so we can never get down to this light level
-		return defaultInfiniteDistance;
+	// The positive root of quadratic * d^2 + linear * d + (constant - 1 / targetLightLevel) = 0, written as 2k / (linear + sqrt(linear^2 + 4 * quadratic * k))
+	// so it doesn't lose precision when the quadratic term is tiny and still works when it's 0
+	float k = 1.0f / targetLightLevel - constAttenuation;
+	if (k <= 0.0f)
+	{
+		return 0.0f;
 	}
 
-	// There is a light level somewhere between a distance of 0.0 to DEFAULTINFINITEDISTANCE
-	// Set initial guesses
-	float distanceGuessLow = 0.0f;
-	float distanceGuessHigh = defaultInfiniteDistance;
-
-	unsigned int iterationCount = 0;
-	while (iterationCount < maxIterations)
+	float denominator = linearAttenuation + std::sqrt(std::max(linearAttenuation * linearAttenuation + 4.0f * quadraticAttenuation * k, 0.0f));
+	if (denominator <= 0.0f) // No falloff
 	{
-		// Pick a distance between the high and low
-		float curDistanceGuess = ((distanceGuessHigh - distanceGuessLow) / 2.0f) + distanceGuessLow;
-		float curDiffuseAtGuessDistance = CalcDiffuseFromAttenByDistance(curDistanceGuess, constAttenuation, linearAttenuation, quadraticAttenuation, 0.0001f);
-
-		// Could be three possibilities: too low, too high, or in between
-		if (curDiffuseAtGuessDistance < targetLightLevelLow)
-		{	// Light is too dark, so distance is to HIGH. Reduce and guess again.
-			distanceGuessHigh = curDistanceGuess;		// Lower the high limit for the guesses
-		}
-		else if (curDiffuseAtGuessDistance > targetLightLevelHigh)
-		{	// Light is too bright, so distance is to LOW. Increase and guess again
-			distanceGuessLow = curDistanceGuess;
-		}
-		else
-		{	// Nailed it! Light level is within range, so return this distance
-			return curDistanceGuess;
-		}
-
-		iterationCount++;
-
+		return infiniteDistance;
 	}
 
-	// If we are here, then we ran out of iterations.
-	// Pick a distance between the low and high
-	float distance = (distanceGuessHigh - distanceGuessLow) / 2.0f;
-
-	return distance;
+	return std::min(2.0f * k / denominator, infiniteDistance);
 }
 
 float Light::CalcDiffuseFromAttenByDistance(float distance,
@@ -3,6 +3,7 @@
 #include "pch.h"
 #include "GLCommon.h"
 #include "Shader.h"
+#include "StorageBuffer.h"
 #include "Serializable.h"
 
 #include <glm/glm.hpp>
@@ -11,15 +12,19 @@
 
 #include <iostream>
 
-struct LightUniform
+// One element of the light array in the "LightData" storage block, laid out std430:
+// struct Light { vec4 position; vec4 diffuse; vec4 specular; vec4 attenuation; vec4 direction; vec4 param1; vec4 param2; };
+// layout(std430) readonly buffer LightData { Light lightArray[]; };
+// The array is as long as the highest light index needs, the shader only reaches lights through the cluster lists (see LightClusters) or an instance's own list (see LightGrid).
+struct LightUniformData
 {
-	GLuint positionLocation = 0;
-	GLuint diffuseLocation = 0;
-	GLuint specularLocation = 0;
-	GLuint attenuationLocation = 0;
-	GLuint directionLocation = 0;
-	GLuint param1Location = 0; // vec4(lightType, innerAngle, outerAngle, ???)
-	GLuint param2Location = 0; // vec4(isLightOn, ???, ???, ???)
+	glm::vec4 position;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	glm::vec4 attenuation;
+	glm::vec4 direction;
+	glm::vec4 param1; // vec4(lightType, innerAngle, outerAngle, ???)
+	glm::vec4 param2; // vec4(isLightOn, ???, ???, ???)
 };
 
 class Light 
@@ -44,7 +49,7 @@ public:
 	// Modifies the specular color and power of this light
 	void EditSpecular(float r, float g, float b, float power);
 
-	// Modifies the attenuation this light
+	// Modifies the attenuation this light, and works out its influence radius again
 	void EditAttenuation(float constant, float linear, float quadratic, float distanceCutOff);
 
 	// Modifies the direction of this light (Does nothing if we aren't a SPOT/DIRECTIONAL light)
@@ -56,19 +61,29 @@ public:
 	// Modifies if the light is on or off
 	void EditState(bool on);
 
-	// Will copy this light's information to the shader (WARNING: Make sure you call SetupUniforms() before calling this to ensure that this object's uniform locations are set.)
+	// Copies this light's information into the light storage block, growing it if the index is past its end. It reaches the GPU with the next UploadLights(), so the shader doesn't need to be bound.
 	void SendToShader();
 
 	virtual void Save(YAML::Emitter& emitter) const;
 
 	static Ref<Light> StaticLoad(YAML::Node& node);
 
+	// Creates the light storage buffer and attaches the shader's LightData block to it
 	static void InitializeUniforms(Ref<Shader> shader);
-	static float CalcApproxDistFromAtten(float targetLightLevel, float accuracy, float infiniteDistance, 
-		float constAttenuation = 0.1f, 
-		float linearAttenuation = 0.1f,
-		float quadraticAttenuation = 0.1, 
-		unsigned int maxIterations = 50);
+
+	// Writes every light changed since the last call to the storage buffer in one go, replacing the buffer with a bigger one if the lights outgrew it
+	static void UploadLights();
+
+	// How far the light reaches before its attenuation drops below InfluenceCutoff, capped by its cutoff distance (attenuation.w).
+	// Only worked out when the attenuation is edited, so culling and light assignment can read it every frame for free.
+	inline float GetInfluenceRadius() const { return this->influenceRadius; }
+
+	static const uint32_t StorageBinding = 1; // Shader storage binding point of LightData
+	static constexpr float InfluenceCutoff = 0.005f; // Attenuation below which a light no longer counts as reaching a point
+
+	// Distance at which 1 / (constant + linear * d + quadratic * d^2) falls to targetLightLevel, solved in closed form.
+	// 0 if the light never gets that bright, and at most infiniteDistance for lights that never get that dark.
+	static float CalcDistFromAtten(float targetLightLevel, float constAttenuation, float linearAttenuation, float quadraticAttenuation, float infiniteDistance = 10000.0f);
 
 	static float CalcDiffuseFromAttenByDistance(float distance,
 		float constAttenuation,
@@ -80,7 +95,7 @@ public:
 	glm::vec4 position;
 	glm::vec4 diffuse;
 	glm::vec4 specular;
-	glm::vec4 attenuation;
+	glm::vec4 attenuation; // Set through EditAttenuation() so the influence radius keeps up
 	glm::vec4 direction;
 	LightType lightType;
 	float innerAngle;
@@ -92,9 +107,16 @@ public:
 private:
 	friend class Scene;
 
-	// Uniforms
-	static std::vector<LightUniform> lightUniforms;
-	static const int numOfLights = 100;
+	LightUniformData ToUniformData() const;
+
+	float influenceRadius;
+
+	// CPU copy of the light block, lights in [dirtyBegin, dirtyEnd) changed since the last upload
+	static std::vector<LightUniformData> lightData;
+	static uint32_t dirtyBegin;
+	static uint32_t dirtyEnd;
+	static Ref<StorageBuffer> lightBuffer;
+	static const uint32_t initialLightCount = 128;
 };
 
 static std::string LightTypeToString(Light::LightType lightType)
@@ -0,0 +1,247 @@
+#include "LightClusters.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+LightClusters::LightClusters()
+	: maxClusterLightCount(0),
+	projectionX(1.0f),
+	projectionY(1.0f),
+	nearPlane(1.0f),
+	farPlane(2.0f),
+	sliceScale(1.0f),
+	sliceBias(0.0f),
+	clusterParametersUniform(-1),
+	globalLightCountUniform(-1)
+{
+	this->slices.resize(GridZ);
+	this->clusters.resize(ClusterCount);
+}
+
+void LightClusters::Initialize(Ref<Shader> shader)
+{
+	this->shader = shader;
+	this->clusterParametersUniform = shader->GetUniformLocation("clusterParameters");
+	this->globalLightCountUniform = shader->GetUniformLocation("globalLightCount");
+
+	this->clusterBuffer = CreateRef<StorageBuffer>(ClusterCount * (uint32_t)sizeof(glm::uvec2), ClusterStorageBinding);
+	this->clusterBuffer->Bind();
+	shader->SetStorageBlockBinding("ClusterData", ClusterStorageBinding);
+	shader->SetStorageBlockBinding("ClusterLightIndices", IndexStorageBinding);
+}
+
+void LightClusters::Update(const std::vector<Ref<SceneLight>>& lights, const glm::mat4& view)
+{
+	float width = Renderer::GetViewportWidth();
+	float height = Renderer::GetViewportHeight();
+	float tanHalfFov = tan(Renderer::GetFieldOfView() * 0.5f);
+	this->projectionY = 1.0f / tanHalfFov;
+	this->projectionX = this->projectionY * height / width;
+	this->nearPlane = Renderer::GetNearPlane();
+	this->farPlane = Renderer::GetFarPlane();
+	this->sliceScale = GridZ / log(this->farPlane / this->nearPlane);
+	this->sliceBias = -log(this->nearPlane) * this->sliceScale;
+
+	// Directional lights reach everything, so they get one shared list at the front instead of an entry in every cluster
+	this->lightIndices.clear();
+	this->clusterLights.clear();
+	for (const Ref<SceneLight>& sceneLight : lights)
+	{
+		const Light& light = *sceneLight->light;
+		if (!light.state)
+		{
+			continue;
+		}
+
+		if (light.lightType == Light::DIRECTIONAL)
+		{
+			this->lightIndices.push_back(light.index);
+			continue;
+		}
+
+		float radius = light.GetInfluenceRadius();
+
+		glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.position), 1.0f));
+		float depth = -center.z; // The view looks down -Z
+		if (depth + radius < this->nearPlane || depth - radius > this->farPlane)
+		{
+			continue;
+		}
+
+		ClusterLight clusterLight;
+		clusterLight.center = center;
+		clusterLight.radius = radius;
+		clusterLight.firstSlice = GetSlice(std::max(depth - radius, this->nearPlane));
+		clusterLight.lastSlice = GetSlice(std::min(depth + radius, this->farPlane));
+		clusterLight.index = light.index;
+		this->clusterLights.push_back(clusterLight);
+	}
+	uint32_t globalLightCount = (uint32_t)this->lightIndices.size();
+
+	// Every slice only writes its own clusters and lists, so they can be filled in parallel. Slices are dealt out round robin since the ones near the camera tend to be the busy ones.
+	ThreadPool& pool = ThreadPool::Get();
+	uint32_t taskCount = this->clusterLights.empty() ? 1 : std::min(GridZ, pool.GetThreadCount() + 1); // The calling thread takes a share too
+	std::vector<std::future<void>> futures;
+	for (uint32_t task = 1; task < taskCount; task++)
+	{
+		futures.push_back(pool.Submit([this, task, taskCount]() { AssignSlices(task, taskCount); }));
+	}
+
+	AssignSlices(0, taskCount);
+	for (std::future<void>& future : futures)
+	{
+		future.get();
+	}
+
+	// Stitch the slices' lists together after the directional lights
+	uint32_t base = globalLightCount;
+	for (Slice& slice : this->slices)
+	{
+		slice.base = base;
+		base += (uint32_t)slice.indices.size();
+	}
+
+	this->lightIndices.resize(base);
+	this->maxClusterLightCount = 0;
+	for (uint32_t z = 0; z < GridZ; z++)
+	{
+		const Slice& slice = this->slices[z];
+		std::copy(slice.indices.begin(), slice.indices.end(), this->lightIndices.begin() + slice.base);
+
+		glm::uvec2* sliceClusters = &this->clusters[z * GridX * GridY];
+		for (uint32_t tile = 0; tile < GridX * GridY; tile++)
+		{
+			sliceClusters[tile].x += slice.base;
+			this->maxClusterLightCount = std::max(this->maxClusterLightCount, sliceClusters[tile].y);
+		}
+	}
+
+	uint32_t indexSize = (uint32_t)(std::max(this->lightIndices.size(), (size_t)1) * sizeof(uint32_t));
+	if (!this->indexBuffer || this->indexBuffer->GetSize() < indexSize)
+	{
+		this->indexBuffer = CreateRef<StorageBuffer>(std::max(indexSize, this->indexBuffer ? this->indexBuffer->GetSize() * 2 : 0), IndexStorageBinding);
+		this->indexBuffer->Bind();
+	}
+
+	this->clusterBuffer->SetData(this->clusters.data(), ClusterCount * (uint32_t)sizeof(glm::uvec2));
+	this->indexBuffer->SetData(this->lightIndices.data(), (uint32_t)(this->lightIndices.size() * sizeof(uint32_t)));
+
+	this->shader->SetFloat4(this->clusterParametersUniform, glm::vec4(width / GridX, height / GridY, this->sliceScale, this->sliceBias));
+	this->shader->SetFloat(this->globalLightCountUniform, (float)globalLightCount);
+}
+
+void LightClusters::AssignSlices(uint32_t firstSlice, uint32_t sliceStep)
+{
+	for (uint32_t slice = firstSlice; slice < GridZ; slice += sliceStep)
+	{
+		AssignSlice(slice);
+	}
+}
+
+void LightClusters::AssignSlice(uint32_t sliceIndex)
+{
+	Slice& slice = this->slices[sliceIndex];
+	slice.pairs.clear();
+
+	float sliceNear = GetSliceDepth(sliceIndex);
+	float sliceFar = GetSliceDepth(sliceIndex + 1);
+	for (uint32_t i = 0; i < this->clusterLights.size(); i++)
+	{
+		const ClusterLight& light = this->clusterLights[i];
+		if (sliceIndex < light.firstSlice || sliceIndex > light.lastSlice)
+		{
+			continue;
+		}
+
+		// The part of the sphere's bounding box inside the slice projects to a screen rectangle bounded by its corners, since x / depth only grows or shrinks with depth
+		float depth = -light.center.z;
+		float nearDepth = std::max(sliceNear, depth - light.radius);
+		float farDepth = std::min(sliceFar, depth + light.radius);
+		float minX = light.center.x - light.radius, maxX = light.center.x + light.radius;
+		float minY = light.center.y - light.radius, maxY = light.center.y + light.radius;
+		float ndcMinX = this->projectionX * std::min(minX / nearDepth, minX / farDepth);
+		float ndcMaxX = this->projectionX * std::max(maxX / nearDepth, maxX / farDepth);
+		float ndcMinY = this->projectionY * std::min(minY / nearDepth, minY / farDepth);
+		float ndcMaxY = this->projectionY * std::max(maxY / nearDepth, maxY / farDepth);
+		if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+		{
+			continue;
+		}
+
+		uint32_t firstX = (uint32_t)std::max((ndcMinX * 0.5f + 0.5f) * GridX, 0.0f);
+		uint32_t lastX = std::min((uint32_t)std::max((ndcMaxX * 0.5f + 0.5f) * GridX, 0.0f), GridX - 1);
+		uint32_t firstY = (uint32_t)std::max((ndcMinY * 0.5f + 0.5f) * GridY, 0.0f);
+		uint32_t lastY = std::min((uint32_t)std::max((ndcMaxY * 0.5f + 0.5f) * GridY, 0.0f), GridY - 1);
+
+		// The rectangle is loose around the sphere, so check it against each cluster's view space box
+		float radiusSquared = light.radius * light.radius;
+		float closestZ = std::min(std::max(depth, sliceNear), sliceFar);
+		float distanceZ = depth - closestZ;
+		for (uint32_t y = firstY; y <= lastY; y++)
+		{
+			float tileMinY = (2.0f * y / GridY - 1.0f) / this->projectionY; // Tile edges as view space slopes (y / depth)
+			float tileMaxY = (2.0f * (y + 1) / GridY - 1.0f) / this->projectionY;
+			float boxMinY = std::min(tileMinY * sliceNear, tileMinY * sliceFar);
+			float boxMaxY = std::max(tileMaxY * sliceNear, tileMaxY * sliceFar);
+			float distanceY = light.center.y - std::min(std::max(light.center.y, boxMinY), boxMaxY);
+
+			for (uint32_t x = firstX; x <= lastX; x++)
+			{
+				float tileMinX = (2.0f * x / GridX - 1.0f) / this->projectionX;
+				float tileMaxX = (2.0f * (x + 1) / GridX - 1.0f) / this->projectionX;
+				float boxMinX = std::min(tileMinX * sliceNear, tileMinX * sliceFar);
+				float boxMaxX = std::max(tileMaxX * sliceNear, tileMaxX * sliceFar);
+				float distanceX = light.center.x - std::min(std::max(light.center.x, boxMinX), boxMaxX);
+
+				if (distanceX * distanceX + distanceY * distanceY + distanceZ * distanceZ <= radiusSquared)
+				{
+					slice.pairs.push_back(((y * GridX + x) << 24) | i);
+				}
+			}
+		}
+	}
+
+	// Counting sort the pairs by cluster, which turns them into one list per cluster
+	glm::uvec2* sliceClusters = &this->clusters[sliceIndex * GridX * GridY];
+	for (uint32_t tile = 0; tile < GridX * GridY; tile++)
+	{
+		sliceClusters[tile] = glm::uvec2(0);
+	}
+
+	for (uint32_t pair : slice.pairs)
+	{
+		sliceClusters[pair >> 24].y++;
+	}
+
+	uint32_t offset = 0;
+	for (uint32_t tile = 0; tile < GridX * GridY; tile++)
+	{
+		sliceClusters[tile].x = offset; // Relative to the slice until Update() knows where the slice's list goes
+		offset += sliceClusters[tile].y;
+	}
+
+	slice.indices.resize(slice.pairs.size());
+	uint32_t cursors[GridX * GridY];
+	for (uint32_t tile = 0; tile < GridX * GridY; tile++)
+	{
+		cursors[tile] = sliceClusters[tile].x;
+	}
+
+	for (uint32_t pair : slice.pairs)
+	{
+		slice.indices[cursors[pair >> 24]++] = this->clusterLights[pair & 0xFFFFFF].index;
+	}
+}
+
+float LightClusters::GetSliceDepth(uint32_t slice) const
+{
+	return this->nearPlane * pow(this->farPlane / this->nearPlane, (float)slice / GridZ);
+}
+
+uint32_t LightClusters::GetSlice(float depth) const
+{
+	float slice = log(depth) * this->sliceScale + this->sliceBias;
+	return std::min((uint32_t)std::max(slice, 0.0f), GridZ - 1);
+}
\ No newline at end of file
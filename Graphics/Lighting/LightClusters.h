@@ -0,0 +1,90 @@
+#pragma once
+
+#include "pch.h"
+#include "Light.h"
+#include "SceneLight.h"
+#include "Shader.h"
+#include "StorageBuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Clustered forward light assignment (Olsson et al. 2012). The view frustum is split into a froxel grid of GridX by GridY screen tiles and GridZ depth slices spaced exponentially,
+// and every light is listed in the clusters its sphere of influence touches. Assignment runs on the CPU with the depth slices spread over the thread pool.
+// The fragment shader finds its cluster and only loops over the lights listed there:
+// layout(std430) readonly buffer ClusterData { uvec2 clusters[]; }; // x: first entry in clusterLightIndices, y: light count. Indexed by (slice * GridY + tileY) * GridX + tileX
+// layout(std430) readonly buffer ClusterLightIndices { uint clusterLightIndices[]; }; // Indices into lightArray
+// uniform vec4 clusterParameters; // xy: tile size in pixels, z: slice scale, w: slice bias. slice = int(log(viewDepth) * z + w), clamped to the grid
+// uniform float globalLightCount; // The first this many entries of clusterLightIndices are directional lights, which light every pixel
+class LightClusters
+{
+public:
+	LightClusters();
+
+	// Attaches the shader's cluster blocks to their buffers and looks up its cluster uniforms
+	void Initialize(Ref<Shader> shader);
+
+	// Assigns the lights to the clusters of this frame's view and uploads the lists. Lights that are off are left out.
+	// Uses the projection and viewport of the current frame, so call after Renderer::BeginFrame().
+	void Update(const std::vector<Ref<SceneLight>>& lights, const glm::mat4& view);
+
+	// Light index entries across all clusters, and the most any one cluster got
+	inline uint32_t GetAssignmentCount() const { return (uint32_t)this->lightIndices.size(); }
+	inline uint32_t GetMaxClusterLightCount() const { return this->maxClusterLightCount; }
+
+	static const uint32_t GridX = 16;
+	static const uint32_t GridY = 9;
+	static const uint32_t GridZ = 24;
+	static const uint32_t ClusterCount = GridX * GridY * GridZ;
+	static_assert(GridX * GridY <= 256, "Tiles are packed into 8 bits while sorting");
+
+	static const uint32_t ClusterStorageBinding = 2; // Shader storage binding points of ClusterData and ClusterLightIndices
+	static const uint32_t IndexStorageBinding = 3;
+
+private:
+	// A point or spot light in view space. Spot lights are treated as the sphere around their full range.
+	struct ClusterLight
+	{
+		glm::vec3 center;
+		float radius;
+		uint32_t firstSlice;
+		uint32_t lastSlice;
+		uint32_t index; // Into lightArray
+	};
+
+	struct Slice
+	{
+		std::vector<uint32_t> pairs; // (tile << 24) | light, tile being the cluster's index within the slice and light an index into clusterLights
+		std::vector<uint32_t> indices; // Light indices of the slice's clusters, one after the other
+		uint32_t base; // Where indices starts in the combined list
+	};
+
+	// Fills in the clusters of the given slices and their index lists
+	void AssignSlices(uint32_t firstSlice, uint32_t sliceStep);
+	void AssignSlice(uint32_t slice);
+
+	// Depth in front of the camera where a slice starts
+	float GetSliceDepth(uint32_t slice) const;
+	uint32_t GetSlice(float depth) const;
+
+	std::vector<ClusterLight> clusterLights;
+	std::vector<Slice> slices;
+	std::vector<glm::uvec2> clusters;
+	std::vector<uint32_t> lightIndices; // Directional lights first, then every slice's lists
+	uint32_t maxClusterLightCount;
+
+	// Projection of the frame being assigned
+	float projectionX; // projection[0][0]
+	float projectionY; // projection[1][1]
+	float nearPlane;
+	float farPlane;
+	float sliceScale;
+	float sliceBias;
+
+	Ref<Shader> shader;
+	GLint clusterParametersUniform;
+	GLint globalLightCountUniform;
+	Ref<StorageBuffer> clusterBuffer;
+	Ref<StorageBuffer> indexBuffer;
+};
\ No newline at end of file
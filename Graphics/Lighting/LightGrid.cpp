@@ -0,0 +1,192 @@
+#include "LightGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const int32_t CellLimit = 1 << 20; // Cell coordinates run from -CellLimit to CellLimit - 1
+	const float MinCellSize = 1.0f;
+}
+
+LightGrid::LightGrid()
+	: cellSize(MinCellSize), inverseCellSize(1.0f / MinCellSize), queryStamp(0), rankCount(0)
+{
+
+}
+
+void LightGrid::Build(const std::vector<Ref<SceneLight>>& lights)
+{
+	this->gridLights.clear();
+	this->largeLights.clear();
+	this->cellEntries.clear();
+
+	float diameterSum = 0.0f;
+	for (const Ref<SceneLight>& sceneLight : lights)
+	{
+		const Light& light = *sceneLight->light;
+		if (!light.state || light.lightType == Light::DIRECTIONAL)
+		{
+			continue;
+		}
+
+		float radius = light.GetInfluenceRadius();
+		if (radius <= 0.0f)
+		{
+			continue;
+		}
+
+		GridLight gridLight;
+		gridLight.center = glm::vec3(light.position);
+		gridLight.radius = radius;
+		gridLight.attenuation = glm::vec3(light.attenuation);
+		gridLight.brightness = std::max(light.diffuse.x, std::max(light.diffuse.y, light.diffuse.z));
+		gridLight.index = light.index;
+		this->gridLights.push_back(gridLight);
+		diameterSum += radius * 2.0f;
+	}
+
+	this->cellSize = this->gridLights.empty() ? MinCellSize : std::max(diameterSum / this->gridLights.size(), MinCellSize);
+	this->inverseCellSize = 1.0f / this->cellSize;
+
+	for (uint32_t i = 0; i < this->gridLights.size(); i++)
+	{
+		const GridLight& light = this->gridLights[i];
+		int32_t minX = GetCell(light.center.x - light.radius), maxX = GetCell(light.center.x + light.radius);
+		int32_t minY = GetCell(light.center.y - light.radius), maxY = GetCell(light.center.y + light.radius);
+		int32_t minZ = GetCell(light.center.z - light.radius), maxZ = GetCell(light.center.z + light.radius);
+
+		uint64_t cellCount = (uint64_t)(maxX - minX + 1) * (uint64_t)(maxY - minY + 1) * (uint64_t)(maxZ - minZ + 1);
+		if (cellCount > MaxCellsPerLight)
+		{
+			this->largeLights.push_back(i);
+			continue;
+		}
+
+		for (int32_t z = minZ; z <= maxZ; z++)
+		{
+			for (int32_t y = minY; y <= maxY; y++)
+			{
+				for (int32_t x = minX; x <= maxX; x++)
+				{
+					this->cellEntries.push_back({ GetCellKey(x, y, z), i });
+				}
+			}
+		}
+	}
+
+	RenderQueue::RadixSort(this->cellEntries, this->sortScratch);
+
+	this->stamps.assign(this->gridLights.size(), 0);
+	this->queryStamp = 0;
+}
+
+ObjectLights LightGrid::Query(const AABB& box)
+{
+	ObjectLights result;
+	if (this->gridLights.empty())
+	{
+		return result;
+	}
+
+	this->queryStamp++;
+	this->rankCount = 0;
+
+	for (uint32_t light : this->largeLights)
+	{
+		Consider(light, box);
+	}
+
+	int32_t minX = GetCell(box.min.x), maxX = GetCell(box.max.x);
+	int32_t minY = GetCell(box.min.y), maxY = GetCell(box.max.y);
+	int32_t minZ = GetCell(box.min.z), maxZ = GetCell(box.max.z);
+	uint64_t cellCount = (uint64_t)(maxX - minX + 1) * (uint64_t)(maxY - minY + 1) * (uint64_t)(maxZ - minZ + 1);
+
+	if (cellCount > this->gridLights.size()) // A box this big is cheaper to check against every light than cell by cell
+	{
+		for (uint32_t light = 0; light < this->gridLights.size(); light++)
+		{
+			Consider(light, box);
+		}
+	}
+	else
+	{
+		for (int32_t z = minZ; z <= maxZ; z++)
+		{
+			for (int32_t y = minY; y <= maxY; y++)
+			{
+				for (int32_t x = minX; x <= maxX; x++)
+				{
+					uint64_t key = GetCellKey(x, y, z);
+					std::vector<RenderQueue::SortItem>::const_iterator it = std::lower_bound(this->cellEntries.begin(), this->cellEntries.end(), key,
+						[](const RenderQueue::SortItem& entry, uint64_t key) { return entry.key < key; });
+
+					for (; it != this->cellEntries.end() && it->key == key; it++)
+					{
+						Consider(it->index, box);
+					}
+				}
+			}
+		}
+	}
+
+	for (uint32_t rank = 0; rank < this->rankCount; rank++)
+	{
+		result.indices[rank / 4][rank % 4] = (int)this->gridLights[this->rankLights[rank]].index;
+	}
+
+	return result;
+}
+
+void LightGrid::Consider(uint32_t light, const AABB& box)
+{
+	if (this->stamps[light] == this->queryStamp) // Lights covering several of the box's cells come up once per cell
+	{
+		return;
+	}
+	this->stamps[light] = this->queryStamp;
+
+	const GridLight& gridLight = this->gridLights[light];
+	float distanceX = gridLight.center.x - std::min(std::max(gridLight.center.x, box.min.x), box.max.x);
+	float distanceY = gridLight.center.y - std::min(std::max(gridLight.center.y, box.min.y), box.max.y);
+	float distanceZ = gridLight.center.z - std::min(std::max(gridLight.center.z, box.min.z), box.max.z);
+	float distanceSquared = distanceX * distanceX + distanceY * distanceY + distanceZ * distanceZ;
+	if (distanceSquared > gridLight.radius * gridLight.radius)
+	{
+		return;
+	}
+
+	// Same falloff as the shader, at the point of the box nearest to the light
+	float distance = std::sqrt(distanceSquared);
+	float falloff = gridLight.attenuation.x + gridLight.attenuation.y * distance + gridLight.attenuation.z * distanceSquared;
+	float score = gridLight.brightness / std::max(falloff, 0.0001f);
+
+	const uint32_t maxRank = Renderer::MaxObjectLights;
+	if (this->rankCount == maxRank && score <= this->rankScores[maxRank - 1])
+	{
+		return;
+	}
+
+	// Insertion into the sorted ranking, pushing the dimmest light out if it's full
+	uint32_t rank = this->rankCount < maxRank ? this->rankCount++ : maxRank - 1;
+	while (rank > 0 && this->rankScores[rank - 1] < score)
+	{
+		this->rankScores[rank] = this->rankScores[rank - 1];
+		this->rankLights[rank] = this->rankLights[rank - 1];
+		rank--;
+	}
+
+	this->rankScores[rank] = score;
+	this->rankLights[rank] = light;
+}
+
+int32_t LightGrid::GetCell(float position) const
+{
+	float cell = std::min(std::max(std::floor(position * this->inverseCellSize), (float)-CellLimit), (float)(CellLimit - 1));
+	return (int32_t)cell;
+}
+
+uint64_t LightGrid::GetCellKey(int32_t x, int32_t y, int32_t z)
+{
+	return ((uint64_t)(x + CellLimit) << 42) | ((uint64_t)(y + CellLimit) << 21) | (uint64_t)(z + CellLimit);
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "pch.h"
+#include "SceneLight.h"
+#include "RenderQueue.h"
+#include "AABB.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Spatial index over the spheres of influence of the point and spot lights, for picking the few lights each mesh gets shaded with (see Renderer::IsPerObjectLights).
+// A hashed uniform grid rebuilt every frame: every light is listed under each cell its sphere's box covers, and the (cell, light) entries are radix sorted by cell so a cell's lights sit next to each other.
+// The cell size follows the average light size, so a typical light covers a handful of cells. Lights that would cover more than MaxCellsPerLight cells are kept aside and checked by every query.
+// Directional lights aren't in the grid, the shader still gets them from the global list at the front of the cluster lists.
+class LightGrid
+{
+public:
+	LightGrid();
+
+	// Rebuilds the grid around the point and spot lights that are on
+	void Build(const std::vector<Ref<SceneLight>>& lights);
+
+	// The up to Renderer::MaxObjectLights lights whose spheres touch the box, ranked by how bright they are at the nearest point of the box, brightest first.
+	ObjectLights Query(const AABB& box);
+
+	// Lights in the grid, and how many of those are too big for the cells
+	inline uint32_t GetLightCount() const { return (uint32_t)this->gridLights.size(); }
+	inline uint32_t GetLargeLightCount() const { return (uint32_t)this->largeLights.size(); }
+
+	static const uint32_t MaxCellsPerLight = 64;
+
+private:
+	// Spot lights are treated as the sphere around their full range
+	struct GridLight
+	{
+		glm::vec3 center;
+		float radius;
+		glm::vec3 attenuation; // Constant, linear, quadratic
+		float brightness; // Brightest channel of the diffuse color
+		uint32_t index; // Into lightArray
+	};
+
+	// Cell coordinates are clamped to 21 bits each so the three fit in one key
+	int32_t GetCell(float position) const;
+	static uint64_t GetCellKey(int32_t x, int32_t y, int32_t z);
+
+	// Adds the light to the ranking if it touches the box and beats the dimmest light ranked so far. Lights already seen by this query are skipped.
+	void Consider(uint32_t light, const AABB& box);
+
+	std::vector<GridLight> gridLights;
+	std::vector<uint32_t> largeLights; // Indices into gridLights
+	std::vector<RenderQueue::SortItem> cellEntries; // key: cell, index: into gridLights. Sorted by cell.
+	std::vector<RenderQueue::SortItem> sortScratch;
+	float cellSize;
+	float inverseCellSize;
+
+	// Query state. A light was seen by the current query if its stamp matches queryStamp, which saves clearing anything between queries.
+	std::vector<uint32_t> stamps;
+	uint32_t queryStamp;
+	float rankScores[Renderer::MaxObjectLights];
+	uint32_t rankLights[Renderer::MaxObjectLights];
+	uint32_t rankCount;
+};
\ No newline at end of file
@@ -1,10 +1,19 @@
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshManager.h"
 
+#include <assimp/Importer.hpp>
 #include <assimp/LogStream.hpp>
 #include <assimp/DefaultLogger.hpp>
 #include <assimp/postprocess.h>
 
+#include <glm/gtc/packing.hpp>
+
 #include <iostream>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
 
 static const uint32_t assimpFlags =
 aiProcess_CalcTangentSpace |        // Create binormals/tangents just in case
@@ -16,6 +25,10 @@ aiProcess_OptimizeMeshes |          // Batch draws where possible
 aiProcess_JoinIdenticalVertices |	// Join up identical vertices
 aiProcess_ValidateDataStructure;    // Validation
 
+VertexFormat Mesh::defaultVertexFormat = VertexFormat::Standard;
+uint32_t Mesh::defaultOptimizerFlags = MeshOptimizer_Default;
+std::vector<float> Mesh::defaultLODErrorTargets = { 0.005f, 0.02f, 0.06f };
+
 static glm::mat4 ConvertToGLMMat4(const aiMatrix4x4& matrix)
 {
 	glm::mat4 glmMat;
@@ -38,61 +51,175 @@ static glm::mat4 ConvertToGLMMat4(const aiMatrix4x4& matrix)
 	return glmMat;
 }
 
-static float* ConvertVerticesToArray(const std::vector<Vertex>& vertices)
+// Octahedral encoding maps a unit vector onto a square in [-1, 1]
+static glm::vec2 OctahedralEncode(const glm::vec3& vector)
 {
-	uint32_t vertexBufferSize = (uint32_t)(vertices.size() * sizeof(Vertex));
-	float* vertexBuffer = new float[vertexBufferSize];
-	uint32_t bufferIndex = 0;
-	for (int i = 0; i < vertices.size(); i++) // Convert data into contiguous float array 
+	float sum = glm::abs(vector.x) + glm::abs(vector.y) + glm::abs(vector.z);
+	if (sum == 0.0f) // Missing tangents etc.
 	{
-		const Vertex& vertex = vertices[i];
-		vertexBuffer[bufferIndex] = vertex.position.x;
-		vertexBuffer[bufferIndex + 1] = vertex.position.y;
-		vertexBuffer[bufferIndex + 2] = vertex.position.z;
-
-		vertexBuffer[bufferIndex + 3] = vertex.normal.x;
-		vertexBuffer[bufferIndex + 4] = vertex.normal.y;
-		vertexBuffer[bufferIndex + 5] = vertex.normal.z;
+		return glm::vec2(0.0f, 0.0f);
+	}
 
-		vertexBuffer[bufferIndex + 6] = vertex.textureCoord.x;
-		vertexBuffer[bufferIndex + 7] = vertex.textureCoord.y;
+	glm::vec2 encoded(vector.x / sum, vector.y / sum);
+	if (vector.z < 0.0f) // Fold the lower hemisphere over the diagonals
+	{
+		encoded = glm::vec2((1.0f - glm::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - glm::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f));
+	}
 
-		vertexBuffer[bufferIndex + 8] = vertex.binormal.x;
-		vertexBuffer[bufferIndex + 9] = vertex.binormal.y;
-		vertexBuffer[bufferIndex + 10] = vertex.binormal.z;
+	return encoded;
+}
 
-		vertexBuffer[bufferIndex + 11] = vertex.tangent.x;
-		vertexBuffer[bufferIndex + 12] = vertex.tangent.y;
-		vertexBuffer[bufferIndex + 13] = vertex.tangent.z;
-		 
-		bufferIndex += 14;
+static glm::vec3 OctahedralDecode(const glm::vec2& encoded)
+{
+	glm::vec3 vector(encoded.x, encoded.y, 1.0f - glm::abs(encoded.x) - glm::abs(encoded.y));
+	if (vector.z < 0.0f)
+	{
+		vector.x = (1.0f - glm::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f);
+		vector.y = (1.0f - glm::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f);
 	}
 
-	return vertexBuffer;
+	return glm::normalize(vector);
 }
 
-static uint32_t* ConvertIndicesToArray(const std::vector<Face>& faces)
+struct CompactVertex
 {
-	uint32_t indexBufferSize = (uint32_t)(faces.size() * sizeof(Face));
-	uint32_t* indexBuffer = new uint32_t[indexBufferSize];
-	uint32_t bufferIndex = 0;
-	for (int i = 0; i < faces.size(); i++) // Convert data into contiguous int array 
+	float position[3];
+	int16_t normal[2];
+	uint16_t textureCoord[2];
+	int8_t tangent[4];
+};
+
+struct QuantizedCompactVertex
+{
+	uint16_t position[4];
+	int16_t normal[2];
+	uint16_t textureCoord[2];
+	int8_t tangent[4];
+};
+
+template<typename T>
+static void PackCompactAttributes(const Vertex& vertex, T& packed)
+{
+	glm::vec2 normal = OctahedralEncode(vertex.normal);
+	packed.normal[0] = (int16_t)glm::packSnorm1x16(normal.x);
+	packed.normal[1] = (int16_t)glm::packSnorm1x16(normal.y);
+
+	packed.textureCoord[0] = glm::packHalf1x16(vertex.textureCoord.x);
+	packed.textureCoord[1] = glm::packHalf1x16(vertex.textureCoord.y);
+
+	// The binormal isn't stored, only which way it points relative to cross(normal, tangent)
+	glm::vec2 tangent = OctahedralEncode(vertex.tangent);
+	float binormalSign = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.binormal) < 0.0f ? -1.0f : 1.0f;
+	packed.tangent[0] = (int8_t)glm::packSnorm1x8(tangent.x);
+	packed.tangent[1] = (int8_t)glm::packSnorm1x8(tangent.y);
+	packed.tangent[2] = (int8_t)glm::packSnorm1x8(binormalSign);
+	packed.tangent[3] = 0;
+}
+
+template<typename T>
+static void UnpackCompactAttributes(const T& packed, Vertex& vertex)
+{
+	vertex.normal = OctahedralDecode(glm::vec2(glm::unpackSnorm1x16((uint16_t)packed.normal[0]), glm::unpackSnorm1x16((uint16_t)packed.normal[1])));
+	vertex.textureCoord = glm::vec2(glm::unpackHalf1x16(packed.textureCoord[0]), glm::unpackHalf1x16(packed.textureCoord[1]));
+	vertex.tangent = OctahedralDecode(glm::vec2(glm::unpackSnorm1x8((uint8_t)packed.tangent[0]), glm::unpackSnorm1x8((uint8_t)packed.tangent[1])));
+	vertex.binormal = glm::cross(vertex.normal, vertex.tangent) * (packed.tangent[2] < 0 ? -1.0f : 1.0f);
+}
+
+// Writes a single vertex in the layout it will have on the GPU
+static void PackVertex(const Vertex& vertex, VertexFormat format, const AABB& quantizationBounds, uint8_t* destination)
+{
+	if (format == VertexFormat::Compact)
 	{
-		const Face& face = faces[i];
-		indexBuffer[bufferIndex] = face.v1;
-		indexBuffer[bufferIndex + 1] = face.v2;
-		indexBuffer[bufferIndex + 2] = face.v3;
+		CompactVertex& packed = *(CompactVertex*)destination;
+		packed.position[0] = vertex.position.x;
+		packed.position[1] = vertex.position.y;
+		packed.position[2] = vertex.position.z;
+		PackCompactAttributes(vertex, packed);
+		return;
+	}
+	else if (format == VertexFormat::CompactQuantized)
+	{
+		QuantizedCompactVertex& packed = *(QuantizedCompactVertex*)destination;
+		glm::vec3 relative = (vertex.position - quantizationBounds.min) / (quantizationBounds.max - quantizationBounds.min);
+		packed.position[0] = glm::packUnorm1x16(relative.x);
+		packed.position[1] = glm::packUnorm1x16(relative.y);
+		packed.position[2] = glm::packUnorm1x16(relative.z);
+		packed.position[3] = 0xFFFF; // Normalizes to w = 1, so the attribute still works as a vec4 position
+		PackCompactAttributes(vertex, packed);
+		return;
+	}
+
+	float* floatBuffer = (float*)destination;
+	floatBuffer[0] = vertex.position.x;
+	floatBuffer[1] = vertex.position.y;
+	floatBuffer[2] = vertex.position.z;
+
+	floatBuffer[3] = vertex.normal.x;
+	floatBuffer[4] = vertex.normal.y;
+	floatBuffer[5] = vertex.normal.z;
+
+	floatBuffer[6] = vertex.textureCoord.x;
+	floatBuffer[7] = vertex.textureCoord.y;
+
+	floatBuffer[8] = vertex.binormal.x;
+	floatBuffer[9] = vertex.binormal.y;
+	floatBuffer[10] = vertex.binormal.z;
+
+	floatBuffer[11] = vertex.tangent.x;
+	floatBuffer[12] = vertex.tangent.y;
+	floatBuffer[13] = vertex.tangent.z;
+}
+
+// Converts vertices in their GPU layout back into our vertices
+static void ConvertArrayToVertices(const void* vertexBuffer, uint32_t vertexCount, VertexFormat format, const AABB& quantizationBounds, std::vector<Vertex>& vertices)
+{
+	vertices.resize(vertexCount);
 
-		bufferIndex += 3;
+	if (format == VertexFormat::Compact)
+	{
+		const CompactVertex* packedVertices = (const CompactVertex*)vertexBuffer;
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			const CompactVertex& packed = packedVertices[i];
+			vertices[i].position = glm::vec3(packed.position[0], packed.position[1], packed.position[2]);
+			UnpackCompactAttributes(packed, vertices[i]);
+		}
+		return;
+	}
+	else if (format == VertexFormat::CompactQuantized)
+	{
+		glm::vec3 extent = quantizationBounds.max - quantizationBounds.min;
+		const QuantizedCompactVertex* packedVertices = (const QuantizedCompactVertex*)vertexBuffer;
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			const QuantizedCompactVertex& packed = packedVertices[i];
+			glm::vec3 relative(glm::unpackUnorm1x16(packed.position[0]), glm::unpackUnorm1x16(packed.position[1]), glm::unpackUnorm1x16(packed.position[2]));
+			vertices[i].position = quantizationBounds.min + relative * extent;
+			UnpackCompactAttributes(packed, vertices[i]);
+		}
+		return;
 	}
 
-	return indexBuffer;
+	const float* floatBuffer = (const float*)vertexBuffer;
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const float* data = floatBuffer + (i * 14);
+		Vertex& vertex = vertices[i];
+		vertex.position = glm::vec3(data[0], data[1], data[2]);
+		vertex.normal = glm::vec3(data[3], data[4], data[5]);
+		vertex.textureCoord = glm::vec2(data[6], data[7]);
+		vertex.binormal = glm::vec3(data[8], data[9], data[10]);
+		vertex.tangent = glm::vec3(data[11], data[12], data[13]);
+	}
 }
 
 struct AssimpLogger : public Assimp::LogStream
 {
 	static void Initialize()
 	{
+		static std::mutex initializeMutex; // Meshes can be imported from several worker threads at once
+		std::lock_guard<std::mutex> lock(initializeMutex);
 		if (Assimp::DefaultLogger::isNullLogger())
 		{
 			Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
@@ -106,168 +233,548 @@ struct AssimpLogger : public Assimp::LogStream
 	}
 };
 
-Mesh::Mesh(const std::string& filePath)
-	: filePath(filePath), boundingBox(glm::vec3(0.0f), glm::vec3(0.0f))
+Mesh::Mesh(const std::string& filePath, bool uploadToGPU)
+	: inverseTransform(1.0f), 
+	vertexCount(0), 
+	indexCount(0), 
+	indexSize(sizeof(uint32_t)), 
+	boundingBox(glm::vec3(0.0f), glm::vec3(0.0f)), 
+	optimizerFlags(defaultOptimizerFlags), 
+	lodErrorTargets(defaultLODErrorTargets), 
+	lodErrors(1, 0.0f), 
+	vertexFormat(defaultVertexFormat), 
+	quantizationBounds(glm::vec3(0.0f), glm::vec3(1.0f)), 
+	dequantizeTransform(1.0f), 
+	filePath(filePath)
 {
-	AssimpLogger::Initialize();
+	std::cout << "Loading mesh " << filePath << "..." << std::endl;
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
 
-	std::cout << "Loading mesh " << filePath << "..." << std::endl;;
-	this->importer = CreateScope<Assimp::Importer>();
+	if (this->lodErrorTargets.size() > MaxLODs - 1)
+	{
+		this->lodErrorTargets.resize(MaxLODs - 1);
+	}
 
-	const aiScene* scene = this->importer->ReadFile(filePath, assimpFlags);
+	Scope<MeshCacheFile> cacheFile = MeshCache::Open(filePath, GetCacheKey());
+	bool cacheHit = cacheFile != nullptr;
+	if (cacheHit)
+	{
+		LoadFromCache(std::move(cacheFile));
+	}
+	else if (!LoadFromAssimp())
+	{
+		return;
+	}
+
+	if (uploadToGPU)
+	{
+		UploadToGPU();
+	}
+
+	std::chrono::duration<float, std::milli> loadTime = std::chrono::high_resolution_clock::now() - startTime;
+	std::cout << "Loaded mesh " << filePath << " in " << loadTime.count() << "ms (" << (cacheHit ? "warm" : "cold") << ", " << GetVertexBufferSize() / 1024 << "KB of vertices, " << this->indexSize * 8 << "-bit indices)" << std::endl;
+}
+
+void Mesh::UploadToGPU()
+{
+	if (IsUploaded())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->cpuGeometryMutex); // GetVertices() may be reading the pending geometry on another thread
+
+	if (this->pendingCacheFile)
+	{
+		CreateBuffers(this->pendingCacheFile->GetVertexData(), this->pendingCacheFile->GetIndexData());
+		this->pendingCacheFile.reset(); // Unmaps the file
+	}
+	else if (!this->pendingVertexData.empty())
+	{
+		CreateBuffers(this->pendingVertexData.data(), this->pendingIndexData.data());
+		std::vector<uint8_t>().swap(this->pendingVertexData);
+		std::vector<uint8_t>().swap(this->pendingIndexData);
+	}
+}
+
+const std::vector<Vertex>& Mesh::GetVertices() const
+{
+	static const std::vector<Vertex> noVertices;
+	LoadCPUGeometry();
+	return this->cpuGeometry ? this->cpuGeometry->vertices : noVertices;
+}
+
+const std::vector<Face>& Mesh::GetFaces() const
+{
+	static const std::vector<Face> noFaces;
+	LoadCPUGeometry();
+	return this->cpuGeometry ? this->cpuGeometry->faces : noFaces;
+}
+
+void Mesh::SetKeepCPUGeometry(bool keep)
+{
+	if (keep)
+	{
+		LoadCPUGeometry();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->cpuGeometryMutex);
+	this->cpuGeometry.reset();
+}
+
+bool Mesh::IsKeepingCPUGeometry() const
+{
+	std::lock_guard<std::mutex> lock(this->cpuGeometryMutex);
+	return this->cpuGeometry != nullptr;
+}
+
+size_t Mesh::GetResidentCPUBytes() const
+{
+	std::lock_guard<std::mutex> lock(this->cpuGeometryMutex);
+
+	size_t bytes = sizeof(Mesh) + this->filePath.capacity();
+	bytes += this->submeshes.capacity() * sizeof(Submesh);
+	for (const Submesh& submesh : this->submeshes)
+	{
+		bytes += submesh.lods.capacity() * sizeof(SubmeshLOD) + submesh.nodeName.capacity() + submesh.meshName.capacity();
+	}
+
+	bytes += (this->lodErrorTargets.capacity() + this->lodErrors.capacity()) * sizeof(float);
+	bytes += this->textures.capacity() * sizeof(Ref<Texture>);
+
+	// Only there until UploadToGPU()
+	bytes += this->pendingVertexData.capacity() + this->pendingIndexData.capacity();
+
+	if (this->cpuGeometry) // Counted in full by every copy sharing it
+	{
+		bytes += sizeof(MeshCPUGeometry);
+		bytes += this->cpuGeometry->vertices.capacity() * sizeof(Vertex);
+		bytes += this->cpuGeometry->faces.capacity() * sizeof(Face);
+	}
+
+	return bytes;
+}
+
+bool Mesh::LoadFromAssimp()
+{
+	AssimpLogger::Initialize();
+
+	// The importer owns the aiScene, both go away as soon as we've pulled what we need out of them
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(filePath, assimpFlags);
 	if (!scene || !scene->HasMeshes())
 	{
 		std::cout << "Failed to load mesh file: " << filePath << std::endl;
-		return;
+		return false;
 	}
 
-	this->assimpScene = scene;
 	this->inverseTransform = glm::inverse(ConvertToGLMMat4(scene->mRootNode->mTransformation));
 	this->submeshes.reserve(scene->mNumMeshes);
 
-	uint32_t vertexCount = 0;
-	uint32_t indexCount = 0;
-
+	// First pass only gathers sizes and bounds so the GPU blobs can be allocated at exactly the right size
 	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
 	{
 		aiMesh* assimpMesh = scene->mMeshes[i];
 
-		Submesh submesh;
-		submesh.baseVertex = vertexCount;
-		submesh.baseIndex = indexCount;
+		this->submeshes.push_back(Submesh());
+		Submesh& submesh = this->submeshes.back();
+		submesh.baseVertex = this->vertexCount;
+		submesh.baseIndex = this->indexCount;
 		submesh.materialIndex = assimpMesh->mMaterialIndex;
 		submesh.vertexCount = assimpMesh->mNumVertices;
 		submesh.indexCount = assimpMesh->mNumFaces * 3;
 		submesh.meshName = assimpMesh->mName.C_Str();
-		this->submeshes.push_back(submesh);
 
-		vertexCount += assimpMesh->mNumVertices;
-		indexCount += submesh.indexCount;
+		this->vertexCount += assimpMesh->mNumVertices;
+		this->indexCount += submesh.indexCount;
 
 		if (!assimpMesh->HasPositions())
 		{
 			std::cout << "Mesh does not have position!" << std::endl;
-			return;
+			return false;
 		}
 
 		if (!assimpMesh->HasNormals())
 		{
 			std::cout << "Mesh does not have normals!" << std::endl;
-			return;
+			return false;
 		}
 
 		AABB& aabb = submesh.boundingBox;
 		aabb.min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
 		aabb.max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (unsigned int j = 0; j < assimpMesh->mNumVertices; j++)
+		{
+			glm::vec3 position(assimpMesh->mVertices[j].x, assimpMesh->mVertices[j].y, assimpMesh->mVertices[j].z);
+			aabb.min = glm::min(position, aabb.min);
+			aabb.max = glm::max(position, aabb.max);
+		}
+
+		for (unsigned int j = 0; j < assimpMesh->mNumFaces; j++)
+		{
+			if (assimpMesh->mFaces[j].mNumIndices != 3)
+			{
+				std::cout << "Face must be a triangle!" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	LoadNodes(scene->mRootNode); // Load all the submeshes
+
+	// Configure parent's bounding box based off of the submeshes we just added
+	this->boundingBox.min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	this->boundingBox.max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (Submesh& submesh : this->submeshes)
+	{
+		AABB submeshAABB = submesh.boundingBox.Transform(submesh.transform);
+
+		this->boundingBox.min.x = glm::min(this->boundingBox.min.x, submeshAABB.min.x);
+		this->boundingBox.min.y = glm::min(this->boundingBox.min.y, submeshAABB.min.y);
+		this->boundingBox.min.z = glm::min(this->boundingBox.min.z, submeshAABB.min.z);
+		this->boundingBox.max.x = glm::max(this->boundingBox.max.x, submeshAABB.max.x);
+		this->boundingBox.max.y = glm::max(this->boundingBox.max.y, submeshAABB.max.y);
+		this->boundingBox.max.z = glm::max(this->boundingBox.max.z, submeshAABB.max.z);
+	}
+
+	if (scene->HasMaterials())
+	{
+		SetupMaterials();
+	}
+
+	SetupQuantization();
+
+	// Face indices are relative to their submesh, so the index size only depends on the biggest submesh
+	uint32_t largestSubmesh = 0;
+	for (const Submesh& submesh : this->submeshes)
+	{
+		largestSubmesh = std::max(largestSubmesh, submesh.vertexCount);
+	}
+	this->indexSize = largestSubmesh <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	// Second pass optimizes each submesh's triangle order and writes every vertex and index straight into its final GPU layout, without building an intermediate array of Vertex
+	uint32_t vertexStride = GetVertexStride(this->vertexFormat);
+	this->pendingVertexData.resize((size_t)this->vertexCount * vertexStride);
+	this->pendingIndexData.resize((size_t)this->indexCount * this->indexSize);
+
+	VertexCacheStatistics statisticsBefore;
+	VertexCacheStatistics statisticsAfter;
+	std::vector<uint32_t> submeshIndices;
+	std::vector<glm::vec3> submeshPositions;
+	std::vector<uint32_t> remap;
+
+	uint32_t lodTargetCount = (uint32_t)this->lodErrorTargets.size();
+	float meshDiagonal = glm::length(this->boundingBox.max - this->boundingBox.min);
+	std::vector<std::vector<uint32_t>> lodIndices((size_t)scene->mNumMeshes * lodTargetCount); // [submesh * lodTargetCount + target]
+	std::vector<float> lodMeasuredErrors((size_t)scene->mNumMeshes * lodTargetCount, 0.0f); // What Simplify() actually got to for each of those, in model units
+
+	uint8_t* vertexDestination = this->pendingVertexData.data();
+	uint16_t* shortIndexDestination = (uint16_t*)this->pendingIndexData.data();
+	uint32_t* indexDestination = (uint32_t*)this->pendingIndexData.data();
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+	{
+		aiMesh* assimpMesh = scene->mMeshes[i];
+
+		submeshIndices.resize(assimpMesh->mNumFaces * 3);
+		for (unsigned int j = 0; j < assimpMesh->mNumFaces; j++)
+		{
+			submeshIndices[j * 3] = assimpMesh->mFaces[j].mIndices[0];
+			submeshIndices[j * 3 + 1] = assimpMesh->mFaces[j].mIndices[1];
+			submeshIndices[j * 3 + 2] = assimpMesh->mFaces[j].mIndices[2];
+		}
+
+		statisticsBefore.Add(MeshOptimizer::AnalyzeVertexCache(submeshIndices, assimpMesh->mNumVertices));
+
+		if (this->optimizerFlags & MeshOptimizer_VertexCache)
+		{
+			MeshOptimizer::OptimizeVertexCache(submeshIndices, assimpMesh->mNumVertices);
+		}
+
+		if (this->optimizerFlags & MeshOptimizer_Overdraw)
+		{
+			submeshPositions.resize(assimpMesh->mNumVertices);
+			for (unsigned int j = 0; j < assimpMesh->mNumVertices; j++)
+			{
+				submeshPositions[j] = glm::vec3(assimpMesh->mVertices[j].x, assimpMesh->mVertices[j].y, assimpMesh->mVertices[j].z);
+			}
+
+			MeshOptimizer::OptimizeOverdraw(submeshIndices, submeshPositions);
+		}
+
+		remap.clear();
+		if (this->optimizerFlags & MeshOptimizer_VertexFetch)
+		{
+			MeshOptimizer::OptimizeVertexFetch(submeshIndices, assimpMesh->mNumVertices, remap);
+		}
+
+		statisticsAfter.Add(MeshOptimizer::AnalyzeVertexCache(submeshIndices, assimpMesh->mNumVertices));
+
+		// Simplify the optimized triangles into the LOD chain, all levels share the submesh's vertices
+		if (lodTargetCount > 0)
+		{
+			submeshPositions.resize(assimpMesh->mNumVertices);
+			for (unsigned int j = 0; j < assimpMesh->mNumVertices; j++)
+			{
+				submeshPositions[remap.empty() ? j : remap[j]] = glm::vec3(assimpMesh->mVertices[j].x, assimpMesh->mVertices[j].y, assimpMesh->mVertices[j].z);
+			}
+
+			for (uint32_t j = 0; j < lodTargetCount; j++)
+			{
+				std::vector<uint32_t>& simplified = lodIndices[(size_t)i * lodTargetCount + j];
+				lodMeasuredErrors[(size_t)i * lodTargetCount + j] = MeshOptimizer::Simplify(submeshIndices, submeshPositions, this->lodErrorTargets[j] * meshDiagonal, simplified);
+				if (this->optimizerFlags & MeshOptimizer_VertexCache)
+				{
+					MeshOptimizer::OptimizeVertexCache(simplified, assimpMesh->mNumVertices);
+				}
+			}
+		}
+
 		for (unsigned int j = 0; j < assimpMesh->mNumVertices; j++)
 		{
 			Vertex vertex;
 			vertex.position = glm::vec3(assimpMesh->mVertices[j].x, assimpMesh->mVertices[j].y, assimpMesh->mVertices[j].z);
 			vertex.normal = glm::vec3(assimpMesh->mNormals[j].x, assimpMesh->mNormals[j].y, assimpMesh->mNormals[j].z);
-			aabb.min.x = glm::min(vertex.position.x, aabb.min.x);
-			aabb.min.y = glm::min(vertex.position.y, aabb.min.y);
-			aabb.min.z = glm::min(vertex.position.z, aabb.min.z);
-			aabb.max.x = glm::max(vertex.position.x, aabb.max.x);
-			aabb.max.y = glm::max(vertex.position.y, aabb.max.y);
-			aabb.max.z = glm::max(vertex.position.z, aabb.max.z);
+			vertex.textureCoord = glm::vec2(0.0f);
+			vertex.tangent = glm::vec3(0.0f);
+			vertex.binormal = glm::vec3(0.0f);
 
 			if (assimpMesh->HasTextureCoords(0))
 			{
 				vertex.textureCoord = glm::vec2(assimpMesh->mTextureCoords[0][j].x, assimpMesh->mTextureCoords[0][j].y);
 			}
 
-
 			if (assimpMesh->HasTangentsAndBitangents())
 			{
 				vertex.tangent = glm::vec3(assimpMesh->mTangents[j].x, assimpMesh->mTangents[j].y, assimpMesh->mTangents[j].z);
 				vertex.binormal = glm::vec3(assimpMesh->mBitangents[j].x, assimpMesh->mBitangents[j].y, assimpMesh->mBitangents[j].z);
 			}
 
-			this->vertices.push_back(vertex);
+			uint32_t vertexIndex = remap.empty() ? j : remap[j];
+			PackVertex(vertex, this->vertexFormat, this->quantizationBounds, vertexDestination + (size_t)vertexIndex * vertexStride);
 		}
+		vertexDestination += (size_t)assimpMesh->mNumVertices * vertexStride;
 
-		for (unsigned int j = 0; j < assimpMesh->mNumFaces; j++)
+		for (uint32_t index : submeshIndices)
 		{
-			if (assimpMesh->mFaces[j].mNumIndices != 3)
+			if (this->indexSize == sizeof(uint16_t))
 			{
-				std::cout << "Face must be a triangle!" << std::endl;
-				return;
+				*shortIndexDestination++ = (uint16_t)index;
+			}
+			else
+			{
+				*indexDestination++ = index;
 			}
+		}
+	}
+
+	for (Submesh& submesh : this->submeshes)
+	{
+		submesh.lods.assign(1, { submesh.baseIndex, submesh.indexCount });
+	}
+
+	// Only keep the levels that actually save a meaningful amount of triangles over the previous one, the rest just point back at the previous level
+	std::vector<uint32_t> keptTargets;
+	uint32_t previousTriangles = this->indexCount / 3;
+	uint32_t lodIndexCount = 0;
+	for (uint32_t j = 0; j < lodTargetCount; j++)
+	{
+		uint32_t triangles = 0;
+		for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+		{
+			triangles += (uint32_t)lodIndices[(size_t)i * lodTargetCount + j].size() / 3;
+		}
+
+		if (triangles == 0 || triangles > previousTriangles * 0.85f)
+		{
+			continue;
+		}
+
+		keptTargets.push_back(j);
+		previousTriangles = triangles;
 
-			Face face;
-			face.v1 = assimpMesh->mFaces[j].mIndices[0];
-			face.v2 = assimpMesh->mFaces[j].mIndices[1];
-			face.v3 = assimpMesh->mFaces[j].mIndices[2];
-			this->faces.push_back(face);
+		for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+		{
+			Submesh& submesh = this->submeshes[i];
+			const std::vector<uint32_t>& simplified = lodIndices[(size_t)i * lodTargetCount + j];
+			if (simplified.empty() || simplified.size() >= submesh.lods.back().indexCount) // This submesh didn't get any simpler
+			{
+				submesh.lods.push_back(submesh.lods.back());
+			}
+			else
+			{
+				submesh.lods.push_back({ this->indexCount + lodIndexCount, (uint32_t)simplified.size() });
+				lodIndexCount += (uint32_t)simplified.size();
+			}
 		}
 	}
 
-	LoadNodes(scene->mRootNode); // Load all the submeshes
+	// Append the LOD indices after the full detail ones
+	this->pendingIndexData.resize(((size_t)this->indexCount + lodIndexCount) * this->indexSize);
+	for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+	{
+		const Submesh& submesh = this->submeshes[i];
+		for (uint32_t j = 1; j < submesh.lods.size(); j++)
+		{
+			if (submesh.lods[j].baseIndex == submesh.lods[j - 1].baseIndex) // Shared with the previous level
+			{
+				continue;
+			}
 
-	// Configure parent's bounding box based off of the submeshes we just added
-	for (Submesh& submesh : this->submeshes)
+			const std::vector<uint32_t>& simplified = lodIndices[(size_t)i * lodTargetCount + keptTargets[j - 1]];
+			uint8_t* destination = this->pendingIndexData.data() + (size_t)submesh.lods[j].baseIndex * this->indexSize;
+			for (size_t k = 0; k < simplified.size(); k++)
+			{
+				if (this->indexSize == sizeof(uint16_t))
+				{
+					((uint16_t*)destination)[k] = (uint16_t)simplified[k];
+				}
+				else
+				{
+					((uint32_t*)destination)[k] = simplified[k];
+				}
+			}
+		}
+	}
+	this->indexCount += lodIndexCount;
+
+	// Each level's error is the worst any of its submeshes measured, relative to the diagonal like the targets. Kept from shrinking between levels so LOD selection can walk the chain in order.
+	this->lodErrors.assign(1, 0.0f);
+	for (uint32_t target : keptTargets)
 	{
-		AABB submeshAABB = submesh.boundingBox;
-		glm::vec3 min = glm::vec3(submesh.transform * glm::vec4(submeshAABB.min, 1.0f));
-		glm::vec3 max = glm::vec3(submesh.transform * glm::vec4(submeshAABB.max, 1.0f));
+		float error = this->lodErrors.back();
+		for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+		{
+			error = std::max(error, meshDiagonal > 0.0f ? lodMeasuredErrors[(size_t)i * lodTargetCount + target] / meshDiagonal : 0.0f);
+		}
+		this->lodErrors.push_back(error);
+	}
 
-		this->boundingBox.min.x = glm::min(this->boundingBox.min.x, min.x);
-		this->boundingBox.min.y = glm::min(this->boundingBox.min.y, min.y);
-		this->boundingBox.min.z = glm::min(this->boundingBox.min.z, min.z);
-		this->boundingBox.max.x = glm::max(this->boundingBox.max.x, max.x);
-		this->boundingBox.max.y = glm::max(this->boundingBox.max.y, max.y);
-		this->boundingBox.max.z = glm::max(this->boundingBox.max.z, max.z);
+	if (GetLODCount() > 1)
+	{
+		std::cout << "Generated " << GetLODCount() - 1 << " LODs for mesh " << this->filePath << ", triangles:";
+		for (uint32_t i = 0; i < GetLODCount(); i++)
+		{
+			std::cout << " " << GetTriangleCount(i);
+		}
+		std::cout << std::endl;
 	}
 
-	if (scene->HasMaterials())
+	if (this->optimizerFlags != MeshOptimizer_None)
 	{
-		SetupMaterials();
+		std::cout << "Optimized mesh " << this->filePath << ": ACMR " << statisticsBefore.GetACMR() << " -> " << statisticsAfter.GetACMR() 
+			<< ", ATVR " << statisticsBefore.GetATVR() << " -> " << statisticsAfter.GetATVR() << std::endl;
 	}
 
-	BufferLayout bufferLayout = {
-		{ ShaderDataType::Float3, "vPosition" },
-		{ ShaderDataType::Float3, "vNormal" },
-		{ ShaderDataType::Float2, "vTextureCoordinates" },
-		{ ShaderDataType::Float3, "vBiNormal" },
-		{ ShaderDataType::Float3, "vTangent" }
-	};
+	// Bake the final geometry so the next load doesn't have to go through Assimp
+	MeshCache::Write(this->filePath, GetCacheKey(), this->pendingVertexData.data(), vertexStride, this->vertexCount, this->pendingIndexData.data(), this->indexSize, this->indexCount, this->submeshes, this->lodErrors, this->boundingBox, this->inverseTransform);
+	return true;
+}
 
-	this->vertexArray = CreateRef<VertexArrayObject>();
+void Mesh::LoadFromCache(Scope<MeshCacheFile> cacheFile)
+{
+	this->submeshes = cacheFile->GetSubmeshes();
+	this->boundingBox = cacheFile->GetBoundingBox();
+	this->inverseTransform = cacheFile->GetInverseTransform();
+	this->vertexCount = cacheFile->GetVertexCount();
+	this->indexCount = cacheFile->GetIndexCount();
+	this->indexSize = cacheFile->GetIndexSize();
+	this->lodErrors = cacheFile->GetLODErrors();
+
+	SetupQuantization();
+
+	// The cached blobs are already in their final GPU layout, they get uploaded straight out of the mapped file
+	this->pendingCacheFile = std::move(cacheFile);
+}
 
-	uint32_t vertexBufferSize = (uint32_t)(this->vertices.size() * sizeof(Vertex));
-	float* vertexBuffer = ConvertVerticesToArray(this->vertices);
+void Mesh::LoadCPUGeometry() const
+{
+	std::lock_guard<std::mutex> lock(this->cpuGeometryMutex);
+	if (this->cpuGeometry)
+	{
+		return;
+	}
 
-	this->vertexBuffer = CreateRef<VertexBuffer>(vertexBuffer, vertexBufferSize);
-	this->vertexBuffer->SetLayout(bufferLayout);
+	// Decode from wherever the GPU layout still lives: the pending upload, the mesh cache on disk or, as a last resort, the GPU buffers themselves
+	Scope<MeshCacheFile> cacheFile;
+	std::vector<uint8_t> readbackVertices;
+	std::vector<uint8_t> readbackIndices;
+	const void* vertexData = nullptr;
+	const void* indexData = nullptr;
+	if (this->pendingCacheFile)
+	{
+		vertexData = this->pendingCacheFile->GetVertexData();
+		indexData = this->pendingCacheFile->GetIndexData();
+	}
+	else if (!this->pendingVertexData.empty())
+	{
+		vertexData = this->pendingVertexData.data();
+		indexData = this->pendingIndexData.data();
+	}
+	else if ((cacheFile = MeshCache::Open(this->filePath, GetCacheKey())) != nullptr 
+		&& cacheFile->GetVertexCount() == this->vertexCount && cacheFile->GetIndexCount() == this->indexCount && cacheFile->GetIndexSize() == this->indexSize)
+	{
+		vertexData = cacheFile->GetVertexData();
+		indexData = cacheFile->GetIndexData();
+	}
+	else if (this->geometry) // Only valid on the GL thread
+	{
+		GeometryArena* arena = this->geometry->GetArena();
+		readbackVertices.resize(GetVertexBufferSize());
+		arena->GetVertexData(readbackVertices.data(), this->vertexCount, this->geometry->GetBaseVertex());
+		readbackIndices.resize((size_t)this->indexCount * this->indexSize);
+		arena->GetIndexData(readbackIndices.data(), this->indexCount, this->geometry->GetFirstIndex());
+		vertexData = readbackVertices.data();
+		indexData = readbackIndices.data();
+	}
+	else
+	{
+		std::cout << "No geometry to build CPU copy of mesh " << this->filePath << " from!" << std::endl;
+		return;
+	}
 
-	uint32_t indexBufferSize = (uint32_t)(this->faces.size() * sizeof(Face));
-	uint32_t* indexBuffer = ConvertIndicesToArray(this->faces);
+	Ref<MeshCPUGeometry> decoded = CreateRef<MeshCPUGeometry>();
+	ConvertArrayToVertices(vertexData, this->vertexCount, this->vertexFormat, this->quantizationBounds, decoded->vertices);
 
-	this->vertexArray->Bind();
-	this->indexBuffer = CreateRef<IndexBuffer>(indexBuffer, indexBufferSize);
+	// Widen the full detail indices and make them relative to the whole mesh
+	decoded->faces.resize(GetTriangleCount(0));
+	uint32_t* faceIndices = (uint32_t*)decoded->faces.data();
+	for (const Submesh& submesh : this->submeshes)
+	{
+		for (uint32_t i = submesh.baseIndex; i < submesh.baseIndex + submesh.indexCount; i++)
+		{
+			uint32_t index = this->indexSize == sizeof(uint16_t) ? ((const uint16_t*)indexData)[i] : ((const uint32_t*)indexData)[i];
+			faceIndices[i] = index + submesh.baseVertex;
+		}
+	}
 
-	this->vertexArray->AddVertexBuffer(this->vertexBuffer);
-	this->vertexArray->SetIndexBuffer(this->indexBuffer);
+	this->cpuGeometry = decoded;
+}
 
-	delete[] vertexBuffer;
-	delete[] indexBuffer;
+void Mesh::CreateBuffers(const void* vertexData, const void* indexData)
+{
+	this->geometry = MeshManager::AllocateGeometry(this->vertexFormat, this->indexSize, vertexData, this->vertexCount, indexData, this->indexCount);
 }
 
 Mesh::Mesh(const Ref<Mesh> mesh)
 	: submeshes(mesh->submeshes),
 	inverseTransform(mesh->inverseTransform),
-	vertexArray(mesh->vertexArray),
-	vertexBuffer(mesh->vertexBuffer),
-	indexBuffer(mesh->indexBuffer),
-	vertices(mesh->vertices),
-	faces(mesh->faces),
-	nodeMap(mesh->nodeMap),
-	assimpScene(mesh->assimpScene),
+	geometry(mesh->geometry),
+	vertexCount(mesh->vertexCount),
+	indexCount(mesh->indexCount),
+	indexSize(mesh->indexSize),
 	textures(mesh->textures),
 	boundingBox(mesh->boundingBox),
+	optimizerFlags(mesh->optimizerFlags),
+	lodErrorTargets(mesh->lodErrorTargets),
+	lodErrors(mesh->lodErrors),
+	vertexFormat(mesh->vertexFormat),
+	quantizationBounds(mesh->quantizationBounds),
+	dequantizeTransform(mesh->dequantizeTransform),
 	filePath(mesh->filePath)
 {
-
+	std::lock_guard<std::mutex> lock(mesh->cpuGeometryMutex);
+	this->cpuGeometry = mesh->cpuGeometry; // Copies opt in along with the mesh they came from
 }
 
 Mesh::~Mesh()
@@ -275,17 +782,101 @@ Mesh::~Mesh()
 
 }
 
+uint32_t Mesh::GetTriangleCount(uint32_t lod) const
+{
+	uint32_t triangles = 0;
+	for (const Submesh& submesh : this->submeshes)
+	{
+		triangles += submesh.lods[std::min(lod, (uint32_t)submesh.lods.size() - 1)].indexCount / 3;
+	}
+	return triangles;
+}
+
+MeshCacheKey Mesh::GetCacheKey() const
+{
+	MeshCacheKey key;
+	key.importerFlags = assimpFlags;
+	key.optimizerFlags = this->optimizerFlags;
+	key.vertexFormat = this->vertexFormat;
+	key.lodErrorTargets = this->lodErrorTargets;
+	return key;
+}
+
+uint32_t Mesh::GetVertexStride(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:
+		return sizeof(CompactVertex);
+	case VertexFormat::CompactQuantized:
+		return sizeof(QuantizedCompactVertex);
+	default:
+		return 14 * sizeof(float);
+	}
+}
+
+BufferLayout Mesh::GetVertexLayout(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:
+		return {
+			{ ShaderDataType::Float3, "vPosition" },
+			{ ShaderDataType::Short2Norm, "vNormal" },
+			{ ShaderDataType::Half2, "vTextureCoordinates" },
+			{ ShaderDataType::Byte4Norm, "vTangent" }
+		};
+	case VertexFormat::CompactQuantized:
+		return {
+			{ ShaderDataType::UShort4Norm, "vPosition" },
+			{ ShaderDataType::Short2Norm, "vNormal" },
+			{ ShaderDataType::Half2, "vTextureCoordinates" },
+			{ ShaderDataType::Byte4Norm, "vTangent" }
+		};
+	default:
+		return {
+			{ ShaderDataType::Float3, "vPosition" },
+			{ ShaderDataType::Float3, "vNormal" },
+			{ ShaderDataType::Float2, "vTextureCoordinates" },
+			{ ShaderDataType::Float3, "vBiNormal" },
+			{ ShaderDataType::Float3, "vTangent" }
+		};
+	}
+}
+
+void Mesh::SetupQuantization()
+{
+	if (this->vertexFormat != VertexFormat::CompactQuantized || this->submeshes.empty())
+	{
+		return;
+	}
+
+	// Quantize relative to the untransformed bounds of all our vertices
+	this->quantizationBounds = this->submeshes[0].boundingBox;
+	for (const Submesh& submesh : this->submeshes)
+	{
+		this->quantizationBounds.min = glm::min(this->quantizationBounds.min, submesh.boundingBox.min);
+		this->quantizationBounds.max = glm::max(this->quantizationBounds.max, submesh.boundingBox.max);
+	}
+
+	glm::vec3 extent = this->quantizationBounds.max - this->quantizationBounds.min;
+	extent.x = extent.x > 0.0f ? extent.x : 1.0f; // Flat meshes would otherwise divide by 0
+	extent.y = extent.y > 0.0f ? extent.y : 1.0f;
+	extent.z = extent.z > 0.0f ? extent.z : 1.0f;
+	this->quantizationBounds.max = this->quantizationBounds.min + extent;
+
+	this->dequantizeTransform = glm::translate(glm::mat4(1.0f), this->quantizationBounds.min) * glm::scale(glm::mat4(1.0f), extent);
+}
+
 void Mesh::LoadNodes(aiNode* node, const glm::mat4& parentTransform)
 {
 	glm::mat4 transform = parentTransform * ConvertToGLMMat4(node->mTransformation);
-	this->nodeMap[node].resize(node->mNumMeshes);
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		unsigned int meshIndex = node->mMeshes[i];
 		Submesh& submesh = this->submeshes[meshIndex];
 		submesh.nodeName = node->mName.C_Str();
 		submesh.transform = transform;
-		this->nodeMap[node][i] = meshIndex;
 	}
 
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
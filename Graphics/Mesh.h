@@ -5,8 +5,8 @@
 #include "Texture.h"
 #include "VertexInformation.h"
 #include "VertexArrayObject.h"
+#include "GeometryArena.h"
 
-#include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 
 #include <glm/glm.hpp>
@@ -14,6 +14,10 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
+
+class MeshCacheFile;
+struct MeshCacheKey;
 
 struct Vertex
 {
@@ -24,11 +28,37 @@ struct Vertex
 	glm::vec3 binormal;
 };
 
+// The layout a mesh's vertices are stored in on the GPU
+// Standard: 56 bytes, everything is stored as full floats
+// Compact: 24 bytes, octahedral encoded normal (snorm16) and tangent (snorm8, binormal sign in z) with half float UVs
+// CompactQuantized: 20 bytes, same as Compact but positions are stored as unorm16 relative to the mesh's vertex bounds
+// The compact formats need the vertex shader to decode the normal/tangent and rebuild the binormal (see the "vertexFormat" uniform set by the Renderer)
+enum class VertexFormat
+{
+	Standard = 0,
+	Compact = 1,
+	CompactQuantized = 2
+};
+
 struct Face
 {
 	uint32_t v1, v2, v3;
 };
 
+// A decoded copy of a mesh's full detail geometry, shared between copies of the mesh
+struct MeshCPUGeometry
+{
+	std::vector<Vertex> vertices;
+	std::vector<Face> faces;
+};
+
+// A range of the index buffer holding one level of detail of a submesh
+struct SubmeshLOD
+{
+	uint32_t baseIndex;
+	uint32_t indexCount;
+};
+
 struct Submesh
 {
 	Submesh() : boundingBox(glm::vec3(0.0f), glm::vec3(0.0f)) {}
@@ -39,6 +69,8 @@ struct Submesh
 	uint32_t indexCount;
 	uint32_t vertexCount;
 
+	std::vector<SubmeshLOD> lods; // lods[0] is the full detail range (baseIndex/indexCount). Coarser levels index the same vertices.
+
 	AABB boundingBox;
 
 	glm::mat4 transform{ 1.0f };
@@ -49,21 +81,48 @@ struct Submesh
 class Mesh
 {
 public:
-	Mesh(const std::string& filePath);
+	static const uint32_t MaxLODs = 4; // Including the full detail level
+
+	// Loads the mesh's geometry. If uploadToGPU is false the GPU buffers aren't created until UploadToGPU() is called, which lets the import run off the GL thread.
+	Mesh(const std::string& filePath, bool uploadToGPU = true);
 	Mesh(const Ref<Mesh> mesh);
 	virtual ~Mesh();
-	
+
+	// Copies the loaded geometry into the shared geometry arena for the mesh's vertex format (see MeshManager::AllocateGeometry). Must be called on the GL thread.
+	void UploadToGPU();
+	inline bool IsUploaded() const { return this->geometry != nullptr; }
+
 	inline std::vector<Submesh>& GetSubmeshes() { return this->submeshes; }
 	inline const std::vector<Submesh>& GetSubmeshes() const { return this->submeshes; }
 
-	inline Ref<VertexArrayObject> GetVertexArray() { return this->vertexArray; }
-	inline Ref<VertexBuffer> GetVertexBuffer() { return this->vertexBuffer; }
-	inline Ref<IndexBuffer> GetIndexBuffer() { return this->indexBuffer; }
+	// The mesh's range of its geometry arena. Submesh base vertices and indices are relative to the start of this range.
+	inline const Ref<GeometryAllocation>& GetGeometry() const { return this->geometry; }
+
+	// The arena's buffers, shared with every other mesh of the same vertex format and index size
+	inline Ref<VertexArrayObject> GetVertexArray() { return this->geometry->GetArena()->GetVertexArray(); }
+	inline Ref<VertexBuffer> GetVertexBuffer() { return this->geometry->GetArena()->GetVertexBuffer(); }
+	inline Ref<IndexBuffer> GetIndexBuffer() { return this->geometry->GetArena()->GetIndexBuffer(); }
+
+	const BufferLayout& GetVertexBufferLayout() const { return this->geometry->GetArena()->GetVertexBuffer()->GetLayout(); }
+
+	// CPU copies of the geometry for things like raycasting. These are only built the first time they're asked for, which opts the mesh in to keeping them.
+	// Unlike the GPU index buffer, faces index straight into GetVertices() (the submesh base vertices are already added).
+	const std::vector<Vertex>& GetVertices() const;
+	const std::vector<Face>& GetFaces() const;
 
-	const BufferLayout& GetVertexBufferLayout() const { return this->vertexBuffer->GetLayout(); }
+	// Meshes only keep their GPU copy unless they opt in to a CPU copy (raycasting, collision...)
+	// Opting in builds the copy right away instead of on first use. Opting out frees it, so any references from GetVertices()/GetFaces() must be dropped first.
+	void SetKeepCPUGeometry(bool keep);
+	bool IsKeepingCPUGeometry() const;
 
-	inline const std::vector<Vertex>& GetVertices() const { return this->vertices; }
-	inline const std::vector<Face>& GetFaces() const { return this->faces; }
+	// Roughly how much CPU memory this mesh is holding on to (not counting textures or the GPU copy)
+	size_t GetResidentCPUBytes() const;
+
+	inline uint32_t GetVertexCount() const { return this->vertexCount; }
+	inline uint32_t GetIndexCount() const { return this->indexCount; }
+
+	// Indices are stored relative to their submesh's base vertex, so 16-bit indices are used whenever every submesh has at most 65536 vertices
+	inline uint32_t GetIndexSize() const { return this->indexSize; }
 
 	inline const std::vector<Ref<Texture>>& GetTextures() const { return this->textures; }
 
@@ -71,28 +130,78 @@ public:
 
 	inline const std::string& GetPath() const { return this->filePath; }
 
+	inline VertexFormat GetVertexFormat() const { return this->vertexFormat; }
+
+	// Maps the stored vertex positions back into model space. This is the identity unless the positions are quantized.
+	inline const glm::mat4& GetDequantizeTransform() const { return this->dequantizeTransform; }
+
+	inline uint32_t GetLODCount() const { return (uint32_t)this->lodErrors.size(); }
+
+	// How far a LOD's surface may be from the full detail mesh, relative to the diagonal of the mesh's bounding box (0 for LOD 0)
+	inline float GetLODError(uint32_t lod) const { return this->lodErrors[lod]; }
+
+	uint32_t GetTriangleCount(uint32_t lod = 0) const;
+
+	// The number of bytes the vertices take up on the GPU
+	inline uint32_t GetVertexBufferSize() const { return this->vertexCount * GetVertexStride(this->vertexFormat); }
+
+	static uint32_t GetVertexStride(VertexFormat format);
+	static BufferLayout GetVertexLayout(VertexFormat format);
+
+	// The format used by meshes loaded from now on
+	inline static void SetDefaultVertexFormat(VertexFormat format) { defaultVertexFormat = format; }
+	inline static VertexFormat GetDefaultVertexFormat() { return defaultVertexFormat; }
+
+	// The MeshOptimizerFlags cold loads run with from now on
+	inline static void SetDefaultOptimizerFlags(uint32_t flags) { defaultOptimizerFlags = flags; }
+	inline static uint32_t GetDefaultOptimizerFlags() { return defaultOptimizerFlags; }
+
+	// The simplification error targets of the LODs generated by cold loads from now on, in ascending order and relative to the mesh's size. At most MaxLODs - 1 of them.
+	inline static void SetDefaultLODErrorTargets(const std::vector<float>& targets) { defaultLODErrorTargets = targets; }
+	inline static const std::vector<float>& GetDefaultLODErrorTargets() { return defaultLODErrorTargets; }
+
 private:
+	bool LoadFromAssimp();
+	void LoadFromCache(Scope<MeshCacheFile> cacheFile);
+	MeshCacheKey GetCacheKey() const;
+	void LoadCPUGeometry() const;
+	void CreateBuffers(const void* vertexData, const void* indexData);
+	void SetupQuantization();
+
 	void SetupMaterials();
 	void LoadNodes(aiNode* node, const glm::mat4& parentTransform = glm::mat4(1.0f));
 
-	Scope<Assimp::Importer> importer;
-
 	std::vector<Submesh> submeshes;
 	glm::mat4 inverseTransform;
 
-	Ref<VertexArrayObject> vertexArray;
-	Ref<VertexBuffer> vertexBuffer;
-	Ref<IndexBuffer> indexBuffer;
+	Ref<GeometryAllocation> geometry;
 
-	std::vector<Vertex> vertices;
-	std::vector<Face> faces;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;
+
+	mutable Ref<MeshCPUGeometry> cpuGeometry; // Null unless the mesh opted in
+	mutable std::mutex cpuGeometryMutex;
 
-	std::unordered_map<aiNode*, std::vector<uint32_t>> nodeMap;
-	const aiScene* assimpScene;
+	// Geometry waiting for UploadToGPU(), either still mapped from the mesh cache or freshly converted from Assimp
+	Scope<MeshCacheFile> pendingCacheFile;
+	std::vector<uint8_t> pendingVertexData;
+	std::vector<uint8_t> pendingIndexData;
 
 	std::vector<Ref<Texture>> textures;
 
 	AABB boundingBox;
 
+	uint32_t optimizerFlags;
+	std::vector<float> lodErrorTargets;
+	std::vector<float> lodErrors;
+	VertexFormat vertexFormat;
+	AABB quantizationBounds;
+	glm::mat4 dequantizeTransform;
+
 	std::string filePath;
+
+	static VertexFormat defaultVertexFormat;
+	static uint32_t defaultOptimizerFlags;
+	static std::vector<float> defaultLODErrorTargets;
 };
\ No newline at end of file
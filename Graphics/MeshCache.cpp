@@ -0,0 +1,485 @@
+#include "MeshCache.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MeshCacheUtils
+{
+	static const uint32_t Magic = 0x434D5344; // "DSMC"
+	static const uint64_t DataAlignment = 16;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t importerFlags;
+		uint32_t vertexStride;
+		uint32_t vertexFormat;
+		uint32_t indexSize;
+		uint32_t optimizerFlags;
+		uint32_t lodCount;
+
+		uint32_t lodTargetCount;
+		float lodErrorTargets[Mesh::MaxLODs - 1];
+		float lodErrors[Mesh::MaxLODs];
+
+		uint64_t sourceSize;
+		uint64_t sourceWriteTime;
+		uint64_t sourceHash;
+
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t submeshCount;
+		uint32_t stringTableSize;
+
+		float boundsMin[3];
+		float boundsMax[3];
+		float inverseTransform[16];
+
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t submeshOffset;
+		uint64_t stringOffset;
+	};
+
+	struct SubmeshRecord
+	{
+		uint32_t baseVertex;
+		uint32_t baseIndex;
+		uint32_t materialIndex;
+		uint32_t indexCount;
+		uint32_t vertexCount;
+
+		uint32_t lodBaseIndex[Mesh::MaxLODs];
+		uint32_t lodIndexCount[Mesh::MaxLODs];
+
+		float boundsMin[3];
+		float boundsMax[3];
+		float transform[16];
+
+		uint32_t nodeNameOffset;
+		uint32_t nodeNameLength;
+		uint32_t meshNameOffset;
+		uint32_t meshNameLength;
+	};
+
+	static uint64_t Align(uint64_t offset)
+	{
+		return (offset + DataAlignment - 1) & ~(DataAlignment - 1);
+	}
+
+	// 64-bit FNV-1a
+	static uint64_t Hash(const uint8_t* data, uint64_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (uint64_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static bool GetFileStamp(const std::string& path, uint64_t& size, uint64_t& writeTime)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			return false;
+		}
+
+		size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+		writeTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+		{
+			return false;
+		}
+
+		size = (uint64_t)info.st_size;
+		writeTime = (uint64_t)info.st_mtime;
+#endif
+		return true;
+	}
+
+	static bool HashFile(const std::string& path, uint64_t& hash)
+	{
+		MappedFile file(path);
+		if (!file.IsValid())
+		{
+			return false;
+		}
+
+		hash = Hash(file.GetData(), file.GetSize());
+		return true;
+	}
+
+	// Patches the source write time stored in the cache's header in place
+	static bool RewriteWriteTime(const std::string& cachePath, uint64_t writeTime)
+	{
+		std::fstream fs(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+		if (!fs.good())
+		{
+			return false;
+		}
+
+		fs.seekp(offsetof(Header, sourceWriteTime));
+		fs.write((const char*)&writeTime, sizeof(uint64_t));
+		return fs.good();
+	}
+}
+
+MappedFile::MappedFile(const std::string& path)
+	: data(nullptr), size(0)
+{
+#ifdef _WIN32
+	this->mappingHandle = NULL;
+	this->fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (this->fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(this->fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		return;
+	}
+
+	this->mappingHandle = CreateFileMappingA(this->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!this->mappingHandle)
+	{
+		return;
+	}
+
+	this->data = (const uint8_t*)MapViewOfFile(this->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	this->size = this->data ? (uint64_t)fileSize.QuadPart : 0;
+#else
+	this->fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (this->fileDescriptor < 0)
+	{
+		return;
+	}
+
+	struct stat info;
+	if (fstat(this->fileDescriptor, &info) != 0 || info.st_size == 0)
+	{
+		return;
+	}
+
+	void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, this->fileDescriptor, 0);
+	if (mapped == MAP_FAILED)
+	{
+		return;
+	}
+
+	this->data = (const uint8_t*)mapped;
+	this->size = (uint64_t)info.st_size;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (this->data)
+	{
+		UnmapViewOfFile(this->data);
+	}
+
+	if (this->mappingHandle)
+	{
+		CloseHandle(this->mappingHandle);
+	}
+
+	if (this->fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(this->fileHandle);
+	}
+#else
+	if (this->data)
+	{
+		munmap((void*)this->data, (size_t)this->size);
+	}
+
+	if (this->fileDescriptor >= 0)
+	{
+		close(this->fileDescriptor);
+	}
+#endif
+}
+
+MeshCacheFile::MeshCacheFile(Scope<MappedFile> file)
+	: file(std::move(file)), boundingBox(glm::vec3(0.0f), glm::vec3(0.0f)), inverseTransform(1.0f)
+{
+	const uint8_t* base = this->file->GetData();
+	const MeshCacheUtils::Header* header = (const MeshCacheUtils::Header*)base;
+
+	this->vertexData = base + header->vertexOffset;
+	this->vertexStride = header->vertexStride;
+	this->vertexCount = header->vertexCount;
+	this->indexData = base + header->indexOffset;
+	this->indexSize = header->indexSize;
+	this->indexCount = header->indexCount;
+	this->lodErrors.assign(header->lodErrors, header->lodErrors + header->lodCount);
+
+	this->boundingBox.min = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+	this->boundingBox.max = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+	memcpy(glm::value_ptr(this->inverseTransform), header->inverseTransform, sizeof(header->inverseTransform));
+
+	const MeshCacheUtils::SubmeshRecord* records = (const MeshCacheUtils::SubmeshRecord*)(base + header->submeshOffset);
+	const char* strings = (const char*)(base + header->stringOffset);
+	this->submeshes.resize(header->submeshCount);
+	for (uint32_t i = 0; i < header->submeshCount; i++)
+	{
+		const MeshCacheUtils::SubmeshRecord& record = records[i];
+		Submesh& submesh = this->submeshes[i];
+		submesh.baseVertex = record.baseVertex;
+		submesh.baseIndex = record.baseIndex;
+		submesh.materialIndex = record.materialIndex;
+		submesh.indexCount = record.indexCount;
+		submesh.vertexCount = record.vertexCount;
+		submesh.lods.resize(header->lodCount);
+		for (uint32_t j = 0; j < header->lodCount; j++)
+		{
+			submesh.lods[j].baseIndex = record.lodBaseIndex[j];
+			submesh.lods[j].indexCount = record.lodIndexCount[j];
+		}
+		submesh.boundingBox.min = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+		submesh.boundingBox.max = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+		memcpy(glm::value_ptr(submesh.transform), record.transform, sizeof(record.transform));
+		submesh.nodeName = std::string(strings + record.nodeNameOffset, record.nodeNameLength);
+		submesh.meshName = std::string(strings + record.meshNameOffset, record.meshNameLength);
+	}
+}
+
+std::string MeshCache::GetCachePath(const std::string& sourcePath, VertexFormat vertexFormat)
+{
+	switch (vertexFormat)
+	{
+	case VertexFormat::Compact:
+		return sourcePath + ".compact.meshcache";
+	case VertexFormat::CompactQuantized:
+		return sourcePath + ".quantized.meshcache";
+	default:
+		return sourcePath + ".meshcache";
+	}
+}
+
+Scope<MeshCacheFile> MeshCache::Open(const std::string& sourcePath, const MeshCacheKey& key)
+{
+	uint64_t sourceSize, sourceWriteTime;
+	if (!MeshCacheUtils::GetFileStamp(sourcePath, sourceSize, sourceWriteTime))
+	{
+		return nullptr;
+	}
+
+	std::string cachePath = GetCachePath(sourcePath, key.vertexFormat);
+	Scope<MappedFile> file = CreateScope<MappedFile>(cachePath);
+	if (!file->IsValid() || file->GetSize() < sizeof(MeshCacheUtils::Header))
+	{
+		return nullptr;
+	}
+
+	const MeshCacheUtils::Header* header = (const MeshCacheUtils::Header*)file->GetData();
+	if (header->magic != MeshCacheUtils::Magic || header->version != Version || header->importerFlags != key.importerFlags || header->optimizerFlags != key.optimizerFlags
+		|| header->vertexFormat != (uint32_t)key.vertexFormat || header->vertexStride != Mesh::GetVertexStride(key.vertexFormat) || header->sourceSize != sourceSize)
+	{
+		return nullptr;
+	}
+
+	if (header->lodTargetCount != key.lodErrorTargets.size() || memcmp(header->lodErrorTargets, key.lodErrorTargets.data(), key.lodErrorTargets.size() * sizeof(float)) != 0)
+	{
+		return nullptr;
+	}
+
+	if (header->sourceWriteTime != sourceWriteTime) // The file was touched, only rebuild if the contents actually changed
+	{
+		uint64_t sourceHash;
+		if (!MeshCacheUtils::HashFile(sourcePath, sourceHash) || sourceHash != header->sourceHash)
+		{
+			return nullptr;
+		}
+
+		// Store the new write time so the next load doesn't hash the source again. The mapping has to go first, Windows won't open a mapped file for writing.
+		file.reset();
+		if (!MeshCacheUtils::RewriteWriteTime(cachePath, sourceWriteTime))
+		{
+			std::cout << "Failed to update mesh cache " << cachePath << std::endl;
+		}
+
+		file = CreateScope<MappedFile>(cachePath);
+		if (!file->IsValid() || file->GetSize() < sizeof(MeshCacheUtils::Header))
+		{
+			return nullptr;
+		}
+		header = (const MeshCacheUtils::Header*)file->GetData();
+	}
+
+	// Make sure the file isn't truncated
+	uint64_t stringEnd = header->stringOffset + header->stringTableSize;
+	uint64_t vertexEnd = header->vertexOffset + (uint64_t)header->vertexCount * header->vertexStride;
+	if ((header->indexSize != sizeof(uint16_t) && header->indexSize != sizeof(uint32_t)) || header->lodCount == 0 || header->lodCount > Mesh::MaxLODs)
+	{
+		std::cout << "Mesh cache " << cachePath << " is corrupt!" << std::endl;
+		return nullptr;
+	}
+
+	uint64_t indexEnd = header->indexOffset + (uint64_t)header->indexCount * header->indexSize;
+	uint64_t submeshEnd = header->submeshOffset + (uint64_t)header->submeshCount * sizeof(MeshCacheUtils::SubmeshRecord);
+	if (stringEnd > file->GetSize() || vertexEnd > file->GetSize() || indexEnd > file->GetSize() || submeshEnd > file->GetSize())
+	{
+		std::cout << "Mesh cache " << cachePath << " is corrupt!" << std::endl;
+		return nullptr;
+	}
+
+	return CreateScope<MeshCacheFile>(std::move(file));
+}
+
+bool MeshCache::Write(const std::string& sourcePath, const MeshCacheKey& key,
+	const void* vertexData, uint32_t vertexStride, uint32_t vertexCount,
+	const void* indexData, uint32_t indexSize, uint32_t indexCount,
+	const std::vector<Submesh>& submeshes, const std::vector<float>& lodErrors, const AABB& boundingBox, const glm::mat4& inverseTransform)
+{
+	MeshCacheUtils::Header header;
+	memset(&header, 0, sizeof(MeshCacheUtils::Header));
+	header.magic = MeshCacheUtils::Magic;
+	header.version = Version;
+	header.importerFlags = key.importerFlags;
+	header.optimizerFlags = key.optimizerFlags;
+	header.vertexStride = vertexStride;
+	header.vertexFormat = (uint32_t)key.vertexFormat;
+	header.vertexCount = vertexCount;
+	header.indexSize = indexSize;
+	header.indexCount = indexCount;
+	header.submeshCount = (uint32_t)submeshes.size();
+	header.lodCount = (uint32_t)lodErrors.size();
+
+	if (key.lodErrorTargets.size() > Mesh::MaxLODs - 1 || lodErrors.empty() || lodErrors.size() > Mesh::MaxLODs)
+	{
+		return false;
+	}
+	memcpy(header.lodErrors, lodErrors.data(), lodErrors.size() * sizeof(float));
+	header.lodTargetCount = (uint32_t)key.lodErrorTargets.size();
+	memcpy(header.lodErrorTargets, key.lodErrorTargets.data(), key.lodErrorTargets.size() * sizeof(float));
+
+	if (!MeshCacheUtils::GetFileStamp(sourcePath, header.sourceSize, header.sourceWriteTime) || !MeshCacheUtils::HashFile(sourcePath, header.sourceHash))
+	{
+		return false;
+	}
+
+	header.boundsMin[0] = boundingBox.min.x;
+	header.boundsMin[1] = boundingBox.min.y;
+	header.boundsMin[2] = boundingBox.min.z;
+	header.boundsMax[0] = boundingBox.max.x;
+	header.boundsMax[1] = boundingBox.max.y;
+	header.boundsMax[2] = boundingBox.max.z;
+	memcpy(header.inverseTransform, glm::value_ptr(inverseTransform), sizeof(header.inverseTransform));
+
+	// Build the submesh table and the string table it points into
+	std::vector<MeshCacheUtils::SubmeshRecord> records(submeshes.size());
+	std::string strings;
+	for (size_t i = 0; i < submeshes.size(); i++)
+	{
+		const Submesh& submesh = submeshes[i];
+		MeshCacheUtils::SubmeshRecord& record = records[i];
+		memset(&record, 0, sizeof(MeshCacheUtils::SubmeshRecord));
+		record.baseVertex = submesh.baseVertex;
+		record.baseIndex = submesh.baseIndex;
+		record.materialIndex = submesh.materialIndex;
+		record.indexCount = submesh.indexCount;
+		record.vertexCount = submesh.vertexCount;
+		for (uint32_t j = 0; j < header.lodCount; j++)
+		{
+			record.lodBaseIndex[j] = submesh.lods[j].baseIndex;
+			record.lodIndexCount[j] = submesh.lods[j].indexCount;
+		}
+		record.boundsMin[0] = submesh.boundingBox.min.x;
+		record.boundsMin[1] = submesh.boundingBox.min.y;
+		record.boundsMin[2] = submesh.boundingBox.min.z;
+		record.boundsMax[0] = submesh.boundingBox.max.x;
+		record.boundsMax[1] = submesh.boundingBox.max.y;
+		record.boundsMax[2] = submesh.boundingBox.max.z;
+		memcpy(record.transform, glm::value_ptr(submesh.transform), sizeof(record.transform));
+
+		record.nodeNameOffset = (uint32_t)strings.size();
+		record.nodeNameLength = (uint32_t)submesh.nodeName.size();
+		strings += submesh.nodeName;
+		record.meshNameOffset = (uint32_t)strings.size();
+		record.meshNameLength = (uint32_t)submesh.meshName.size();
+		strings += submesh.meshName;
+	}
+	header.stringTableSize = (uint32_t)strings.size();
+
+	// Lay out the sections, keeping the geometry blobs aligned so they can be handed straight to the GPU
+	uint64_t vertexSize = (uint64_t)vertexCount * vertexStride;
+	uint64_t indexDataSize = (uint64_t)indexCount * indexSize;
+	uint64_t submeshSize = records.size() * sizeof(MeshCacheUtils::SubmeshRecord);
+	header.vertexOffset = MeshCacheUtils::Align(sizeof(MeshCacheUtils::Header));
+	header.indexOffset = MeshCacheUtils::Align(header.vertexOffset + vertexSize);
+	header.submeshOffset = MeshCacheUtils::Align(header.indexOffset + indexDataSize);
+	header.stringOffset = header.submeshOffset + submeshSize;
+
+	std::string cachePath = GetCachePath(sourcePath, key.vertexFormat);
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream ofs(tempPath, std::ios::binary | std::ios::trunc);
+		if (!ofs.good())
+		{
+			std::cout << "Failed to write mesh cache " << cachePath << std::endl;
+			return false;
+		}
+
+		const char padding[MeshCacheUtils::DataAlignment] = { 0 };
+		ofs.write((const char*)&header, sizeof(MeshCacheUtils::Header));
+		ofs.write(padding, header.vertexOffset - sizeof(MeshCacheUtils::Header));
+		ofs.write((const char*)vertexData, vertexSize);
+		ofs.write(padding, header.indexOffset - (header.vertexOffset + vertexSize));
+		ofs.write((const char*)indexData, indexDataSize);
+		ofs.write(padding, header.submeshOffset - (header.indexOffset + indexDataSize));
+		ofs.write((const char*)records.data(), submeshSize);
+		ofs.write(strings.data(), strings.size());
+
+		if (!ofs.good())
+		{
+			std::cout << "Failed to write mesh cache " << cachePath << std::endl;
+			ofs.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	// Swap the finished file in so a crash mid-write never leaves a half written cache behind
+	std::remove(cachePath.c_str());
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void MeshCache::Invalidate(const std::string& sourcePath)
+{
+	std::remove(GetCachePath(sourcePath, VertexFormat::Standard).c_str());
+	std::remove(GetCachePath(sourcePath, VertexFormat::Compact).c_str());
+	std::remove(GetCachePath(sourcePath, VertexFormat::CompactQuantized).c_str());
+}
\ No newline at end of file
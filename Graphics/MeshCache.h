@@ -0,0 +1,100 @@
+#pragma once
+
+#include "pch.h"
+#include "Mesh.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// A read-only view of a file mapped into memory
+class MappedFile
+{
+public:
+	MappedFile(const std::string& path);
+	virtual ~MappedFile();
+
+	inline bool IsValid() const { return this->data != nullptr; }
+	inline const uint8_t* GetData() const { return this->data; }
+	inline uint64_t GetSize() const { return this->size; }
+
+private:
+	const uint8_t* data;
+	uint64_t size;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+// An opened, validated mesh cache file. All pointers returned point directly into the mapped file and are only valid while this object is alive.
+class MeshCacheFile
+{
+public:
+	MeshCacheFile(Scope<MappedFile> file);
+	virtual ~MeshCacheFile() = default;
+
+	inline const void* GetVertexData() const { return this->vertexData; }
+	inline uint32_t GetVertexStride() const { return this->vertexStride; }
+	inline uint32_t GetVertexCount() const { return this->vertexCount; }
+
+	inline const void* GetIndexData() const { return this->indexData; }
+	inline uint32_t GetIndexSize() const { return this->indexSize; } // 2 or 4 bytes
+	inline uint32_t GetIndexCount() const { return this->indexCount; }
+
+	inline const std::vector<Submesh>& GetSubmeshes() const { return this->submeshes; }
+	inline const std::vector<float>& GetLODErrors() const { return this->lodErrors; }
+	inline const AABB& GetBoundingBox() const { return this->boundingBox; }
+	inline const glm::mat4& GetInverseTransform() const { return this->inverseTransform; }
+
+private:
+	Scope<MappedFile> file;
+
+	const void* vertexData;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+
+	const void* indexData;
+	uint32_t indexSize;
+	uint32_t indexCount;
+
+	std::vector<Submesh> submeshes;
+	std::vector<float> lodErrors;
+	AABB boundingBox;
+	glm::mat4 inverseTransform;
+};
+
+// Everything besides the source file that changes what ends up in a cache file
+struct MeshCacheKey
+{
+	uint32_t importerFlags;
+	uint32_t optimizerFlags;
+	VertexFormat vertexFormat;
+	std::vector<float> lodErrorTargets;
+};
+
+// Stores the final GPU-ready geometry of a mesh on disk so that warm loads can skip Assimp entirely.
+// Each vertex format gets its own cache file. A cache file is only considered valid if its version, key and source file stamp (size, last write time and content hash) all match.
+class MeshCache
+{
+public:
+	static const uint32_t Version = 7;
+
+	// Returns the path of the cache file that belongs to the given source file and vertex format
+	static std::string GetCachePath(const std::string& sourcePath, VertexFormat vertexFormat);
+
+	// Opens the cache for the given source file. Returns nullptr if the cache does not exist or is stale.
+	static Scope<MeshCacheFile> Open(const std::string& sourcePath, const MeshCacheKey& key);
+
+	// Writes a new cache file for the given source file, replacing any existing one
+	static bool Write(const std::string& sourcePath, const MeshCacheKey& key,
+		const void* vertexData, uint32_t vertexStride, uint32_t vertexCount,
+		const void* indexData, uint32_t indexSize, uint32_t indexCount,
+		const std::vector<Submesh>& submeshes, const std::vector<float>& lodErrors, const AABB& boundingBox, const glm::mat4& inverseTransform);
+
+	// Deletes the cache files of every vertex format for the given source file (used to force a cold load)
+	static void Invalidate(const std::string& sourcePath);
+};
\ No newline at end of file
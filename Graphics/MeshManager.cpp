@@ -1,21 +1,260 @@
 #include "MeshManager.h"
+#include "ThreadPool.h"
 
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+std::map<std::pair<VertexFormat, uint32_t>, Scope<GeometryArena>> MeshManager::geometryArenas; // Defined first so it's destroyed after the meshes holding allocations from it. Meshes held outside this file have to be gone before Shutdown().
 std::unordered_map<std::string, Ref<Mesh>> MeshManager::loadedMeshes;
+std::unordered_map<std::string, MeshManager::InFlightLoad> MeshManager::inFlightMeshes;
+std::deque<MeshManager::PendingUpload> MeshManager::pendingUploads;
+std::mutex MeshManager::mutex;
 
 Ref<Mesh> MeshManager::LoadMesh(const std::string& path, bool copy)
 {
-	std::unordered_map<std::string, Ref<Mesh>>::iterator it = loadedMeshes.find(path);
-	if (it != loadedMeshes.end())
+	std::shared_future<Ref<Mesh>> inFlight;
 	{
-		if (copy)
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<std::string, Ref<Mesh>>::iterator it = loadedMeshes.find(path);
+		if (it != loadedMeshes.end())
 		{
-			return CreateRef<Mesh>(path); // We don't really need the manager to store this since it creates a shared ptr that will be destroyed on its own when out of scope
+			if (copy)
+			{
+				return CreateRef<Mesh>(path); // We don't really need the manager to store this since it creates a shared ptr that will be destroyed on its own when out of scope
+			}
+
+			return it->second;
 		}
 
-		return it->second;
+		std::unordered_map<std::string, InFlightLoad>::iterator inFlightIt = inFlightMeshes.find(path);
+		if (inFlightIt != inFlightMeshes.end())
+		{
+			inFlight = inFlightIt->second.future;
+		}
+	}
+
+	if (inFlight.valid()) // Somebody already kicked off this load, just wait for it instead of importing again
+	{
+		Ref<Mesh> mesh = WaitForLoad(inFlight).get();
+		return copy ? CreateRef<Mesh>(path) : mesh;
 	}
 
 	Ref<Mesh> mesh = CreateRef<Mesh>(path);
+
+	std::lock_guard<std::mutex> lock(mutex);
 	loadedMeshes.insert(std::make_pair(path, mesh));
 	return mesh;
 }
+
+std::shared_future<Ref<Mesh>> MeshManager::LoadMeshAsync(const std::string& path)
+{
+	Ref<std::promise<Ref<Mesh>>> promise = CreateRef<std::promise<Ref<Mesh>>>();
+	std::shared_future<Ref<Mesh>> future = promise->get_future().share();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<std::string, Ref<Mesh>>::iterator it = loadedMeshes.find(path);
+		if (it != loadedMeshes.end())
+		{
+			promise->set_value(it->second);
+			return future;
+		}
+
+		std::unordered_map<std::string, InFlightLoad>::iterator inFlightIt = inFlightMeshes.find(path);
+		if (inFlightIt != inFlightMeshes.end())
+		{
+			return inFlightIt->second.future;
+		}
+
+		inFlightMeshes.insert(std::make_pair(path, InFlightLoad{ promise, future }));
+	}
+
+	// Do the import, vertex conversion and bounds on a worker. Only the GL objects are created back on the GL thread.
+	ThreadPool::Get().Enqueue([path]()
+	{
+		try
+		{
+			Ref<Mesh> mesh = CreateRef<Mesh>(path, false);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			pendingUploads.push_back({ path, mesh });
+		}
+		catch (...)
+		{
+			FailLoad(path, std::current_exception());
+		}
+	});
+
+	return future;
+}
+
+void MeshManager::ProcessUploads(uint32_t maxUploads)
+{
+	for (uint32_t i = 0; i < maxUploads; i++)
+	{
+		PendingUpload upload;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pendingUploads.empty())
+			{
+				return;
+			}
+
+			upload = pendingUploads.front();
+			pendingUploads.pop_front();
+		}
+
+		try
+		{
+			upload.mesh->UploadToGPU();
+		}
+		catch (...)
+		{
+			FailLoad(upload.path, std::current_exception());
+			continue;
+		}
+
+		if (!upload.mesh->IsUploaded()) // The import failed without throwing, there's no geometry to hand out
+		{
+			FailLoad(upload.path, std::make_exception_ptr(std::runtime_error("Failed to import mesh " + upload.path)));
+			continue;
+		}
+
+		Ref<std::promise<Ref<Mesh>>> promise;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			loadedMeshes.insert(std::make_pair(upload.path, upload.mesh));
+
+			std::unordered_map<std::string, InFlightLoad>::iterator it = inFlightMeshes.find(upload.path);
+			if (it != inFlightMeshes.end())
+			{
+				promise = it->second.promise;
+				inFlightMeshes.erase(it);
+			}
+		}
+
+		if (promise)
+		{
+			promise->set_value(upload.mesh);
+		}
+	}
+}
+
+void MeshManager::FailLoad(const std::string& path, std::exception_ptr error)
+{
+	std::cout << "Failed to load mesh " << path << std::endl;
+
+	Ref<std::promise<Ref<Mesh>>> promise;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<std::string, InFlightLoad>::iterator it = inFlightMeshes.find(path);
+		if (it != inFlightMeshes.end())
+		{
+			promise = it->second.promise;
+			inFlightMeshes.erase(it);
+		}
+	}
+
+	if (promise)
+	{
+		promise->set_exception(error);
+	}
+}
+
+void MeshManager::WaitForLoads()
+{
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (inFlightMeshes.empty())
+			{
+				return;
+			}
+		}
+
+		ProcessUploads();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void MeshManager::Shutdown()
+{
+	WaitForLoads();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingUploads.clear();
+		loadedMeshes.clear();
+	}
+
+	geometryArenas.clear();
+}
+
+std::shared_future<Ref<Mesh>> MeshManager::WaitForLoad(std::shared_future<Ref<Mesh>> future)
+{
+	// The upload has to happen on this (the GL) thread, so keep pumping uploads until ours comes through
+	while (future.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+	{
+		ProcessUploads();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return future;
+}
+
+Ref<GeometryAllocation> MeshManager::AllocateGeometry(VertexFormat format, uint32_t indexSize, const void* vertexData, uint32_t vertexCount, const void* indexData, uint32_t indexCount)
+{
+	Scope<GeometryArena>& arena = geometryArenas[std::make_pair(format, indexSize)]; // Only touched on the GL thread, no lock needed
+	if (!arena)
+	{
+		arena = CreateScope<GeometryArena>(Mesh::GetVertexLayout(format), indexSize);
+	}
+
+	return arena->Allocate(vertexData, vertexCount, indexData, indexCount);
+}
+
+std::vector<GeometryArena*> MeshManager::GetGeometryArenas()
+{
+	std::vector<GeometryArena*> arenas;
+	for (const std::pair<const std::pair<VertexFormat, uint32_t>, Scope<GeometryArena>>& arena : geometryArenas)
+	{
+		arenas.push_back(arena.second.get());
+	}
+	return arenas;
+}
+
+size_t MeshManager::GetResidentCPUBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t bytes = 0;
+	for (const std::pair<const std::string, Ref<Mesh>>& loaded : loadedMeshes)
+	{
+		bytes += loaded.second->GetResidentCPUBytes();
+	}
+	return bytes;
+}
+
+void MeshManager::PrintMemoryReport()
+{
+	std::vector<std::pair<size_t, Ref<Mesh>>> meshes;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const std::pair<const std::string, Ref<Mesh>>& loaded : loadedMeshes)
+		{
+			meshes.push_back(std::make_pair(loaded.second->GetResidentCPUBytes(), loaded.second));
+		}
+	}
+
+	std::sort(meshes.begin(), meshes.end(), [](const std::pair<size_t, Ref<Mesh>>& a, const std::pair<size_t, Ref<Mesh>>& b) { return a.first > b.first; });
+
+	size_t total = 0;
+	std::cout << "Mesh CPU memory:" << std::endl;
+	for (const std::pair<size_t, Ref<Mesh>>& mesh : meshes)
+	{
+		std::cout << "  " << mesh.first / 1024 << "KB" << (mesh.second->IsKeepingCPUGeometry() ? " (keeps CPU geometry) " : " ") << mesh.second->GetPath() << std::endl;
+		total += mesh.first;
+	}
+	std::cout << "Total: " << total / 1024 << "KB across " << meshes.size() << " meshes" << std::endl;
+}
\ No newline at end of file
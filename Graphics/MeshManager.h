@@ -1,14 +1,66 @@
 #pragma once
 
 #include "Mesh.h"
+#include "GeometryArena.h"
 
+#include <map>
 #include <unordered_map>
+#include <future>
+#include <mutex>
+#include <deque>
 
 class MeshManager
 {
 public:
 	static Ref<Mesh> LoadMesh(const std::string& path, bool copy = false);
 
+	// Imports the mesh on a worker thread. The returned future is fulfilled on the GL thread once ProcessUploads() has created the mesh's GPU buffers.
+	// Requesting a path that is already being loaded returns the in-flight load instead of importing it twice.
+	// If the import or upload fails, the error is stored in the future (get() rethrows it) and the load stops counting as in flight.
+	static std::shared_future<Ref<Mesh>> LoadMeshAsync(const std::string& path);
+
+	// Uploads meshes that have finished importing. Must be called on the GL thread.
+	static void ProcessUploads(uint32_t maxUploads = UINT32_MAX);
+
+	// Blocks the GL thread until every in-flight load has been uploaded or has failed
+	static void WaitForLoads();
+
+	// Copies a mesh's geometry into the shared arena for its vertex format and index size. Must be called on the GL thread.
+	static Ref<GeometryAllocation> AllocateGeometry(VertexFormat format, uint32_t indexSize, const void* vertexData, uint32_t vertexCount, const void* indexData, uint32_t indexCount);
+
+	// Every arena created so far, one per vertex format and index size in use
+	static std::vector<GeometryArena*> GetGeometryArenas();
+
+	// CPU memory held by all loaded meshes, see Mesh::GetResidentCPUBytes()
+	static size_t GetResidentCPUBytes();
+
+	// Prints each loaded mesh's resident CPU memory, biggest first, followed by the total
+	static void PrintMemoryReport();
+
+	// Finishes outstanding loads and releases the cached meshes, then the arenas. Call on the GL thread before the context goes away, once nothing else holds meshes.
+	static void Shutdown();
+
 private:
+	struct InFlightLoad
+	{
+		Ref<std::promise<Ref<Mesh>>> promise;
+		std::shared_future<Ref<Mesh>> future;
+	};
+
+	struct PendingUpload
+	{
+		std::string path;
+		Ref<Mesh> mesh;
+	};
+
+	static std::shared_future<Ref<Mesh>> WaitForLoad(std::shared_future<Ref<Mesh>> future);
+
+	// Hands the error to whoever is waiting on the path's load and forgets the load
+	static void FailLoad(const std::string& path, std::exception_ptr error);
+
+	static std::map<std::pair<VertexFormat, uint32_t>, Scope<GeometryArena>> geometryArenas;
 	static std::unordered_map<std::string, Ref<Mesh>> loadedMeshes;
+	static std::unordered_map<std::string, InFlightLoad> inFlightMeshes;
+	static std::deque<PendingUpload> pendingUploads;
+	static std::mutex mutex;
 };
\ No newline at end of file
@@ -0,0 +1,612 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <unordered_map>
+
+namespace MeshOptimizerUtils
+{
+	// Tuning values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	static const uint32_t CacheSize = 32;
+	static const float CacheDecayPower = 1.5f;
+	static const float LastTriangleScore = 0.75f;
+	static const float ValenceBoostScale = 2.0f;
+	static const float ValenceBoostPower = 0.5f;
+
+	static const uint32_t InvalidTriangle = UINT32_MAX;
+
+	static float ScoreVertex(int cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0) // Nothing left to draw with this vertex
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3) // Used by the last triangle, deliberately lower so we don't just keep fanning around one vertex
+			{
+				score = LastTriangleScore;
+			}
+			else
+			{
+				float scaler = 1.0f - (float)(cachePosition - 3) / (CacheSize - 3);
+				score = std::pow(scaler, CacheDecayPower);
+			}
+		}
+
+		// Favour vertices that only have a few triangles left so they get finished off instead of lingering
+		score += ValenceBoostScale * std::pow((float)remainingTriangles, -ValenceBoostPower);
+		return score;
+	}
+
+	struct Cluster
+	{
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		float sortKey;
+	};
+
+	// Symmetric 4x4 matrix that sums squared distances to a set of planes
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+		double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+		double a22 = 0.0, a23 = 0.0;
+		double a33 = 0.0;
+
+		void AddPlane(const glm::vec3& normal, float distance, float weight)
+		{
+			double a = normal.x, b = normal.y, c = normal.z, d = distance;
+			a00 += weight * a * a; a01 += weight * a * b; a02 += weight * a * c; a03 += weight * a * d;
+			a11 += weight * b * b; a12 += weight * b * c; a13 += weight * b * d;
+			a22 += weight * c * c; a23 += weight * c * d;
+			a33 += weight * d * d;
+		}
+
+		void Add(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+			a11 += other.a11; a12 += other.a12; a13 += other.a13;
+			a22 += other.a22; a23 += other.a23;
+			a33 += other.a33;
+		}
+
+		double Evaluate(const glm::vec3& point) const
+		{
+			double x = point.x, y = point.y, z = point.z;
+			return a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+				+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+				+ a22 * z * z + 2.0 * a23 * z
+				+ a33;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& position) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &position.x, sizeof(float));
+			memcpy(bits + 1, &position.y, sizeof(float));
+			memcpy(bits + 2, &position.z, sizeof(float));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	uint32_t triangleCount = (uint32_t)indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Build the vertex -> triangle adjacency
+	std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		remainingTriangles[index]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + remainingTriangles[i];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); i++)
+		{
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		vertexScores[i] = MeshOptimizerUtils::ScoreVertex(-1, remainingTriangles[i]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	uint32_t bestTriangle = 0;
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+		if (triangleScores[i] > triangleScores[bestTriangle])
+		{
+			bestTriangle = i;
+		}
+	}
+
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(MeshOptimizerUtils::CacheSize + 3);
+	newCache.reserve(MeshOptimizerUtils::CacheSize + 3);
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint32_t searchCursor = 0;
+	for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (bestTriangle == MeshOptimizerUtils::InvalidTriangle) // Nothing in the cache is connected to anything left, start over with the next unused triangle
+		{
+			while (emitted[searchCursor])
+			{
+				searchCursor++;
+			}
+			bestTriangle = searchCursor;
+		}
+
+		const uint32_t* triangle = &indices[bestTriangle * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		// Detach the triangle from its vertices
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			uint32_t vertex = triangle[i];
+			uint32_t* vertexTriangles = &adjacency[adjacencyOffsets[vertex]];
+			uint32_t count = remainingTriangles[vertex];
+			for (uint32_t j = 0; j < count; j++)
+			{
+				if (vertexTriangles[j] == bestTriangle)
+				{
+					std::swap(vertexTriangles[j], vertexTriangles[count - 1]);
+					break;
+				}
+			}
+			remainingTriangles[vertex]--;
+		}
+
+		// The triangle's vertices move to the front of the LRU cache
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t vertex : cache)
+		{
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+			{
+				newCache.push_back(vertex);
+			}
+		}
+
+		for (uint32_t i = MeshOptimizerUtils::CacheSize; i < newCache.size(); i++) // Evicted
+		{
+			cachePositions[newCache[i]] = -1;
+		}
+		uint32_t cacheCount = std::min((uint32_t)newCache.size(), MeshOptimizerUtils::CacheSize);
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			cachePositions[newCache[i]] = (int)i;
+		}
+
+		// Rescore every vertex whose cache position changed and push the difference onto their remaining triangles
+		bestTriangle = MeshOptimizerUtils::InvalidTriangle;
+		float bestScore = -FLT_MAX;
+		for (uint32_t i = 0; i < newCache.size(); i++)
+		{
+			uint32_t vertex = newCache[i];
+			float newScore = MeshOptimizerUtils::ScoreVertex(cachePositions[vertex], remainingTriangles[vertex]);
+			float scoreDelta = newScore - vertexScores[vertex];
+			vertexScores[vertex] = newScore;
+
+			const uint32_t* vertexTriangles = &adjacency[adjacencyOffsets[vertex]];
+			for (uint32_t j = 0; j < remainingTriangles[vertex]; j++)
+			{
+				uint32_t vertexTriangle = vertexTriangles[j];
+				triangleScores[vertexTriangle] += scoreDelta;
+				if (i < cacheCount && triangleScores[vertexTriangle] > bestScore)
+				{
+					bestScore = triangleScores[vertexTriangle];
+					bestTriangle = vertexTriangle;
+				}
+			}
+		}
+
+		newCache.resize(cacheCount);
+		std::swap(cache, newCache);
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float threshold)
+{
+	uint32_t triangleCount = (uint32_t)indices.size() / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	// Cut clusters where the FIFO cache would restart anyway (all 3 vertices miss), as long as the cluster so far is within the threshold of the whole mesh
+	const uint32_t cacheSize = 16;
+	float meshACMR = AnalyzeVertexCache(indices, (uint32_t)positions.size(), cacheSize).GetACMR();
+
+	std::vector<uint32_t> cacheTimestamps(positions.size(), 0);
+	uint32_t timestamp = cacheSize + 1;
+
+	std::vector<MeshOptimizerUtils::Cluster> clusters;
+	MeshOptimizerUtils::Cluster currentCluster = { 0, 0, 0.0f };
+	uint32_t clusterMisses = 0;
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		uint32_t misses = 0;
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			uint32_t vertex = indices[i * 3 + j];
+			if (timestamp - cacheTimestamps[vertex] > cacheSize)
+			{
+				cacheTimestamps[vertex] = timestamp++;
+				misses++;
+			}
+		}
+
+		if (misses == 3 && currentCluster.triangleCount > 0 && (float)clusterMisses / currentCluster.triangleCount <= meshACMR * threshold)
+		{
+			clusters.push_back(currentCluster);
+			currentCluster = { i, 0, 0.0f };
+			clusterMisses = 0;
+		}
+
+		currentCluster.triangleCount++;
+		clusterMisses += misses;
+	}
+	clusters.push_back(currentCluster);
+
+	if (clusters.size() < 2)
+	{
+		return;
+	}
+
+	// Sort clusters by how much they face away from the center of the mesh, those are the most likely to occlude the others
+	glm::vec3 meshCentroid(0.0f);
+	for (const glm::vec3& position : positions)
+	{
+		meshCentroid += position;
+	}
+	meshCentroid /= (float)positions.size();
+
+	for (MeshOptimizerUtils::Cluster& cluster : clusters)
+	{
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float totalArea = 0.0f;
+		for (uint32_t i = cluster.firstTriangle; i < cluster.firstTriangle + cluster.triangleCount; i++)
+		{
+			const glm::vec3& p0 = positions[indices[i * 3]];
+			const glm::vec3& p1 = positions[indices[i * 3 + 1]];
+			const glm::vec3& p2 = positions[indices[i * 3 + 2]];
+
+			glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+			float area = glm::length(areaNormal);
+			centroid += (p0 + p1 + p2) * (area / 3.0f);
+			normal += areaNormal;
+			totalArea += area;
+		}
+
+		if (totalArea > 0.0f)
+		{
+			centroid /= totalArea;
+		}
+
+		float normalLength = glm::length(normal);
+		cluster.sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const MeshOptimizerUtils::Cluster& a, const MeshOptimizerUtils::Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const MeshOptimizerUtils::Cluster& cluster : clusters)
+	{
+		output.insert(output.end(), indices.begin() + cluster.firstTriangle * 3, indices.begin() + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap)
+{
+	remap.assign(vertexCount, UINT32_MAX);
+
+	uint32_t nextVertex = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = nextVertex++;
+		}
+		index = remap[index];
+	}
+
+	for (uint32_t& newIndex : remap) // Keep vertices no triangle uses, just out of the way
+	{
+		if (newIndex == UINT32_MAX)
+		{
+			newIndex = nextVertex++;
+		}
+	}
+}
+
+float MeshOptimizer::Simplify(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float targetError, std::vector<uint32_t>& result)
+{
+	result = indices;
+
+	uint32_t vertexCount = (uint32_t)positions.size();
+	if (indices.empty() || vertexCount == 0)
+	{
+		return 0.0f;
+	}
+
+	// Lock vertices on open borders (holes would appear) and on attribute seams (vertices that were split because of UVs/normals would tear apart)
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<glm::vec3, uint32_t, MeshOptimizerUtils::PositionHash, MeshOptimizerUtils::PositionEqual> firstVertexAtPosition;
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			std::pair<std::unordered_map<glm::vec3, uint32_t, MeshOptimizerUtils::PositionHash, MeshOptimizerUtils::PositionEqual>::iterator, bool> inserted = firstVertexAtPosition.insert({ positions[i], i });
+			if (!inserted.second)
+			{
+				locked[i] = true;
+				locked[inserted.first->second] = true;
+			}
+		}
+
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				uint32_t a = indices[i + j];
+				uint32_t b = indices[i + (j + 1) % 3];
+				uint64_t edge = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+				edgeUses[edge]++;
+			}
+		}
+
+		for (const std::pair<const uint64_t, uint32_t>& edge : edgeUses)
+		{
+			if (edge.second == 1)
+			{
+				locked[(uint32_t)(edge.first >> 32)] = true;
+				locked[(uint32_t)(edge.first & 0xFFFFFFFF)] = true;
+			}
+		}
+	}
+
+	// Every vertex starts with the planes of the triangles around it. They're left unweighted so a quadric's value is a sum of squared distances, and staying under targetError^2 keeps every single one of them under targetError regardless of triangle size.
+	std::vector<MeshOptimizerUtils::Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const glm::vec3& p0 = positions[indices[i]];
+		const glm::vec3& p1 = positions[indices[i + 1]];
+		const glm::vec3& p2 = positions[indices[i + 2]];
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+		{
+			continue;
+		}
+
+		normal /= length;
+		float distance = -glm::dot(normal, p0);
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			quadrics[indices[i + j]].AddPlane(normal, distance, 1.0f);
+		}
+	}
+
+	double maxCost = (double)targetError * targetError;
+	double largestCost = 0.0; // Of the collapses done. A vertex's quadric only ever grows, so its last collapse is the one that counts, and every vertex's last collapse is in here.
+	std::vector<MeshOptimizerUtils::Collapse> collapses;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+
+	// Each pass collapses the cheapest edges that don't share any triangles, then rebuilds
+	const uint32_t maxPasses = 32;
+	for (uint32_t pass = 0; pass < maxPasses; pass++)
+	{
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				uint32_t from = result[i + j];
+				uint32_t to = result[i + (j + 1) % 3];
+				if (locked[from])
+				{
+					continue;
+				}
+
+				MeshOptimizerUtils::Quadric quadric = quadrics[from];
+				quadric.Add(quadrics[to]);
+				double cost = quadric.Evaluate(positions[to]);
+				if (cost <= maxCost)
+				{
+					collapses.push_back({ from, to, cost });
+				}
+			}
+		}
+
+		if (collapses.empty())
+		{
+			break;
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const MeshOptimizerUtils::Collapse& a, const MeshOptimizerUtils::Collapse& b) { return a.cost < b.cost; });
+
+		// Vertex -> triangle adjacency of the current triangles, for the flip test
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : result)
+		{
+			adjacencyOffsets[index + 1]++;
+		}
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t i = 0; i < result.size(); i++)
+			{
+				adjacency[fill[result[i]]++] = i / 3;
+			}
+		}
+
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			remap[i] = i;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		uint32_t collapseCount = 0;
+		for (const MeshOptimizerUtils::Collapse& collapse : collapses)
+		{
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			// Moving the vertex must not flip any of the triangles that survive the collapse
+			bool flips = false;
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; j++)
+			{
+				const uint32_t* triangle = &result[adjacency[j] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) // Degenerates and goes away
+				{
+					continue;
+				}
+
+				glm::vec3 oldPositions[3] = { positions[triangle[0]], positions[triangle[1]], positions[triangle[2]] };
+				glm::vec3 newPositions[3] = { oldPositions[0], oldPositions[1], oldPositions[2] };
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					if (triangle[k] == collapse.from)
+					{
+						newPositions[k] = positions[collapse.to];
+					}
+				}
+
+				glm::vec3 oldNormal = glm::cross(oldPositions[1] - oldPositions[0], oldPositions[2] - oldPositions[0]);
+				glm::vec3 newNormal = glm::cross(newPositions[1] - newPositions[0], newPositions[2] - newPositions[0]);
+				flips = glm::dot(oldNormal, newNormal) <= 0.25f * glm::length(oldNormal) * glm::length(newNormal); // Also rejects turning more than ~75 degrees
+			}
+
+			if (flips)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			largestCost = std::max(largestCost, collapse.cost);
+
+			// Everything around the collapsed vertex changed shape, leave it alone until the next pass
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+			{
+				const uint32_t* triangle = &result[adjacency[j] * 3];
+				touched[triangle[0]] = true;
+				touched[triangle[1]] = true;
+				touched[triangle[2]] = true;
+			}
+			touched[collapse.to] = true;
+			collapseCount++;
+		}
+
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t writeIndex = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+			if (a != b && b != c && a != c)
+			{
+				result[writeIndex++] = a;
+				result[writeIndex++] = b;
+				result[writeIndex++] = c;
+			}
+		}
+		result.resize(writeIndex);
+	}
+
+	return (float)std::sqrt(std::max(largestCost, 0.0));
+}
+
+VertexCacheStatistics MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStatistics statistics;
+	statistics.triangleCount = (uint32_t)indices.size() / 3;
+
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	uint32_t timestamp = cacheSize + 1;
+	for (uint32_t index : indices)
+	{
+		if (timestamp - cacheTimestamps[index] > cacheSize) // FIFO, hits don't refresh the entry
+		{
+			cacheTimestamps[index] = timestamp++;
+			statistics.misses++;
+		}
+
+		if (!used[index])
+		{
+			used[index] = true;
+			statistics.vertexCount++;
+		}
+	}
+
+	return statistics;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "pch.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+// Which steps of the post-import optimization pass to run. These are part of the mesh cache key.
+enum MeshOptimizerFlags : uint32_t
+{
+	MeshOptimizer_None = 0,
+	MeshOptimizer_VertexCache = 1 << 0, // Reorder triangles for post-transform vertex cache hits
+	MeshOptimizer_Overdraw = 1 << 1, // Reorder clusters of triangles so outward facing ones draw first
+	MeshOptimizer_VertexFetch = 1 << 2, // Reorder vertices into the order they are first used
+	MeshOptimizer_Default = MeshOptimizer_VertexCache | MeshOptimizer_VertexFetch
+};
+
+// Results of simulating a FIFO post-transform vertex cache over an index buffer
+struct VertexCacheStatistics
+{
+	uint32_t misses = 0;
+	uint32_t triangleCount = 0;
+	uint32_t vertexCount = 0;
+
+	// Average cache miss ratio, transformed vertices per triangle (0.5 is ideal for big grids, 3 is the worst)
+	inline float GetACMR() const { return this->triangleCount > 0 ? (float)this->misses / this->triangleCount : 0.0f; }
+
+	// Average transform to vertex ratio, transformed vertices per unique vertex (1 is ideal)
+	inline float GetATVR() const { return this->vertexCount > 0 ? (float)this->misses / this->vertexCount : 0.0f; }
+
+	inline void Add(const VertexCacheStatistics& other)
+	{
+		this->misses += other.misses;
+		this->triangleCount += other.triangleCount;
+		this->vertexCount += other.vertexCount;
+	}
+};
+
+// Triangle and vertex reordering that runs on a single submesh's indices (relative to the submesh's first vertex)
+class MeshOptimizer
+{
+public:
+	// Reorders triangles using Forsyth's linear-speed vertex cache optimization
+	static void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+	// Splits the cache optimized triangles into clusters and draws the most outward facing clusters first. 
+	// A cluster is only cut where it costs at most threshold times the current ACMR, so 1.05 gives up at most ~5% of the cache hits.
+	static void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float threshold = 1.05f);
+
+	// Reorders vertices into the order the index buffer first touches them and rewrites the indices to match.
+	// remap[oldVertex] gives the new position of every vertex, unused vertices are moved to the end.
+	static void OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap);
+
+	// Simplifies the triangles with quadric error edge collapses until the next collapse would move a vertex further than targetError (in model units) from the plane of any original triangle it replaced.
+	// Vertices are only ever collapsed onto other existing vertices, so the result still indexes the original vertex buffer. Border and seam vertices never move.
+	// Returns the largest such distance the result actually ended up with, which is at most targetError.
+	static float Simplify(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float targetError, std::vector<uint32_t>& result);
+
+	static VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+};
\ No newline at end of file
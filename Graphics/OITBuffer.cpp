@@ -0,0 +1,139 @@
+#include "OITBuffer.h"
+#include "GLState.h"
+
+namespace
+{
+	const std::vector<std::string> CompositeVertexSource = {
+		"#version 420",
+		"void main()",
+		"{",
+		"	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);", // One triangle covering the screen
+		"	gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);",
+		"}"
+	};
+
+	const std::vector<std::string> CompositeFragmentSource = {
+		"#version 420",
+		"layout(binding = " + std::to_string(OITBuffer::AccumulationUnit) + ") uniform sampler2D accumulation;",
+		"layout(binding = " + std::to_string(OITBuffer::RevealageUnit) + ") uniform sampler2D revealage;",
+		"out vec4 fragColor;",
+		"void main()",
+		"{",
+		"	ivec2 texel = ivec2(gl_FragCoord.xy);",
+		"	float reveal = texelFetch(revealage, texel, 0).r;",
+		"	if (reveal >= 1.0)", // Nothing transparent covers this pixel
+		"	{",
+		"		discard;",
+		"	}",
+		"	vec4 accum = texelFetch(accumulation, texel, 0);",
+		"	fragColor = vec4(accum.rgb / max(accum.a, 1e-5), 1.0 - reveal);",
+		"}"
+	};
+}
+
+OITBuffer::OITBuffer()
+	: framebuffer(0), accumulationTexture(0), revealageTexture(0), depthRenderbuffer(0), emptyVertexArray(0), width(0), height(0)
+{
+	this->compositeShader = CreateRef<Shader>("OITComposite", CompositeVertexSource, CompositeFragmentSource);
+	glCreateVertexArrays(1, &this->emptyVertexArray);
+}
+
+OITBuffer::~OITBuffer()
+{
+	Destroy();
+	GLState::ForgetVertexArray(this->emptyVertexArray);
+	glDeleteVertexArrays(1, &this->emptyVertexArray);
+}
+
+void OITBuffer::Begin(uint32_t width, uint32_t height)
+{
+	if (width != this->width || height != this->height)
+	{
+		Destroy();
+		Create(width, height);
+	}
+
+	glBlitNamedFramebuffer(0, this->framebuffer, 0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+
+	const float clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const float clearRevealage[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	glClearNamedFramebufferfv(this->framebuffer, GL_COLOR, 0, clearAccumulation);
+	glClearNamedFramebufferfv(this->framebuffer, GL_COLOR, 1, clearRevealage);
+
+	GLState::SetDepthTest(true);
+	GLState::SetDepthMask(false); // Every layer has to land in the targets, not just the nearest
+	GLState::SetBlend(true);
+	GLState::SetBlendFunci(0, GL_ONE, GL_ONE);
+	GLState::SetBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void OITBuffer::Composite()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GLState::SetDepthMask(true);
+	GLState::SetDepthTest(false);
+	GLState::SetBlend(true);
+	GLState::SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::SetPolygonMode(GL_FILL);
+
+	this->compositeShader->Bind();
+	GLState::BindTextureUnit(AccumulationUnit, this->accumulationTexture);
+	GLState::BindTextureUnit(RevealageUnit, this->revealageTexture);
+	GLState::BindVertexArray(this->emptyVertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	GLState::SetDepthTest(true);
+}
+
+void OITBuffer::Create(uint32_t width, uint32_t height)
+{
+	this->width = width;
+	this->height = height;
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &this->accumulationTexture);
+	glTextureStorage2D(this->accumulationTexture, 1, GL_RGBA16F, width, height); // Half floats so the weighted sums don't saturate
+	glTextureParameteri(this->accumulationTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(this->accumulationTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &this->revealageTexture);
+	glTextureStorage2D(this->revealageTexture, 1, GL_R16F, width, height);
+	glTextureParameteri(this->revealageTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(this->revealageTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glCreateRenderbuffers(1, &this->depthRenderbuffer);
+	glNamedRenderbufferStorage(this->depthRenderbuffer, GL_DEPTH24_STENCIL8, width, height); // Has to match the default framebuffer for the depth copy
+
+	glCreateFramebuffers(1, &this->framebuffer);
+	glNamedFramebufferTexture(this->framebuffer, GL_COLOR_ATTACHMENT0, this->accumulationTexture, 0);
+	glNamedFramebufferTexture(this->framebuffer, GL_COLOR_ATTACHMENT1, this->revealageTexture, 0);
+	glNamedFramebufferRenderbuffer(this->framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthRenderbuffer);
+
+	const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glNamedFramebufferDrawBuffers(this->framebuffer, 2, drawBuffers);
+
+	if (glCheckNamedFramebufferStatus(this->framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "OIT framebuffer is incomplete!" << std::endl;
+	}
+}
+
+void OITBuffer::Destroy()
+{
+	if (!this->framebuffer)
+	{
+		return;
+	}
+
+	GLState::ForgetTexture(this->accumulationTexture);
+	GLState::ForgetTexture(this->revealageTexture);
+	glDeleteFramebuffers(1, &this->framebuffer);
+	glDeleteTextures(1, &this->accumulationTexture);
+	glDeleteTextures(1, &this->revealageTexture);
+	glDeleteRenderbuffers(1, &this->depthRenderbuffer);
+
+	this->framebuffer = 0;
+	this->width = 0;
+	this->height = 0;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "pch.h"
+#include "Shader.h"
+#include "GLCommon.h"
+
+// Render targets and composite pass of weighted blended order independent transparency (McGuire and Bavoil 2013).
+// Transparent surfaces add their premultiplied color, weighted by depth and alpha, into an accumulation target and multiply their (1 - alpha) into a revealage target.
+// Compositing divides the accumulated color by its accumulated alpha and blends it over the opaque image by 1 - revealage, so the order transparent meshes are drawn in doesn't matter.
+// While "isWeightedBlended" is set the main fragment shader writes both targets instead of its usual output:
+// layout(location = 0) out vec4 accumulation = vec4(color.rgb * color.a, color.a) * weight; layout(location = 1) out float revealage = color.a;
+// weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3)
+class OITBuffer
+{
+public:
+	OITBuffer();
+	virtual ~OITBuffer();
+
+	// Redirects drawing into the targets (recreated if the window changed size), clears them and sets up blending with depth writes off.
+	// The default framebuffer's depth is copied in first so opaque geometry still hides transparent surfaces behind it. That copy needs the default framebuffer to be single sampled 24 bit depth with 8 bit stencil, which is what GLFW creates unless told otherwise.
+	void Begin(uint32_t width, uint32_t height);
+
+	// Goes back to the default framebuffer and blends the transparent layer over it
+	void Composite();
+
+	// Texture units the composite pass reads from. The main shader's textures use 0-7, 20, 21 and 37, and the environment map takes 40.
+	static const GLuint AccumulationUnit = 42;
+	static const GLuint RevealageUnit = 43;
+
+private:
+	void Create(uint32_t width, uint32_t height);
+	void Destroy();
+
+	GLuint framebuffer;
+	GLuint accumulationTexture; // RGBA16F
+	GLuint revealageTexture; // R16F
+	GLuint depthRenderbuffer;
+	GLuint emptyVertexArray; // The composite triangle is made up in the vertex shader, but core profiles still need a VAO bound to draw
+
+	uint32_t width;
+	uint32_t height;
+
+	Ref<Shader> compositeShader;
+};
\ No newline at end of file
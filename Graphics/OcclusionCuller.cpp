@@ -0,0 +1,329 @@
+#include "OcclusionCuller.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace
+{
+	// In front of the near plane, where GL would clip it
+	bool IsBeforeNearPlane(const glm::vec4& clip)
+	{
+		return clip.z < -clip.w || clip.w < 1e-4f;
+	}
+}
+
+OcclusionCuller::OcclusionCuller()
+	: depthBuffer(Width * Height, 1.0f), viewProjection(1.0f), occluderError(0.0f), occludedCount(0)
+{
+
+}
+
+void OcclusionCuller::Begin(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	this->occluders.clear();
+	this->triangles.clear();
+	for (std::vector<uint32_t>& bin : this->tileBins)
+	{
+		bin.clear();
+	}
+	std::fill(this->depthBuffer.begin(), this->depthBuffer.end(), 1.0f);
+	this->occluderError = 0.0f;
+
+	std::unordered_map<const Mesh*, OccluderModel>::iterator it = this->models.begin();
+	while (it != this->models.end())
+	{
+		it = it->second.mesh.expired() ? this->models.erase(it) : std::next(it);
+	}
+	this->occludedCount = 0;
+}
+
+void OcclusionCuller::AddOccluder(Ref<Mesh> mesh, const glm::mat4& transform)
+{
+	const OccluderModel& model = GetOccluderModel(mesh);
+	if (!model.indices.empty())
+	{
+		this->occluders.push_back({ &model, transform });
+
+		float maxScale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		this->occluderError = std::max(this->occluderError, model.error * maxScale);
+	}
+}
+
+void OcclusionCuller::Rasterize()
+{
+	// Clip space with SSE, one vertex per register: column0 * x + column1 * y + column2 * z + column3
+	for (const Occluder& occluder : this->occluders)
+	{
+		glm::mat4 modelViewProjection = this->viewProjection * occluder.transform;
+		__m128 columns[4];
+		for (int i = 0; i < 4; i++)
+		{
+			columns[i] = _mm_loadu_ps(&modelViewProjection[i][0]);
+		}
+
+		const std::vector<glm::vec3>& positions = occluder.model->positions;
+		this->clipPositions.resize(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			__m128 clip = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(positions[i].x)), _mm_mul_ps(columns[1], _mm_set1_ps(positions[i].y))),
+				_mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(positions[i].z)), columns[3]));
+			_mm_storeu_ps(&this->clipPositions[i][0], clip);
+		}
+
+		const std::vector<uint32_t>& indices = occluder.model->indices;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const glm::vec4* clip[3] = { &this->clipPositions[indices[i]], &this->clipPositions[indices[i + 1]], &this->clipPositions[indices[i + 2]] };
+			if (IsBeforeNearPlane(*clip[0]) || IsBeforeNearPlane(*clip[1]) || IsBeforeNearPlane(*clip[2])) // Not clipped, dropping it only means less gets occluded
+			{
+				continue;
+			}
+
+			ScreenTriangle triangle;
+			glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+			for (int v = 0; v < 3; v++)
+			{
+				float inverseW = 1.0f / clip[v]->w;
+				triangle.vertices[v] = glm::vec3((clip[v]->x * inverseW * 0.5f + 0.5f) * Width, (clip[v]->y * inverseW * 0.5f + 0.5f) * Height, clip[v]->z * inverseW);
+				screenMin = glm::vec2(std::min(screenMin.x, triangle.vertices[v].x), std::min(screenMin.y, triangle.vertices[v].y));
+				screenMax = glm::vec2(std::max(screenMax.x, triangle.vertices[v].x), std::max(screenMax.y, triangle.vertices[v].y));
+			}
+
+			if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= Width || screenMin.y >= Height)
+			{
+				continue;
+			}
+
+			// Bin into every tile the screen bounds touch
+			uint32_t triangleIndex = (uint32_t)this->triangles.size();
+			this->triangles.push_back(triangle);
+			int tileMinX = std::max((int)screenMin.x / (int)TileWidth, 0);
+			int tileMinY = std::max((int)screenMin.y / (int)TileHeight, 0);
+			int tileMaxX = std::min((int)screenMax.x / (int)TileWidth, (int)TilesX - 1);
+			int tileMaxY = std::min((int)screenMax.y / (int)TileHeight, (int)TilesY - 1);
+			for (int tileY = tileMinY; tileY <= tileMaxY; tileY++)
+			{
+				for (int tileX = tileMinX; tileX <= tileMaxX; tileX++)
+				{
+					this->tileBins[tileY * TilesX + tileX].push_back(triangleIndex);
+				}
+			}
+		}
+	}
+
+	if (this->triangles.empty())
+	{
+		return;
+	}
+
+	// Tiles don't share pixels, so each one can go to its own worker. The calling thread takes the last one.
+	std::vector<std::future<void>> futures;
+	for (uint32_t tile = 0; tile + 1 < TilesX * TilesY; tile++)
+	{
+		if (!this->tileBins[tile].empty())
+		{
+			futures.push_back(ThreadPool::Get().Submit([this, tile]() { RasterizeTile(tile); }));
+		}
+	}
+
+	RasterizeTile(TilesX * TilesY - 1);
+	for (std::future<void>& future : futures)
+	{
+		future.get();
+	}
+}
+
+bool OcclusionCuller::IsOccluded(const AABB& worldBounds)
+{
+	glm::vec3 boundsMin = worldBounds.min - glm::vec3(this->occluderError);
+	glm::vec3 boundsMax = worldBounds.max + glm::vec3(this->occluderError);
+
+	glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+	float nearestDepth = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = this->viewProjection * glm::vec4(corner, 1.0f);
+		if (IsBeforeNearPlane(clip))
+		{
+			return false;
+		}
+
+		float inverseW = 1.0f / clip.w;
+		glm::vec2 screen((clip.x * inverseW * 0.5f + 0.5f) * Width, (clip.y * inverseW * 0.5f + 0.5f) * Height);
+		screenMin = glm::vec2(std::min(screenMin.x, screen.x), std::min(screenMin.y, screen.y));
+		screenMax = glm::vec2(std::max(screenMax.x, screen.x), std::max(screenMax.y, screen.y));
+		nearestDepth = std::min(nearestDepth, clip.z * inverseW);
+	}
+
+	// Every pixel the box's screen rectangle touches, even partly
+	int minX = std::max((int)std::floor(screenMin.x), 0);
+	int minY = std::max((int)std::floor(screenMin.y), 0);
+	int maxX = std::min((int)std::ceil(screenMax.x) - 1, (int)Width - 1);
+	int maxY = std::min((int)std::ceil(screenMax.y) - 1, (int)Height - 1);
+	if (minX > maxX || minY > maxY) // Off screen, that's for frustum culling to decide
+	{
+		return false;
+	}
+
+	__m128 nearest = _mm_set1_ps(nearestDepth);
+	__m128 laneX = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 first = _mm_set1_ps((float)minX - 0.5f);
+	__m128 last = _mm_set1_ps((float)maxX + 0.5f);
+	for (int y = minY; y <= maxY; y++)
+	{
+		const float* row = &this->depthBuffer[y * Width];
+		for (int x = minX & ~3; x <= maxX; x += 4) // Whole groups of four, lanes outside the rectangle are masked off
+		{
+			__m128 lanes = _mm_add_ps(_mm_set1_ps((float)x), laneX);
+			__m128 inside = _mm_and_ps(_mm_cmpgt_ps(lanes, first), _mm_cmplt_ps(lanes, last));
+			__m128 behind = _mm_cmpge_ps(_mm_loadu_ps(row + x), nearest); // Nothing in front of the box here
+			if (_mm_movemask_ps(_mm_and_ps(inside, behind)) != 0)
+			{
+				return false;
+			}
+		}
+	}
+
+	this->occludedCount++;
+	return true;
+}
+
+const OcclusionCuller::OccluderModel& OcclusionCuller::GetOccluderModel(const Ref<Mesh>& mesh)
+{
+	std::unordered_map<const Mesh*, OccluderModel>::iterator it = this->models.find(mesh.get());
+	if (it != this->models.end() && !it->second.mesh.expired())
+	{
+		return it->second;
+	}
+
+	OccluderModel& model = this->models[mesh.get()]; // Either new, or left over from a mesh that used to live at this address and rebuilt in place
+	model.mesh = mesh;
+	model.positions.clear();
+	model.indices.clear();
+	model.error = 0.0f;
+
+	bool keepCPUGeometry = mesh->IsKeepingCPUGeometry();
+	const std::vector<Vertex>& vertices = mesh->GetVertices();
+	const std::vector<Face>& faces = mesh->GetFaces();
+	const uint32_t* faceIndices = faces.empty() ? nullptr : (const uint32_t*)faces.data();
+
+	float targetError = glm::length(mesh->GetBoundingBox().max - mesh->GetBoundingBox().min) * OccluderSimplification;
+	for (const Submesh& submesh : mesh->GetSubmeshes())
+	{
+		if (!faceIndices || submesh.indexCount == 0)
+		{
+			continue;
+		}
+
+		std::vector<glm::vec3> positions(submesh.vertexCount);
+		for (uint32_t i = 0; i < submesh.vertexCount; i++)
+		{
+			positions[i] = glm::vec3(submesh.transform * glm::vec4(vertices[submesh.baseVertex + i].position, 1.0f));
+		}
+
+		std::vector<uint32_t> indices(submesh.indexCount);
+		for (uint32_t i = 0; i < submesh.indexCount; i++)
+		{
+			indices[i] = faceIndices[submesh.baseIndex + i] - submesh.baseVertex;
+		}
+
+		// Simplification only collapses onto existing vertices and never moves borders, so the occluder stays inside the mesh's bounds and keeps its holes.
+		// It can still bulge out of the real surface by up to the error it reports, which IsOccluded() makes up for.
+		std::vector<uint32_t> simplified;
+		model.error = std::max(model.error, MeshOptimizer::Simplify(indices, positions, targetError, simplified));
+
+		uint32_t baseVertex = (uint32_t)model.positions.size();
+		model.positions.insert(model.positions.end(), positions.begin(), positions.end());
+		for (uint32_t index : simplified)
+		{
+			model.indices.push_back(index + baseVertex);
+		}
+	}
+
+	if (!keepCPUGeometry) // Only needed it to build the occluder
+	{
+		mesh->SetKeepCPUGeometry(false);
+	}
+	return model;
+}
+
+void OcclusionCuller::RasterizeTile(uint32_t tile)
+{
+	int tileX = (int)(tile % TilesX) * TileWidth;
+	int tileY = (int)(tile / TilesX) * TileHeight;
+	__m128 laneX = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f); // Pixel centers
+
+	for (uint32_t triangleIndex : this->tileBins[tile])
+	{
+		const ScreenTriangle& triangle = this->triangles[triangleIndex];
+		glm::vec3 v0 = triangle.vertices[0], v1 = triangle.vertices[1], v2 = triangle.vertices[2];
+
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (std::abs(area) < 1e-6f)
+		{
+			continue;
+		}
+		if (area < 0.0f) // Both faces occlude, flip so the edge functions are positive inside
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		// Edge functions e = a * x + b * y + c, one per edge, and depth as a plane over the screen
+		float a[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+		float b[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+		float c[3] = { v1.x * v2.y - v2.x * v1.y, v2.x * v0.y - v0.x * v2.y, v0.x * v1.y - v1.x * v0.y };
+		float depthA = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) / area;
+		float depthB = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) / area;
+		float depthC = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) / area;
+
+		int minX = std::max((int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))), tileX) & ~3;
+		int minY = std::max((int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))), tileY);
+		int maxX = std::min((int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))), tileX + (int)TileWidth - 1);
+		int maxY = std::min((int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))), tileY + (int)TileHeight - 1);
+
+		__m128 edgeA[3], edgeB[3], edgeC[3];
+		for (int i = 0; i < 3; i++)
+		{
+			edgeA[i] = _mm_set1_ps(a[i]);
+			edgeB[i] = _mm_set1_ps(b[i]);
+			edgeC[i] = _mm_set1_ps(c[i]);
+		}
+		__m128 depthPlaneA = _mm_set1_ps(depthA);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			__m128 centerY = _mm_set1_ps(y + 0.5f);
+			__m128 rowEdge[3];
+			for (int i = 0; i < 3; i++)
+			{
+				rowEdge[i] = _mm_add_ps(_mm_mul_ps(edgeB[i], centerY), edgeC[i]);
+			}
+			__m128 rowDepth = _mm_set1_ps(depthB * (y + 0.5f) + depthC);
+
+			float* row = &this->depthBuffer[y * Width];
+			for (int x = minX; x <= maxX; x += 4) // minX is a multiple of 4 and so is the tile width, so this never leaves the tile
+			{
+				__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneX);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], centerX), rowEdge[0]), _mm_setzero_ps());
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], centerX), rowEdge[1]), _mm_setzero_ps()));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], centerX), rowEdge[2]), _mm_setzero_ps()));
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				__m128 depth = _mm_add_ps(_mm_mul_ps(depthPlaneA, centerX), rowDepth);
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(current, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+}
\ No newline at end of file
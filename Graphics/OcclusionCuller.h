@@ -0,0 +1,85 @@
+#pragma once
+
+#include "pch.h"
+#include "Mesh.h"
+#include "AABB.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+
+// Software occlusion culling. Occluders (walls, floors) are rasterized into a small depth buffer on the CPU and other meshes' bounds are tested against it.
+// Vertices are transformed and pixels shaded four at a time with SSE, and the screen is split into tiles that are rasterized in parallel on the thread pool.
+// Doesn't touch GL at all.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	// Clears the depth buffer and the occluders of the last frame
+	void Begin(const glm::mat4& viewProjection);
+
+	// The mesh's geometry is simplified and cached the first time it's used as an occluder. Its surface has to be opaque and undisplaced.
+	void AddOccluder(Ref<Mesh> mesh, const glm::mat4& transform);
+
+	// Transforms, bins and rasterizes everything added since Begin()
+	void Rasterize();
+
+	// Whether every pixel the box covers already has an occluder in front of the box's nearest point. Boxes crossing the near plane are never occluded.
+	// The box is grown by the simplification error of this frame's occluders first, so a simplified occluder sticking out past the real surface can't hide anything the real one wouldn't.
+	bool IsOccluded(const AABB& worldBounds);
+
+	inline uint32_t GetOccluderCount() const { return (uint32_t)this->occluders.size(); }
+	inline uint32_t GetOccluderTriangleCount() const { return (uint32_t)this->triangles.size(); }
+	inline uint32_t GetOccludedCount() const { return this->occludedCount; }
+
+	// Row major from the bottom of the screen, NDC depth (-1 near, 1 far and nothing drawn)
+	inline const std::vector<float>& GetDepthBuffer() const { return this->depthBuffer; }
+
+	static const uint32_t Width = 256;
+	static const uint32_t Height = 128;
+	static const uint32_t TileWidth = 64; // A multiple of 4 so rows of a tile split evenly into SSE lanes
+	static const uint32_t TileHeight = 32;
+	static const uint32_t TilesX = Width / TileWidth;
+	static const uint32_t TilesY = Height / TileHeight;
+
+	static constexpr float OccluderSimplification = 0.01f; // Error target occluders are simplified to, relative to their bounding box diagonal
+
+private:
+	struct OccluderModel
+	{
+		std::weak_ptr<Mesh> mesh; // Doesn't keep the mesh alive. Once it expires the entry is stale, and a new mesh may have taken over its address.
+		std::vector<glm::vec3> positions; // Submesh transforms already applied
+		std::vector<uint32_t> indices;
+		float error; // How far the simplified surface can be from the real one, in model units
+	};
+
+	struct Occluder
+	{
+		const OccluderModel* model;
+		glm::mat4 transform;
+	};
+
+	// Screen space, x and y in pixels
+	struct ScreenTriangle
+	{
+		glm::vec3 vertices[3];
+	};
+
+	const OccluderModel& GetOccluderModel(const Ref<Mesh>& mesh);
+
+	void RasterizeTile(uint32_t tile);
+
+	std::unordered_map<const Mesh*, OccluderModel> models; // Entries whose mesh is gone are dropped in Begin()
+	std::vector<Occluder> occluders;
+	std::vector<ScreenTriangle> triangles;
+	std::vector<uint32_t> tileBins[TilesX * TilesY]; // Indices into triangles
+
+	std::vector<glm::vec4> clipPositions; // Scratch for the occluder being transformed
+	std::vector<float> depthBuffer;
+	glm::mat4 viewProjection;
+	float occluderError; // Largest simplification error of the occluders added since Begin(), in world units
+
+	uint32_t occludedCount;
+};
\ No newline at end of file
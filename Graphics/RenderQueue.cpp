@@ -0,0 +1,306 @@
+#include "RenderQueue.h"
+#include "GLState.h"
+
+#include <algorithm>
+
+RenderQueue::RenderQueue()
+	: cameraPosition(0.0f), farPlane(1.0f), transparentCount(0), weightedBlended(false)
+{
+
+}
+
+void RenderQueue::Begin(const glm::vec3& cameraPosition, float farPlane)
+{
+	Clear();
+	this->cameraPosition = cameraPosition;
+	this->farPlane = farPlane;
+	this->weightedBlended = Renderer::GetTransparencyMode() == TransparencyMode::WeightedBlended;
+}
+
+void RenderQueue::Submit(Ref<Shader> shader, Ref<Mesh> mesh, const std::vector<Ref<SceneTextureData>>& textures, const glm::mat4& transform, const glm::mat3& normalMatrix, float alphaTransparency, bool transparent, uint32_t lod, const ObjectLights& lights)
+{
+	DrawPacket packet;
+	packet.shader = shader;
+	packet.mesh = mesh;
+	packet.textures = &textures;
+	packet.textureSet = GetTextureSetID(textures);
+	packet.lod = lod;
+	packet.transparent = transparent;
+	packet.transform = transform;
+	packet.normalMatrix = normalMatrix;
+	packet.alphaTransparency = alphaTransparency;
+	packet.lights = lights;
+
+	uint64_t key;
+	if (!transparent || this->weightedBlended)
+	{
+		uint64_t shaderID = GetShaderID(shader) & 0x3F;
+		uint64_t textureSetID = packet.textureSet;
+		uint64_t meshID = GetMeshID(mesh.get());
+		key = ((uint64_t)transparent << 62) | (shaderID << 56) | ((textureSetID & 0xFFFF) << 40) | ((meshID & 0xFFFF) << 24) | ((uint64_t)(lod & 0x3) << 22);
+		if (!transparent)
+		{
+			double depth = std::min(std::max(glm::length(glm::vec3(transform[3]) - this->cameraPosition) / this->farPlane, 0.0f), 1.0f);
+			key |= (uint64_t)(depth * 0x3FFFFF);
+		}
+	}
+	else // Transparent packets come after every opaque one in the order they came in. Neighbours with the same state still share a draw.
+	{
+		key = (1ull << 62) | this->transparentCount++;
+	}
+
+	this->sortItems.push_back({ key, (uint32_t)this->packets.size() });
+	this->packets.push_back(std::move(packet));
+}
+
+void RenderQueue::Flush(bool debugMode)
+{
+	if (this->packets.empty())
+	{
+		return;
+	}
+
+	RadixSort(this->sortItems, this->sortScratch);
+
+	if (debugMode) // Draw one by one so every packet gets its bounding box drawn
+	{
+		for (const SortItem& item : this->sortItems)
+		{
+			const DrawPacket& packet = this->packets[item.index];
+			GLState::SetBlend(packet.transparent);
+			if (packet.transparent)
+			{
+				GLState::SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			}
+
+			Renderer::RenderMeshWithTextures(packet.shader, packet.mesh, *packet.textures, packet.transform, packet.alphaTransparency, true, packet.lod);
+		}
+
+		Clear();
+		return;
+	}
+
+	// Lay the instance data out in draw order so every run reads a contiguous slice of it
+	this->instances.clear();
+	this->instances.reserve(this->sortItems.size());
+	for (const SortItem& item : this->sortItems)
+	{
+		const DrawPacket& packet = this->packets[item.index];
+		this->instances.push_back(Renderer::CreateInstanceData(packet.transform, packet.normalMatrix, packet.alphaTransparency, packet.lights));
+	}
+	Renderer::UploadInstances(this->instances);
+
+	GLState::SetPolygonMode(GL_FILL);
+
+	this->batches.clear();
+	if (Renderer::IsMultiDrawIndirect())
+	{
+		DrawIndirect();
+	}
+	else
+	{
+		DrawRuns();
+	}
+
+	if (this->blendedShader)
+	{
+		Renderer::EndWeightedBlended(this->blendedShader);
+		this->blendedShader = nullptr;
+	}
+
+	Clear();
+}
+
+void RenderQueue::DrawRuns()
+{
+	size_t runStart = 0;
+	while (runStart < this->sortItems.size())
+	{
+		const DrawPacket& packet = this->packets[this->sortItems[runStart].index];
+		size_t runEnd = GetRunEnd(runStart);
+
+		BindState(packet);
+		Renderer::DrawMeshInstanced(packet.shader, packet.mesh, packet.lod, (uint32_t)runStart, (uint32_t)(runEnd - runStart));
+		runStart = runEnd;
+	}
+}
+
+void RenderQueue::DrawIndirect()
+{
+	// Build every command up front so they go to the GPU in one upload. Commands keep the sorted order, which transparent packets rely on.
+	this->commands.clear();
+	this->draws.clear();
+
+	size_t runStart = 0;
+	while (runStart < this->sortItems.size())
+	{
+		uint32_t packetIndex = this->sortItems[runStart].index;
+		const DrawPacket& packet = this->packets[packetIndex];
+		size_t runEnd = GetRunEnd(runStart);
+
+		if (this->batches.empty() || !HasSameBatchState(this->packets[this->batches.back().packet], packet))
+		{
+			this->batches.push_back({ packetIndex, (uint32_t)this->commands.size(), 0 });
+		}
+
+		Renderer::AppendIndirectDraws(packet.mesh, packet.lod, (uint32_t)runStart, (uint32_t)(runEnd - runStart), this->commands, this->draws);
+		this->batches.back().commandCount = (uint32_t)this->commands.size() - this->batches.back().firstCommand;
+		runStart = runEnd;
+	}
+
+	Renderer::UploadIndirectDraws(this->commands, this->draws);
+
+	for (const IndirectBatch& batch : this->batches)
+	{
+		const DrawPacket& packet = this->packets[batch.packet];
+		BindState(packet);
+		Renderer::MultiDrawIndirect(packet.shader, packet.mesh, batch.firstCommand, batch.commandCount);
+	}
+}
+
+size_t RenderQueue::GetRunEnd(size_t runStart) const
+{
+	const DrawPacket& packet = this->packets[this->sortItems[runStart].index];
+
+	size_t runEnd = runStart + 1;
+	while (runEnd < this->sortItems.size() && HasSameState(packet, this->packets[this->sortItems[runEnd].index]))
+	{
+		runEnd++;
+	}
+	return runEnd;
+}
+
+void RenderQueue::BindState(const DrawPacket& packet)
+{
+	// Redundant changes between runs are dropped by GLState and BindTextures()
+	if (packet.transparent && this->weightedBlended)
+	{
+		if (!this->blendedShader) // Opaque packets all come first, so everything from here on is drawn into the OIT targets
+		{
+			Renderer::BeginWeightedBlended(packet.shader);
+			this->blendedShader = packet.shader;
+		}
+		packet.shader->Bind();
+	}
+	else
+	{
+		packet.shader->Bind();
+		GLState::SetBlend(packet.transparent);
+		if (packet.transparent)
+		{
+			GLState::SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		}
+	}
+	Renderer::BindTextures(*packet.textures);
+}
+
+uint32_t RenderQueue::GetShaderID(const Ref<Shader>& shader)
+{
+	std::unordered_map<GLuint, uint32_t>::iterator it = this->shaderIDs.find(shader->GetID());
+	if (it != this->shaderIDs.end())
+	{
+		return it->second;
+	}
+
+	uint32_t id = (uint32_t)this->shaderIDs.size();
+	this->shaderIDs.insert({ shader->GetID(), id });
+	return id;
+}
+
+uint32_t RenderQueue::GetTextureSetID(const std::vector<Ref<SceneTextureData>>& textures)
+{
+	// Two meshes with their own texture data can still end up with the same set, so go by what actually gets bound
+	this->textureSetKey.clear();
+	for (const Ref<SceneTextureData>& textureData : textures)
+	{
+		this->textureSetKey.push_back(std::make_tuple(textureData->texture.get(), textureData->ratio, textureData->texCoordScale));
+	}
+
+	std::map<TextureSetKey, uint32_t>::iterator it = this->textureSetIDs.find(this->textureSetKey);
+	if (it != this->textureSetIDs.end())
+	{
+		return it->second;
+	}
+
+	uint32_t id = (uint32_t)this->textureSetIDs.size();
+	this->textureSetIDs.insert({ this->textureSetKey, id });
+	return id;
+}
+
+uint32_t RenderQueue::GetMeshID(const Mesh* mesh)
+{
+	std::unordered_map<const Mesh*, uint32_t>::iterator it = this->meshIDs.find(mesh);
+	if (it != this->meshIDs.end())
+	{
+		return it->second;
+	}
+
+	uint32_t id = (uint32_t)this->meshIDs.size();
+	this->meshIDs.insert({ mesh, id });
+	return id;
+}
+
+bool RenderQueue::HasSameState(const DrawPacket& a, const DrawPacket& b)
+{
+	return a.transparent == b.transparent
+		&& a.shader == b.shader
+		&& a.textureSet == b.textureSet
+		&& a.mesh == b.mesh
+		&& a.lod == b.lod;
+}
+
+bool RenderQueue::HasSameBatchState(const DrawPacket& a, const DrawPacket& b)
+{
+	return a.transparent == b.transparent
+		&& a.shader == b.shader
+		&& a.textureSet == b.textureSet
+		&& a.mesh->GetGeometry()->GetArena() == b.mesh->GetGeometry()->GetArena();
+}
+
+void RenderQueue::RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch)
+{
+	if (items.empty())
+	{
+		return;
+	}
+
+	scratch.resize(items.size());
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t counts[256] = {};
+		for (const SortItem& item : items)
+		{
+			counts[(item.key >> shift) & 0xFF]++;
+		}
+
+		if (counts[(items[0].key >> shift) & 0xFF] == items.size()) // Nothing would move
+		{
+			continue;
+		}
+
+		uint32_t offsets[256];
+		uint32_t total = 0;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			offsets[i] = total;
+			total += counts[i];
+		}
+
+		for (const SortItem& item : items)
+		{
+			scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+		}
+
+		items.swap(scratch);
+	}
+}
+
+void RenderQueue::Clear()
+{
+	this->packets.clear();
+	this->sortItems.clear();
+	this->transparentCount = 0;
+	this->shaderIDs.clear();
+	this->textureSetIDs.clear();
+	this->meshIDs.clear();
+}
\ No newline at end of file
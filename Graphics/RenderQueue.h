@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Renderer.h"
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+// Collects the meshes drawn in a frame as packets with a 64 bit sort key, radix sorts the keys and draws the packets in that order.
+// Opaque:      pass (2) | shader (6) | texture set (16) | mesh (16) | LOD (2) | depth (22)      -> packets sharing state end up next to each other, nearest first
+// Transparent: pass (2) | submission order (62)                                                -> drawn as submitted, the caller orders them back to front
+// With TransparencyMode::WeightedBlended transparent packets don't need an order, so they get the opaque layout minus the depth and batch the same way.
+// Runs of packets with the same state are drawn with a single instanced draw call.
+// With Renderer::IsMultiDrawIndirect() every run becomes a command per submesh instead, and consecutive runs that share a shader, textures and arena go out in one glMultiDrawElementsIndirect call.
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	// Starts a new frame. Depths are measured from the camera position and normalized by the far plane.
+	void Begin(const glm::vec3& cameraPosition, float farPlane);
+
+	// Everything submitted gets drawn, culling is up to the caller. The textures have to stay alive until Flush().
+	// The normal matrix is transpose(inverse(mat3(transform))), passed in so callers that cache it don't pay for the inverse every frame.
+	// The lights only matter while Renderer::IsPerObjectLights(). They go in the instance data, so packets with different lights still share a draw.
+	void Submit(Ref<Shader> shader, Ref<Mesh> mesh, const std::vector<Ref<SceneTextureData>>& textures, const glm::mat4& transform, const glm::mat3& normalMatrix, float alphaTransparency, bool transparent, uint32_t lod = 0, const ObjectLights& lights = ObjectLights());
+
+	// Sorts and draws everything submitted since Begin(). Debug mode draws each packet on its own so it gets its bounding box and wireframe, and blends transparent ones directly.
+	void Flush(bool debugMode = false);
+
+	inline size_t GetPacketCount() const { return this->packets.size(); }
+
+	struct SortItem
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// LSD radix sort on the keys, 8 bits per pass. Passes where every key has the same byte are skipped, so small keys only pay for the bytes they use.
+	static void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+	// How many glMultiDrawElementsIndirect calls the last Flush() took, 0 if it didn't use them
+	inline size_t GetIndirectBatchCount() const { return this->batches.size(); }
+
+private:
+	struct DrawPacket
+	{
+		Ref<Shader> shader;
+		Ref<Mesh> mesh;
+		const std::vector<Ref<SceneTextureData>>* textures;
+		uint32_t textureSet;
+		uint32_t lod;
+		bool transparent;
+		glm::mat4 transform;
+		glm::mat3 normalMatrix;
+		float alphaTransparency;
+		ObjectLights lights;
+	};
+
+	// Commands that can go out in one indirect call
+	struct IndirectBatch
+	{
+		uint32_t packet; // The first run's packet, whose state the batch is drawn with
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	typedef std::vector<std::tuple<const Texture*, float, float>> TextureSetKey;
+
+	// Small per frame ids so the state fits in the key. The full ids are still compared when forming runs, so a wrapped id only costs sort quality.
+	uint32_t GetShaderID(const Ref<Shader>& shader);
+	uint32_t GetTextureSetID(const std::vector<Ref<SceneTextureData>>& textures);
+	uint32_t GetMeshID(const Mesh* mesh);
+
+	// Whether two packets can share an instanced draw call
+	static bool HasSameState(const DrawPacket& a, const DrawPacket& b);
+
+	// Whether two runs can share an indirect call. Their meshes can differ as long as they're in the same arena.
+	static bool HasSameBatchState(const DrawPacket& a, const DrawPacket& b);
+
+	// Where the run starting at runStart ends
+	size_t GetRunEnd(size_t runStart) const;
+
+	// Shader, blending and textures, the draw calls set up the rest. The first weighted blended packet switches over to the OIT targets.
+	void BindState(const DrawPacket& packet);
+
+	// Draws the sorted packets, the instance data has to be uploaded already
+	void DrawRuns();
+	void DrawIndirect();
+
+	void Clear();
+
+	std::vector<DrawPacket> packets;
+	std::vector<SortItem> sortItems;
+	std::vector<SortItem> sortScratch;
+	std::vector<InstanceData> instances;
+	std::vector<DrawCommand> commands;
+	std::vector<IndirectDrawData> draws;
+	std::vector<IndirectBatch> batches;
+
+	std::unordered_map<GLuint, uint32_t> shaderIDs;
+	std::map<TextureSetKey, uint32_t> textureSetIDs;
+	std::unordered_map<const Mesh*, uint32_t> meshIDs;
+	TextureSetKey textureSetKey; // Reused between submits so building the lookup key doesn't allocate
+
+	glm::vec3 cameraPosition;
+	float farPlane;
+	uint64_t transparentCount; // Submission order of the next transparent packet
+	bool weightedBlended; // The transparency mode when Begin() was called, so a switch mid frame doesn't mix key layouts
+	Ref<Shader> blendedShader; // Set while drawing into the OIT targets, the composite is still owed
+};
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "GLState.h"
 
 #include <glm/gtc/type_ptr.hpp> 
 #include <sstream>
@@ -10,38 +11,97 @@ GLuint Renderer::colorOverrideUniform = 0;
 GLuint Renderer::ignoreLightingUniform = 0;
 GLuint Renderer::alphaTransparencyUniform = 0;
 
-GLuint Renderer::matViewUniform = 0;
-GLuint Renderer::matProjectionUniform = 0;
-GLuint Renderer::cameraPositionUniform = 0;
+Ref<UniformBuffer> Renderer::frameUniformBuffer;
+
+GLint Renderer::matModelUniform = -1;
+GLint Renderer::matModelInverseTransposeUniform = -1;
+GLint Renderer::matSubmeshUniform = -1;
+GLint Renderer::matSubmeshNormalUniform = -1;
+
+GLuint Renderer::vertexFormatUniform = 0;
+int Renderer::currentVertexFormat = -1;
+
+GLuint Renderer::isInstancedUniform = 0;
+int Renderer::currentInstanced = -1;
+Ref<VertexBuffer> Renderer::instanceBuffer;
+
+GLuint Renderer::isPerObjectLightsUniform = 0;
+bool Renderer::perObjectLights = false;
+
+GLuint Renderer::isWeightedBlendedUniform = 0;
+TransparencyMode Renderer::transparencyMode = TransparencyMode::Sorted;
+Scope<OITBuffer> Renderer::oitBuffer;
+
+GLuint Renderer::isIndirectUniform = 0;
+GLuint Renderer::baseDrawIDUniform = 0;
+int Renderer::currentIndirect = -1;
+Ref<IndirectBuffer> Renderer::commandBuffer;
+Ref<StorageBuffer> Renderer::drawDataBuffer;
 
 std::vector<GLuint> Renderer::textureRatioScales;
 GLuint Renderer::alphaTextureScaleUniform = 0;
 
+std::vector<Renderer::BoundTexture> Renderer::boundTextures;
+
+Frustum Renderer::frustum;
+glm::mat4 Renderer::viewProjection(1.0f);
+bool Renderer::frustumCulling = true;
+bool Renderer::occlusionCulling = true;
+bool Renderer::multiDrawIndirect = true;
+
+FrameStatistics Renderer::frameStatistics;
+float Renderer::fieldOfView = 0.6f;
+const float Renderer::nearPlane = 0.5f;
+const float Renderer::farPlane = 10000.0f;
+float Renderer::viewportHeight = 1.0f;
+float Renderer::viewportWidth = 1.0f;
+
 GLFWwindow* Renderer::window = NULL;
 
 void Renderer::Initialize(const Ref<Shader> shader)
 {
+	GLState::Invalidate();
 	shader->Bind();
 
-	Renderer::isOverrideColorUniform = glGetUniformLocation(shader->GetID(), "isOverrideColor");
-	Renderer::colorOverrideUniform = glGetUniformLocation(shader->GetID(), "colorOverride");
+	Renderer::isOverrideColorUniform = shader->GetUniformLocation("isOverrideColor");
+	Renderer::colorOverrideUniform = shader->GetUniformLocation("colorOverride");
+
+	Renderer::ignoreLightingUniform = shader->GetUniformLocation("isIgnoreLighting");
+	Renderer::alphaTransparencyUniform = shader->GetUniformLocation("alphaTransparency");
 
-	Renderer::ignoreLightingUniform = glGetUniformLocation(shader->GetID(), "isIgnoreLighting");
-	Renderer::alphaTransparencyUniform = glGetUniformLocation(shader->GetID(), "alphaTransparency");
+	Renderer::frameUniformBuffer = CreateRef<UniformBuffer>((uint32_t)sizeof(FrameUniforms), FrameUniformBinding);
+	Renderer::frameUniformBuffer->Bind();
+	shader->SetUniformBlockBinding("FrameData", FrameUniformBinding);
+	shader->SetStorageBlockBinding("DrawData", DrawDataBinding);
 
-	Renderer::matViewUniform = glGetUniformLocation(shader->GetID(), "matView");
-	Renderer::matProjectionUniform = glGetUniformLocation(shader->GetID(), "matProjection");
-	Renderer::cameraPositionUniform = glGetUniformLocation(shader->GetID(), "cameraPosition");
+	Renderer::matModelUniform = shader->GetUniformLocation("matModel");
+	Renderer::matModelInverseTransposeUniform = shader->GetUniformLocation("matModelInverseTranspose");
+	Renderer::matSubmeshUniform = shader->GetUniformLocation("matSubmesh");
+	Renderer::matSubmeshNormalUniform = shader->GetUniformLocation("matSubmeshNormal");
+
+	Renderer::vertexFormatUniform = shader->GetUniformLocation("vertexFormat");
+	Renderer::currentVertexFormat = -1;
+
+	Renderer::isInstancedUniform = shader->GetUniformLocation("isInstanced");
+	Renderer::currentInstanced = -1;
+
+	Renderer::isPerObjectLightsUniform = shader->GetUniformLocation("isPerObjectLights");
+
+	Renderer::isWeightedBlendedUniform = shader->GetUniformLocation("isWeightedBlended");
+
+	Renderer::isIndirectUniform = shader->GetUniformLocation("isIndirect");
+	Renderer::baseDrawIDUniform = shader->GetUniformLocation("baseDrawID");
+	Renderer::currentIndirect = -1;
 
 	Renderer::textureRatioScales.resize(8);
 	for (int i = 0; i < 8; i++)
 	{
 		std::stringstream ss;
 		ss << "textureRatioScale" << i;
-		Renderer::textureRatioScales[i] = glGetUniformLocation(shader->GetID(), ss.str().c_str());
+		Renderer::textureRatioScales[i] = shader->GetUniformLocation(UniformName(ss.str()));
 	}
 
-	Renderer::alphaTextureScaleUniform = glGetUniformLocation(shader->GetID(), "aTexScale");
+	Renderer::alphaTextureScaleUniform = shader->GetUniformLocation("aTexScale");
 
 	Renderer::window = glfwGetCurrentContext();
 }
@@ -55,21 +115,67 @@ void Renderer::BeginFrame(Ref<Shader> shader, Ref<Camera> camera)
 	glViewport(0, 0, width, height); // Specifies the transformation of device coords to window coords 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clears the buffers
 
+	frameStatistics = FrameStatistics();
+	viewportHeight = (float)height;
+	viewportWidth = (float)width;
+	GLState::Invalidate(); // Whatever ran after the last frame (ImGui) may have changed state behind our back
+	GLState::ResetStatistics();
+
+	glm::mat4 view = camera->GetViewMatrix();
+	glm::mat4 projection = glm::perspective(fieldOfView, ratio, nearPlane, farPlane);
+	viewProjection = projection * view;
+	frustum = Frustum(viewProjection);
+
 	shader->Bind();
-	glUniformMatrix4fv(matViewUniform, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix())); // Assign new view matrix
-	glUniformMatrix4fv(matProjectionUniform, 1, GL_FALSE, glm::value_ptr(glm::perspective(0.6f, ratio, 0.5f, 10000.0f))); // Assign projection
-	glUniform4f(cameraPositionUniform, camera->position.x, camera->position.y, camera->position.z, 1.0f);
+	UnbindTextures(); // Texture settings may have been edited since last frame
+	glUniform1f(isPerObjectLightsUniform, perObjectLights ? (float)GL_TRUE : (float)GL_FALSE);
+
+	FrameUniforms frameUniforms;
+	frameUniforms.view = view;
+	frameUniforms.projection = projection;
+	frameUniforms.cameraPosition = glm::vec4(camera->position, 1.0f);
+	frameUniformBuffer->SetData(&frameUniforms, sizeof(FrameUniforms)); // One write for everything the shaders need from the camera
 }
 
-void Renderer::RenderMeshWithTextures(Ref<Shader> shader, Ref<Mesh> mesh, const std::vector<Ref<SceneTextureData>>& textures, const glm::mat4& transform, float alphaTransparency, bool debugMode)
+void Renderer::RenderMeshWithTextures(Ref<Shader> shader, Ref<Mesh> mesh, const std::vector<Ref<SceneTextureData>>& textures, const glm::mat4& transform, float alphaTransparency, bool debugMode, uint32_t lod)
 {
+	if (!IsVisible(mesh, transform)) // Don't bother binding anything
+	{
+		return;
+	}
+
 	shader->Bind();
-	shader->SetMat4x4("matModel", transform);
-	shader->SetMat4x4("matModelInverseTranspose", glm::inverse(transform));
+	SetVertexFormat(mesh->GetVertexFormat());
+	BindTextures(textures);
+
+	glUniform1f(alphaTransparencyUniform, alphaTransparency);
+
+	if (debugMode)
+	{
+		GLState::SetPolygonMode(GL_LINE);
+		BindVertexArray(nullptr); // The box is drawn from client side arrays
+		mesh->GetBoundingBox().Draw(glm::vec3(transform[3]), glm::vec3(1.0f, 1.0f, 1.0f)); // TODO: Retreive scale from transform mat
+	}
+	else
+	{
+		GLState::SetPolygonMode(GL_FILL);
+	}
+
+	DrawMesh(shader, mesh, transform, lod); // The textures stay bound in case the next mesh uses the same ones
+}
+
+void Renderer::BindTextures(const std::vector<Ref<SceneTextureData>>& textures)
+{
+	if (IsBound(textures))
+	{
+		frameStatistics.textureSetsReused++;
+		return;
+	}
+
+	UnbindTextures();
 
-	// Bind textures
 	int diffuseTextureindex = 0;
-	for (int i = 0; i < textures.size(); i++)
+	for (size_t i = 0; i < textures.size(); i++)
 	{
 		const Ref<SceneTextureData>& textureData = textures[i];
 		TextureType textureType = textureData->texture->GetType();
@@ -99,30 +205,291 @@ void Renderer::RenderMeshWithTextures(Ref<Shader> shader, Ref<Mesh> mesh, const
 		glUniform2f(Renderer::textureRatioScales[i], 0.0f, 1.0f); // Make sure we set unused diffuse texture ratios to 0
 	}
 
-	glUniform1f(alphaTransparencyUniform, alphaTransparency);
+	for (const Ref<SceneTextureData>& textureData : textures)
+	{
+		boundTextures.push_back({ textureData, textureData->ratio, textureData->texCoordScale });
+	}
+}
 
-	if (debugMode)
+void Renderer::UnbindTextures()
+{
+	for (size_t i = 0; i < boundTextures.size(); i++)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		mesh->GetBoundingBox().Draw(glm::vec3(transform[3]), glm::vec3(1.0f, 1.0f, 1.0f)); // TODO: Retreive scale from transform mat
+		const Ref<Texture>& texture = boundTextures[i].textureData->texture;
+		uint32_t slot = texture->GetType() == TextureType::Heightmap ? 37 
+			: texture->GetType() == TextureType::Discard ? 20 
+			: texture->GetType() == TextureType::Alpha ? 21 : (uint32_t)i;
+		texture->UnBind(slot);
 	}
-	else
+	boundTextures.clear();
+}
+
+bool Renderer::IsBound(const std::vector<Ref<SceneTextureData>>& textures)
+{
+	if (textures.size() != boundTextures.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const BoundTexture& boundTexture = boundTextures[i];
+		if (textures[i]->texture != boundTexture.textureData->texture || textures[i]->ratio != boundTexture.ratio || textures[i]->texCoordScale != boundTexture.texCoordScale) // Ratios can be edited while the set is bound
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void Renderer::DrawMesh(Ref<Shader> shader, Ref<Mesh> mesh, const glm::mat4& transform, uint32_t lod)
+{
+	const Ref<GeometryAllocation>& geometry = mesh->GetGeometry();
+	const GeometryArena* arena = geometry->GetArena();
+	const std::vector<Submesh>& submeshes = mesh->GetSubmeshes();
+	bool cullSubmeshes = frustumCulling && submeshes.size() > 1; // A lone submesh has the same bounds as its mesh
+
+	SetInstanced(false);
+	SetIndirect(false);
+	BindVertexArray(arena->GetVertexArray().get());
+	const glm::mat4* currentTransform = nullptr;
+	for (const Submesh& submesh : submeshes)
+	{
+		glm::mat4 submeshTransform = transform * submesh.transform;
+		if (cullSubmeshes && !frustum.Intersects(submesh.boundingBox.Transform(submeshTransform)))
+		{
+			frameStatistics.culledSubmeshes++;
+			continue;
+		}
+
+		if (!currentTransform || submesh.transform != *currentTransform) // Submeshes hanging off the same node share a transform, no need to set it again
+		{
+			shader->SetMat4x4(matModelUniform, submeshTransform * mesh->GetDequantizeTransform()); // Quantized positions get moved back into model space along with the rest of the transform
+			shader->SetMat4x4(matModelInverseTransposeUniform, glm::inverse(submeshTransform));
+			currentTransform = &submesh.transform;
+		}
+
+		// Submesh ranges are relative to the mesh's allocation, which is somewhere in the middle of the arena
+		const SubmeshLOD& range = submesh.lods[std::min(lod, (uint32_t)submesh.lods.size() - 1)];
+		const void* indexOffset = (const void*)((uintptr_t)(geometry->GetFirstIndex() + range.baseIndex) * arena->GetIndexSize());
+		glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, arena->GetIndexType(), indexOffset, geometry->GetBaseVertex() + submesh.baseVertex);
+
+		frameStatistics.drawCalls++;
+		frameStatistics.triangles += range.indexCount / 3;
+		frameStatistics.fullDetailTriangles += submesh.indexCount / 3;
+	}
+}
+
+void Renderer::UploadInstances(const std::vector<InstanceData>& instances)
+{
+	uint32_t uploadSize = (uint32_t)(instances.size() * sizeof(InstanceData));
+	if (!instanceBuffer || instanceBuffer->GetSize() < uploadSize)
+	{
+		instanceBuffer = CreateRef<VertexBuffer>(nullptr, std::max(uploadSize, instanceBuffer ? instanceBuffer->GetSize() * 2 : 0), true);
+		instanceBuffer->SetLayout({
+			{ ShaderDataType::Mat4x4, "iModel" },
+			{ ShaderDataType::Mat3x3, "iNormalMatrix" },
+			{ ShaderDataType::Float4, "iParameters" },
+			{ ShaderDataType::Int4, "iLights0" },
+			{ ShaderDataType::Int4, "iLights1" }
+		});
+	}
+
+	instanceBuffer->SetData(instances.data(), uploadSize);
+}
+
+void Renderer::DrawMeshInstanced(Ref<Shader> shader, Ref<Mesh> mesh, uint32_t lod, uint32_t baseInstance, uint32_t instanceCount)
+{
+	const Ref<GeometryAllocation>& geometry = mesh->GetGeometry();
+	const GeometryArena* arena = geometry->GetArena();
+
+	shader->Bind(); // The uniform updates below go to the bound program
+	SetInstanced(true);
+	SetIndirect(false);
+	SetVertexFormat(mesh->GetVertexFormat());
+	AttachInstanceBuffer(arena->GetVertexArray());
+	BindVertexArray(arena->GetVertexArray().get());
+
+	const glm::mat4* currentTransform = nullptr;
+	for (const Submesh& submesh : mesh->GetSubmeshes())
+	{
+		if (!currentTransform || submesh.transform != *currentTransform)
+		{
+			shader->SetMat4x4(matSubmeshUniform, submesh.transform * mesh->GetDequantizeTransform());
+			shader->SetMat4x4(matSubmeshNormalUniform, glm::transpose(glm::inverse(submesh.transform)));
+			currentTransform = &submesh.transform;
+		}
+
+		const SubmeshLOD& range = submesh.lods[std::min(lod, (uint32_t)submesh.lods.size() - 1)];
+		const void* indexOffset = (const void*)((uintptr_t)(geometry->GetFirstIndex() + range.baseIndex) * arena->GetIndexSize());
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, arena->GetIndexType(), indexOffset, instanceCount, geometry->GetBaseVertex() + submesh.baseVertex, baseInstance);
+
+		frameStatistics.drawCalls++;
+		frameStatistics.triangles += range.indexCount / 3 * instanceCount;
+		frameStatistics.fullDetailTriangles += submesh.indexCount / 3 * instanceCount;
+	}
+
+	frameStatistics.instances += instanceCount;
+}
+
+void Renderer::AppendIndirectDraws(Ref<Mesh> mesh, uint32_t lod, uint32_t baseInstance, uint32_t instanceCount, std::vector<DrawCommand>& commands, std::vector<IndirectDrawData>& draws)
+{
+	const Ref<GeometryAllocation>& geometry = mesh->GetGeometry();
+	for (const Submesh& submesh : mesh->GetSubmeshes())
+	{
+		const SubmeshLOD& range = submesh.lods[std::min(lod, (uint32_t)submesh.lods.size() - 1)];
+
+		DrawCommand command;
+		command.count = range.indexCount;
+		command.instanceCount = instanceCount;
+		command.firstIndex = geometry->GetFirstIndex() + range.baseIndex; // In indices rather than bytes, unlike the offsets of the direct draws
+		command.baseVertex = (int32_t)(geometry->GetBaseVertex() + submesh.baseVertex);
+		command.baseInstance = baseInstance;
+		commands.push_back(command);
+
+		IndirectDrawData draw;
+		draw.submesh = submesh.transform * mesh->GetDequantizeTransform();
+		draw.submeshNormal = glm::transpose(glm::inverse(submesh.transform));
+		draws.push_back(draw);
+
+		frameStatistics.triangles += range.indexCount / 3 * instanceCount;
+		frameStatistics.fullDetailTriangles += submesh.indexCount / 3 * instanceCount;
+	}
+
+	frameStatistics.instances += instanceCount;
+}
+
+void Renderer::UploadIndirectDraws(const std::vector<DrawCommand>& commands, const std::vector<IndirectDrawData>& draws)
+{
+	uint32_t commandSize = (uint32_t)(commands.size() * sizeof(DrawCommand));
+	if (!commandBuffer || commandBuffer->GetSize() < commandSize)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		commandBuffer = CreateRef<IndirectBuffer>(std::max(commandSize, commandBuffer ? commandBuffer->GetSize() * 2 : 0));
 	}
+	commandBuffer->SetData(commands.data(), commandSize);
 
-	mesh->GetVertexArray()->Bind();
-	glDrawElements(GL_TRIANGLES, mesh->GetIndexBuffer()->GetCount(), GL_UNSIGNED_INT, 0); // TODO: Make an instanced rendering version of this
-	mesh->GetVertexArray()->Unbind();
+	uint32_t drawSize = (uint32_t)(draws.size() * sizeof(IndirectDrawData));
+	if (!drawDataBuffer || drawDataBuffer->GetSize() < drawSize)
+	{
+		drawDataBuffer = CreateRef<StorageBuffer>(std::max(drawSize, drawDataBuffer ? drawDataBuffer->GetSize() * 2 : 0), DrawDataBinding);
+	}
+	drawDataBuffer->SetData(draws.data(), drawSize);
+
+	// Cheap enough to redo every upload, and covers the buffers having been replaced
+	commandBuffer->Bind();
+	drawDataBuffer->Bind();
+}
+
+void Renderer::MultiDrawIndirect(Ref<Shader> shader, Ref<Mesh> mesh, uint32_t firstCommand, uint32_t commandCount)
+{
+	const GeometryArena* arena = mesh->GetGeometry()->GetArena();
+
+	shader->Bind(); // The uniform updates below go to the bound program
+	SetInstanced(true);
+	SetIndirect(true);
+	SetVertexFormat(mesh->GetVertexFormat());
+	AttachInstanceBuffer(arena->GetVertexArray());
+	BindVertexArray(arena->GetVertexArray().get());
+
+	glUniform1i(baseDrawIDUniform, (int)firstCommand); // gl_DrawID restarts at 0 every call
+	glMultiDrawElementsIndirect(GL_TRIANGLES, arena->GetIndexType(), (const void*)((uintptr_t)firstCommand * sizeof(DrawCommand)), commandCount, sizeof(DrawCommand));
+
+	frameStatistics.drawCalls++;
+	frameStatistics.indirectCommands += commandCount;
+}
 
-	// Unbind textures
-	for (int i = 0; i < textures.size(); i++)
+InstanceData Renderer::CreateInstanceData(const glm::mat4& transform, const glm::mat3& normalMatrix, float alphaTransparency, const ObjectLights& lights)
+{
+	InstanceData instance;
+	instance.model = transform;
+	instance.normalMatrix = normalMatrix;
+	instance.parameters = glm::vec4(alphaTransparency, 0.0f, 0.0f, 0.0f);
+	instance.lights = lights;
+	return instance;
+}
+
+void Renderer::SetInstanced(bool instanced)
+{
+	if (currentInstanced == (int)instanced)
 	{
-		uint32_t slot = textures[i]->texture->GetType() == TextureType::Heightmap ? 37 
-			: textures[i]->texture->GetType() == TextureType::Discard ? 20 
-			: textures[i]->texture->GetType() == TextureType::Alpha ? 21 : i;
-		textures[i]->texture->UnBind(slot);
+		return;
 	}
+
+	glUniform1f(isInstancedUniform, instanced ? (float)GL_TRUE : (float)GL_FALSE);
+	currentInstanced = (int)instanced;
+}
+
+void Renderer::SetIndirect(bool indirect)
+{
+	if (currentIndirect == (int)indirect)
+	{
+		return;
+	}
+
+	glUniform1f(isIndirectUniform, indirect ? (float)GL_TRUE : (float)GL_FALSE);
+	currentIndirect = (int)indirect;
+}
+
+void Renderer::AttachInstanceBuffer(const Ref<VertexArrayObject>& vertexArray)
+{
+	const std::vector<Ref<VertexBuffer>>& vertexBuffers = vertexArray->GetVertexBuffers();
+	if (vertexBuffers.size() < 2)
+	{
+		vertexArray->AddInstanceBuffer(instanceBuffer, InstanceAttributeLocation);
+	}
+	else if (vertexBuffers[1] != instanceBuffer)
+	{
+		vertexArray->ReplaceVertexBuffer(1, instanceBuffer);
+	}
+}
+
+bool Renderer::IsVisible(Ref<Mesh> mesh, const glm::mat4& transform)
+{
+	if (!frustumCulling || frustum.Intersects(mesh->GetBoundingBox().Transform(transform)))
+	{
+		return true;
+	}
+
+	frameStatistics.culledMeshes++;
+	return false;
+}
+
+void Renderer::BindVertexArray(const VertexArrayObject* vertexArray)
+{
+	if (GLState::BindVertexArray(vertexArray ? vertexArray->GetID() : 0) && vertexArray)
+	{
+		frameStatistics.vertexArrayBinds++;
+	}
+}
+
+void Renderer::SetVertexFormat(VertexFormat format)
+{
+	if (currentVertexFormat == (int)format)
+	{
+		return;
+	}
+
+	glUniform1i(vertexFormatUniform, (int)format);
+	currentVertexFormat = (int)format;
+}
+
+void Renderer::BeginWeightedBlended(Ref<Shader> shader)
+{
+	if (!oitBuffer)
+	{
+		oitBuffer = CreateScope<OITBuffer>();
+	}
+
+	oitBuffer->Begin((uint32_t)viewportWidth, (uint32_t)viewportHeight);
+	shader->Bind();
+	glUniform1f(isWeightedBlendedUniform, (float)GL_TRUE);
+}
+
+void Renderer::EndWeightedBlended(Ref<Shader> shader)
+{
+	shader->Bind();
+	glUniform1f(isWeightedBlendedUniform, (float)GL_FALSE);
+	oitBuffer->Composite();
 }
 
 void Renderer::EndFrame()
@@ -131,11 +498,16 @@ void Renderer::EndFrame()
 	glfwPollEvents();
 }
 
-void Renderer::RenderMeshWithColorOverride(Ref<Shader> shader, Ref<Mesh> mesh, const glm::mat4& transform, const glm::vec3& colorOverride, bool debugMode, bool ignoreLight)
+void Renderer::RenderMeshWithColorOverride(Ref<Shader> shader, Ref<Mesh> mesh, const glm::mat4& transform, const glm::vec3& colorOverride, bool debugMode, bool ignoreLight, uint32_t lod)
 {
+	if (!IsVisible(mesh, transform))
+	{
+		return;
+	}
+
 	shader->Bind();
-	shader->SetMat4x4("matModel", transform);
-	shader->SetMat4x4("matModelInverseTranspose", glm::inverse(transform));
+	SetVertexFormat(mesh->GetVertexFormat());
+	UnbindTextures(); // Height maps and discard textures would still apply
 
 	glUniform1f(isOverrideColorUniform, (float)GL_TRUE);
 	glUniform4f(colorOverrideUniform, colorOverride.x, colorOverride.y, colorOverride.z, 1.0f);
@@ -147,17 +519,16 @@ void Renderer::RenderMeshWithColorOverride(Ref<Shader> shader, Ref<Mesh> mesh, c
 
 	if (debugMode)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		GLState::SetPolygonMode(GL_LINE);
+		BindVertexArray(nullptr); // The box is drawn from client side arrays
 		mesh->GetBoundingBox().Draw(glm::vec3(transform[3]), glm::vec3(1.0f, 1.0f, 1.0f)); // TODO: Retreive scale from transform mat
 	}
 	else
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		GLState::SetPolygonMode(GL_FILL);
 	}
 
-	mesh->GetVertexArray()->Bind();
-	glDrawElements(GL_TRIANGLES, mesh->GetIndexBuffer()->GetCount(), GL_UNSIGNED_INT, 0); // TODO: Make an instanced rendering version of this
-	mesh->GetVertexArray()->Unbind();
+	DrawMesh(shader, mesh, transform, lod);
 
 	glUniform1f(isOverrideColorUniform, (float)GL_FALSE);
 
@@ -5,9 +5,82 @@
 #include "Camera.h"
 #include "EnvironmentMap.h"
 #include "SceneTextureData.h"
+#include "Frustum.h"
+#include "UniformBuffer.h"
+#include "StorageBuffer.h"
+#include "IndirectBuffer.h"
+#include "OITBuffer.h"
 
 #include "GLCommon.h"
 
+// Counters for the frame being rendered, reset in BeginFrame
+struct FrameStatistics
+{
+	uint32_t drawCalls = 0;
+	uint32_t triangles = 0;
+	uint32_t fullDetailTriangles = 0; // What the triangle count would have been if every mesh was drawn at LOD 0
+	uint32_t vertexArrayBinds = 0;
+	uint32_t culledMeshes = 0;
+	uint32_t culledSubmeshes = 0;
+	uint32_t instances = 0; // Meshes drawn through DrawMeshInstanced()
+	uint32_t textureSetsReused = 0; // BindTextures() calls skipped because the same textures were still bound
+	uint32_t indirectCommands = 0; // Draws issued through MultiDrawIndirect(), each of those calls only counts once in drawCalls
+};
+
+// The lights an instance is shaded with while Renderer::IsPerObjectLights(), as indices into lightArray with -1 marking unused slots (see LightGrid).
+// They go out as Int4 attributes, which the shader reads back as floats (vec4 iLights0, iLights1), exact for any index below 2^24.
+struct ObjectLights
+{
+	glm::ivec4 indices[2] = { glm::ivec4(-1), glm::ivec4(-1) };
+};
+
+// What every instance of an instanced draw gets. The vertex shader reads it from fixed attribute locations starting at Renderer::InstanceAttributeLocation
+// (model matrix 5-8, normal matrix 9-11, parameters 12, lights 13-14) instead of the matModel uniforms when "isInstanced" is set.
+// Submesh transforms can't be baked in here since every submesh shares the instance, so instanced draws also set "matSubmesh" (including the dequantize transform) and "matSubmeshNormal".
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+	glm::vec4 parameters; // x: alpha transparency
+	ObjectLights lights;
+};
+
+// Laid out the way glMultiDrawElementsIndirect reads its commands
+struct DrawCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+// What every command of an indirect draw gets, the "DrawData" storage block laid out std430:
+// struct IndirectDraw { mat4 matSubmesh; mat4 matSubmeshNormal; }; layout(std430) readonly buffer DrawData { IndirectDraw draws[]; };
+// When "isIndirect" is set the vertex shader reads draws[baseDrawID + gl_DrawID] instead of the matSubmesh uniforms. Instance data still comes from the instance attributes through the command's baseInstance.
+// gl_DrawID needs GLSL 4.60 or ARB_shader_draw_parameters.
+struct IndirectDrawData
+{
+	glm::mat4 submesh; // Includes the dequantize transform
+	glm::mat4 submeshNormal;
+};
+
+// The "FrameData" uniform block, laid out std140:
+// layout(std140) uniform FrameData { mat4 matView; mat4 matProjection; vec4 cameraPosition; };
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 cameraPosition;
+};
+
+// How transparent meshes are blended
+enum class TransparencyMode
+{
+	Sorted = 0, // Back to front with regular alpha blending, sorted on the CPU every frame
+	WeightedBlended = 1 // Order independent approximation (see OITBuffer), drawn in any order and batched like opaque meshes
+};
+
 class Renderer
 {
 public:
@@ -16,22 +89,163 @@ public:
 	static void BeginFrame(Ref<Shader> shader, Ref<Camera> camera);
 	static void EndFrame();
 
-	static void RenderMeshWithColorOverride(Ref<Shader> shader, Ref<Mesh> mesh, const glm::mat4& transform, const glm::vec3& colorOverride, bool debugMode = false, bool ignoreLight = false);
-	static void RenderMeshWithTextures(Ref<Shader> shader, Ref<Mesh> mesh, const std::vector<Ref<SceneTextureData>>& textures, const glm::mat4& transform, float alphaTransparency, bool debugMode = false);
+	static void RenderMeshWithColorOverride(Ref<Shader> shader, Ref<Mesh> mesh, const glm::mat4& transform, const glm::vec3& colorOverride, bool debugMode = false, bool ignoreLight = false, uint32_t lod = 0);
+	static void RenderMeshWithTextures(Ref<Shader> shader, Ref<Mesh> mesh, const std::vector<Ref<SceneTextureData>>& textures, const glm::mat4& transform, float alphaTransparency, bool debugMode = false, uint32_t lod = 0);
+
+	// Issues a draw call per submesh with whatever other shader state is currently set. Each submesh is placed at transform * Submesh::transform.
+	// On meshes with more than one submesh, submeshes outside the view frustum are skipped. Culling the mesh as a whole is up to the caller (see IsVisible).
+	static void DrawMesh(Ref<Shader> shader, Ref<Mesh> mesh, const glm::mat4& transform, uint32_t lod = 0);
+
+	// Whether any part of the mesh's bounds are in the view frustum of the current frame
+	static bool IsVisible(Ref<Mesh> mesh, const glm::mat4& transform);
+
+	// Streams per instance data to the GPU, replacing the last upload. Instanced draws pick their slice of it with baseInstance.
+	static void UploadInstances(const std::vector<InstanceData>& instances);
+
+	// Draws instanceCount copies of every submesh, reading InstanceData from the last upload starting at baseInstance. Textures and blending are up to the caller.
+	static void DrawMeshInstanced(Ref<Shader> shader, Ref<Mesh> mesh, uint32_t lod, uint32_t baseInstance, uint32_t instanceCount);
+
+	// Adds a command per submesh that draws instanceCount instances starting at baseInstance, along with its draw data
+	static void AppendIndirectDraws(Ref<Mesh> mesh, uint32_t lod, uint32_t baseInstance, uint32_t instanceCount, std::vector<DrawCommand>& commands, std::vector<IndirectDrawData>& draws);
+
+	// Streams commands and their draw data to the GPU, replacing the last upload. Both have to be the same length.
+	static void UploadIndirectDraws(const std::vector<DrawCommand>& commands, const std::vector<IndirectDrawData>& draws);
+
+	// Issues commandCount commands of the last upload starting at firstCommand in one call. They all have to draw from the same arena as the given mesh, which also means the same vertex format.
+	// Textures, blending and the instance upload are up to the caller.
+	static void MultiDrawIndirect(Ref<Shader> shader, Ref<Mesh> mesh, uint32_t firstCommand, uint32_t commandCount);
+
+	static InstanceData CreateInstanceData(const glm::mat4& transform, const glm::mat3& normalMatrix, float alphaTransparency, const ObjectLights& lights);
+
+	static const uint32_t FrameUniformBinding = 0; // Uniform buffer binding point of FrameData
+
+	static const uint32_t DrawDataBinding = 0; // Shader storage binding point of DrawData
+
+	static const uint32_t InstanceAttributeLocation = 5; // One past the last vertex attribute of the biggest vertex layout
+
+	static const uint32_t MaxObjectLights = 8; // Slots in ObjectLights
+
+	// Binds textures to the units the fragment shader expects them in and sets up their ratios and scales.
+	// They stay bound until a different set is bound or UnbindTextures() is called, so binding the same set again does nothing.
+	static void BindTextures(const std::vector<Ref<SceneTextureData>>& textures);
+	static void UnbindTextures();
+
+	inline static void SetFrustumCulling(bool enabled) { frustumCulling = enabled; }
+	inline static bool IsFrustumCulling() { return frustumCulling; }
+
+	// Whether the Scene hides meshes behind its occluders (see OcclusionCuller)
+	inline static void SetOcclusionCulling(bool enabled) { occlusionCulling = enabled; }
+	inline static bool IsOcclusionCulling() { return occlusionCulling; }
+
+	// Whether the RenderQueue submits with MultiDrawIndirect() instead of a DrawMeshInstanced() per run
+	inline static void SetMultiDrawIndirect(bool enabled) { multiDrawIndirect = enabled; }
+	inline static bool IsMultiDrawIndirect() { return multiDrawIndirect; }
+
+	// Whether instanced draws shade with the lights in their instance data instead of their cluster's list. Draws that aren't instanced always use the clusters.
+	// Takes effect from the next BeginFrame().
+	inline static void SetPerObjectLights(bool enabled) { perObjectLights = enabled; }
+	inline static bool IsPerObjectLights() { return perObjectLights; }
+
+	// Takes effect from the next frame the RenderQueue starts
+	inline static void SetTransparencyMode(TransparencyMode mode) { transparencyMode = mode; }
+	inline static TransparencyMode GetTransparencyMode() { return transparencyMode; }
+
+	// Sends the draws that follow into the weighted blended targets, with the blending they need set up. Textures are up to the caller.
+	static void BeginWeightedBlended(Ref<Shader> shader);
+
+	// Back to the default framebuffer with the transparent layer composited over it
+	static void EndWeightedBlended(Ref<Shader> shader);
+
+	// The view frustum and view projection matrix of the current frame
+	inline static const Frustum& GetFrustum() { return frustum; }
+	inline static const glm::mat4& GetViewProjection() { return viewProjection; }
+
+	// Tells the vertex shader how to decode the vertices of the next draw. Only touches the uniform when the format changes.
+	static void SetVertexFormat(VertexFormat format);
+
+	inline static const FrameStatistics& GetFrameStatistics() { return frameStatistics; }
+
+	// The vertical field of view (in radians) and viewport size (in pixels) of the current frame
+	inline static float GetFieldOfView() { return fieldOfView; }
+	inline static float GetViewportWidth() { return viewportWidth; }
+	inline static float GetViewportHeight() { return viewportHeight; }
+
+	// Clip plane distances of the projection
+	inline static float GetNearPlane() { return nearPlane; }
+	inline static float GetFarPlane() { return farPlane; }
 
 private:
+	// Binds the VAO unless it's already bound. Meshes share their arena's VAO so most draws skip this.
+	static void BindVertexArray(const VertexArrayObject* vertexArray);
+
+	// Switches the vertex shader between the matModel uniforms and the instance attributes. Only touches the uniform when it changes.
+	static void SetInstanced(bool instanced);
+
+	// Switches the vertex shader between the matSubmesh uniforms and the draw data. Only touches the uniform when it changes.
+	static void SetIndirect(bool indirect);
+
+	// Whether BindTextures() would bind exactly what is bound already
+	static bool IsBound(const std::vector<Ref<SceneTextureData>>& textures);
+
+	// Hooks the instance buffer up to an arena's VAO, or points it at the current one if the buffer has been reallocated since
+	static void AttachInstanceBuffer(const Ref<VertexArrayObject>& vertexArray);
+
 	static GLuint isOverrideColorUniform;
 	static GLuint colorOverrideUniform;
 
 	static GLuint ignoreLightingUniform;
 	static GLuint alphaTransparencyUniform;
 
-	static GLuint matViewUniform;
-	static GLuint matProjectionUniform;
-	static GLuint cameraPositionUniform;
+	static Ref<UniformBuffer> frameUniformBuffer;
+
+	static GLint matModelUniform;
+	static GLint matModelInverseTransposeUniform;
+	static GLint matSubmeshUniform;
+	static GLint matSubmeshNormalUniform;
+
+	static GLuint vertexFormatUniform;
+	static int currentVertexFormat;
+
+	static GLuint isInstancedUniform;
+	static int currentInstanced;
+	static Ref<VertexBuffer> instanceBuffer;
+
+	static GLuint isPerObjectLightsUniform;
+	static bool perObjectLights;
+
+	static GLuint isWeightedBlendedUniform;
+	static TransparencyMode transparencyMode;
+	static Scope<OITBuffer> oitBuffer; // Made the first time weighted blended transparency is used
+
+	static GLuint isIndirectUniform;
+	static GLuint baseDrawIDUniform;
+	static int currentIndirect;
+	static Ref<IndirectBuffer> commandBuffer;
+	static Ref<StorageBuffer> drawDataBuffer;
 
 	static std::vector<GLuint> textureRatioScales;
 	static GLuint alphaTextureScaleUniform;
 
+	struct BoundTexture
+	{
+		Ref<SceneTextureData> textureData; // Holding on to it keeps the texture from being deleted and its ID reused while we think it's bound
+		float ratio;
+		float texCoordScale;
+	};
+	static std::vector<BoundTexture> boundTextures;
+
+	static Frustum frustum;
+	static glm::mat4 viewProjection;
+	static bool frustumCulling;
+	static bool occlusionCulling;
+	static bool multiDrawIndirect;
+
+	static FrameStatistics frameStatistics;
+	static float fieldOfView;
+	static float viewportHeight;
+	static float viewportWidth;
+	static const float nearPlane;
+	static const float farPlane;
+
 	static GLFWwindow* window;
 };
\ No newline at end of file
@@ -1,12 +1,14 @@
 #include "Scene.h"
 #include "MeshManager.h"
 #include "Renderer.h"
+#include "GLState.h"
 #include "YAMLOverloads.h"
 
 #include <sstream>
 #include <fstream>
 
 static const float MaxSpreadRadius = 5500.0f;
+static constexpr UniformName SpreadDataUniform("spreadData"); // Set every frame while the moss spreads, so hash it at compile time
 const std::vector<UUID> atmosphereLights = { 129824329036021396, 129824329036021395 };
 const std::vector<UUID> spotLights = { 129824329036021381, 129824329036021382, 129824329036021383 };
 const std::vector<UUID> lightShafts = { 9671491309700141238, 2066726669122141605, 9749425813235041119 };
@@ -14,25 +16,28 @@ const float nightLightMoveAngle = 0.1f;
 const int nightLightMoveIterations = 300;
 
 Scene::Scene(Ref<Shader> shader)
-	: shader(shader), 
-	transparentEnd(-1), 
-	debugMode(false), 
-	scenePanel(this), 
-	currentMeshIndex(0), 
-	currentLightIndex(0), 
-	showCurrentEdit(true),
+	: showCurrentEdit(true),
+	debugMode(false),
 	camera(NULL),
+	lodPixelError(1.0f),
+	lodHysteresis(0.15f),
+	currentMeshIndex(0),
+	currentLightIndex(0),
+	shader(shader),
+	lightMesh(nullptr),
+	scenePanel(this),
+	vineTexture(nullptr),
+	mossTexture(nullptr),
+	startMossSpread(false),
 	mossRadius(0.0f),
 	vineRadius(0.0f),
 	vineHeight(0.0f),
-	vineTexture(nullptr),
-	mossTexture(nullptr),
-	lightMesh(nullptr),
 	night(false),
 	dimLights(false),
-	startMossSpread(false),
 	lightMoveIterations(0)
 {
+	this->lightClusters.Initialize(shader);
+
 	{
 		std::stringstream ss;
 		ss << SOLUTION_DIR << "Extern\\assets\\models\\ISO_Sphere.ply";
@@ -119,10 +124,16 @@ void Scene::Load(const std::string& path)
 		return;
 	}
 
+	for (const Ref<SceneMeshData>& meshData : this->meshVec)
+	{
+		this->bvh.Remove(meshData->GetTransformID());
+	}
+
 	this->meshes.clear();
-	this->sortedMeshes.clear();
+	this->meshVec.clear();
+	this->meshesByTransform.clear();
 	this->lights.clear();
-	this->transparentEnd = -1;
+	this->lightVec.clear();
 	this->currentMeshIndex = 0;
 	this->scenePanel.SetMeshData(NULL);
 
@@ -140,6 +151,22 @@ void Scene::Load(const std::string& path)
 
 	std::string sceneName = root["Scene"].as<std::string>();
 
+	// Kick off every mesh import up front so they run in parallel, the loads below then only wait on them
+	if (root["EnvironmentMap"])
+	{
+		MeshManager::LoadMeshAsync(SerializeUtils::LoadPath(root["EnvironmentMap"]["MeshPath"].as<std::string>()));
+	}
+
+	const YAML::Node& prefetchNode = root["Meshes"];
+	if (prefetchNode)
+	{
+		YAML::const_iterator it;
+		for (it = prefetchNode.begin(); it != prefetchNode.end(); it++)
+		{
+			MeshManager::LoadMeshAsync(SerializeUtils::LoadPath((*it)["Path"].as<std::string>()));
+		}
+	}
+
 	const YAML::Node& cameraNode = root["Camera"];
 	if (cameraNode && this->camera)
 	{
@@ -183,17 +210,13 @@ void Scene::Load(const std::string& path)
 			AddMesh(meshData);
 		}
 	}
+
+	MeshManager::WaitForLoads(); // Make sure nothing we prefetched is left half loaded
 }
 
 void Scene::AddLight(const glm::vec3& position)
 {
 	int lightIndex = this->lights.size();
-	if (lightIndex >= MAX_LIGHTS)
-	{
-		std::cout << "The maximum number of lights has been reached. You must increase the MAX_LIGHTS value in LightManager.h AND the fragment shader to inccrease the number of lights." << std::endl;
-		return;
-	}
-
 	Ref<Light> light = CreateRef<Light>(lightIndex);
 	light->position = glm::vec4(position, 1.0f);
 	Ref<SceneLight> sLight = CreateRef<SceneLight>(light);
@@ -215,16 +238,9 @@ void Scene::AddLight(Ref<SceneLight> light)
 void Scene::AddMesh(Ref<SceneMeshData> meshData)
 {
 	this->meshes.insert(std::make_pair(meshData->uuid, meshData) );
-
-	if (!this->sortedMeshes.empty() && meshData->alphaTransparency < 1.0f) // We have to add transparent objects to the front so we can handle blend transparency
-	{
-		this->sortedMeshes.insert(this->sortedMeshes.begin(), meshData);
-		transparentEnd++;
-	}
-	else
-	{
-		this->sortedMeshes.push_back(meshData);
-	}
+	this->meshesByTransform.insert(std::make_pair(meshData->GetTransformID(), meshData));
+	this->bvh.Insert(meshData->GetTransformID());
+	this->meshVec.push_back(meshData);
 }
 
 void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
@@ -241,7 +257,7 @@ void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
 			mossRadius += 500.0f * deltaTime;
 		}
 
-		shader->SetFloat3("spreadData", glm::vec3(mossRadius, vineRadius, vineHeight));
+		shader->SetFloat3(SpreadDataUniform, glm::vec3(mossRadius, vineRadius, vineHeight));
 	}
 
 	if (night)
@@ -256,7 +272,8 @@ void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
 
 			for (const UUID& id : lightShafts)
 			{
-				meshes.at(id)->orientation.x += nightLightMoveAngle * deltaTime;
+				const Ref<SceneMeshData>& lightShaft = meshes.at(id);
+				lightShaft->SetOrientation(lightShaft->GetOrientation() + glm::vec3(nightLightMoveAngle * deltaTime, 0.0f, 0.0f));
 			}
 
 			// TODO: Move light beams
@@ -289,8 +306,22 @@ void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
 		}
 	}
 
-	glDisable(GL_DEPTH);
-	glDisable(GL_DEPTH_TEST);
+	Light::UploadLights(); // Everything the lights were edited with this frame goes up in one write
+	this->lightClusters.Update(this->lightVec, camera->GetViewMatrix()); // Each pixel only shades with the lights listed in its cluster
+	if (Renderer::IsPerObjectLights()) // Instanced draws shade with their own short list instead, the clusters stay around for everything else
+	{
+		this->lightGrid.Build(this->lightVec);
+	}
+	TransformComponent::UpdateDirty(); // Only meshes that moved since last frame get their matrices rebuilt
+	this->bvh.Update(); // Refits around whatever UpdateDirty() just moved
+	this->frustumCuller.Cull(Renderer::IsFrustumCulling() ? Renderer::GetFrustum() : Frustum());
+	this->occlusionCuller.Begin(Renderer::GetViewProjection());
+	if (Renderer::IsOcclusionCulling())
+	{
+		RasterizeOccluders();
+	}
+
+	GLState::SetDepthTest(false);
 
 	// Draw environment map
 	if (envMap)
@@ -299,94 +330,59 @@ void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
 	}
 
 	// Draw meshes
-	glEnable(GL_DEPTH);
-	glEnable(GL_DEPTH_TEST);
-
-	for (int i = 1; i <= this->transparentEnd; i++) // Sort the transparent meshes (use insertion sort here since they are sorted the majority of the time)
-	{
-		int j = i - 1;
-
-		Ref<SceneMeshData> cachedMeshData = this->sortedMeshes[i];
-		glm::vec3 difference = camera->position - cachedMeshData->position;
-		float currentDistance = glm::dot(difference, difference);
-
-		glm::vec3 difference2 = camera->position - this->sortedMeshes[j]->position;
-		float toCompare = glm::dot(difference2, difference2);
+	GLState::SetDepthTest(true);
 
-		while (j >= 0 && toCompare < currentDistance)
-		{
-			this->sortedMeshes[j + 1] = this->sortedMeshes[j];
-			j = j - 1;
-		}
+	this->renderQueue.Begin(camera->position, Renderer::GetFarPlane());
 
-		this->sortedMeshes[j + 1] = cachedMeshData;
-	}
+	GLState::SetBlend(false);
 
-	glDisable(GL_BLEND);
+	// Opaque meshes go straight to the queue, transparent ones are collected with their view depth to be sorted first
+	glm::mat4 view = camera->GetViewMatrix();
+	glm::vec3 viewDepthRow = -glm::vec3(view[0][2], view[1][2], view[2][2]); // Distance along the view direction is -(view * p).z
+	float viewDepthOffset = -view[3][2];
+	float depthScale = 1.0f / Renderer::GetFarPlane();
+	const BoundsArrays& worldBounds = TransformComponent::GetWorldBoundsArrays();
+	bool sortTransparent = Renderer::GetTransparencyMode() == TransparencyMode::Sorted; // Weighted blending doesn't care about order
 
-	// Render opaque meshes
-	int startIndex = this->transparentEnd == -1 ? 0 : this->transparentEnd + 1;
-	std::vector<int> changedAlphaValues;
-	for (int i = startIndex; i < this->sortedMeshes.size(); i++)
+	this->transparentItems.clear();
+	for (uint32_t i = 0; i < this->meshVec.size(); i++)
 	{
-		Ref<SceneMeshData> meshData = this->sortedMeshes[i];
-		glm::mat4 transform(1.0f);
-		transform *= glm::translate(glm::mat4(1.0f), meshData->position);
-		transform *= glm::rotate(glm::mat4(1.0f), meshData->orientation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-		transform *= glm::rotate(glm::mat4(1.0f), meshData->orientation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-		transform *= glm::rotate(glm::mat4(1.0f), meshData->orientation.z, glm::vec3(0.0f, 0.0f, 1.0f));
-		transform *= glm::scale(glm::mat4(1.0f), meshData->scale);
-
-		if (meshData->alphaTransparency < 1.0f || meshData->hasAlphaTransparentTexture) // Alpha transparency is now below 1, we need to flag this object to be sorted
+		const Ref<SceneMeshData>& meshData = this->meshVec[i];
+		if (IsCulled(meshData))
 		{
-			changedAlphaValues.push_back(i);
+			continue;
 		}
 
-		if (meshData == this->scenePanel.GetEditMesh() && this->showCurrentEdit)
-		{
-			Renderer::RenderMeshWithColorOverride(shader, meshData->mesh, transform, glm::vec3(0.0f, 1.0f, 0.0f), this->debugMode, true);
-		}
-		else
+		meshData->lod = SelectLOD(meshData, camera->position);
+		if (!meshData->IsTransparent())
 		{
-			Renderer::RenderMeshWithTextures(shader, meshData->mesh, meshData->textures, transform, meshData->alphaTransparency, this->debugMode);
+			SubmitMesh(meshData, false);
+			continue;
 		}
-	}
-
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	for (int i = 0; i <= this->transparentEnd; i++)
-	{
-		Ref<SceneMeshData> meshData = this->sortedMeshes[i];
-		glm::mat4 transform(1.0f);
-		transform *= glm::translate(glm::mat4(1.0f), meshData->position);
-		transform *= glm::rotate(glm::mat4(1.0f), meshData->orientation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-		transform *= glm::rotate(glm::mat4(1.0f), meshData->orientation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-		transform *= glm::rotate(glm::mat4(1.0f), meshData->orientation.z, glm::vec3(0.0f, 0.0f, 1.0f));
-		transform *= glm::scale(glm::mat4(1.0f), meshData->scale);
 
-		if (meshData == this->scenePanel.GetEditMesh() && this->showCurrentEdit)
-		{
-			Renderer::RenderMeshWithColorOverride(shader, meshData->mesh, transform, glm::vec3(0.0f, 1.0f, 0.0f), this->debugMode, true);
-		}
-		else
+		if (!sortTransparent)
 		{
-			Renderer::RenderMeshWithTextures(shader, meshData->mesh, meshData->textures, transform, meshData->alphaTransparency, this->debugMode);
+			SubmitMesh(meshData, true);
+			continue;
 		}
-	}
 
-	glDisable(GL_BLEND);
+		// Bounds centers rather than origins, which can be far from the geometry of a mesh that wasn't modelled around its origin
+		TransformID id = meshData->GetTransformID();
+		glm::vec3 center(worldBounds.centerX[id], worldBounds.centerY[id], worldBounds.centerZ[id]);
+		float depth = std::min(std::max((glm::dot(viewDepthRow, center) + viewDepthOffset) * depthScale, 0.0f), 1.0f);
+		uint64_t key = 0xFFFFFFFFull - std::min<uint64_t>((uint64_t)((double)depth * 4294967295.0), 0xFFFFFFFFull); // Inverted so the farthest comes first. In double, a float can't hold 0xFFFFFFFF and rounds up to 2^32.
+		this->transparentItems.push_back({ key, i });
+	}
 
-	if (!changedAlphaValues.empty())
+	RenderQueue::RadixSort(this->transparentItems, this->transparentScratch);
+	for (const RenderQueue::SortItem& item : this->transparentItems) // The queue draws these in the order they're submitted
 	{
-		for (int& i : changedAlphaValues) // Ad changed alpha meshes to the front of the vector
-		{
-			std::rotate(this->sortedMeshes.begin(), this->sortedMeshes.begin() + i, this->sortedMeshes.begin() + (i + 1));
-			//std::rotate(this->sortedMeshes.rend() - i, this->sortedMeshes.rend() - i, this->sortedMeshes.rend() - 0);
-		}
-		this->transparentEnd += changedAlphaValues.size(); // Make sure we update our transparent end index
+		SubmitMesh(this->meshVec[item.index], true);
 	}
 
+	this->renderQueue.Flush(this->debugMode);
+	GLState::SetBlend(false);
+
 	std::unordered_map<UUID, Ref<SceneLight>>::iterator it = lights.begin();
 	while (it != lights.end())
 	{
@@ -401,29 +397,30 @@ void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
 		if (debugMode)
 		{
 			glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(light->light->position));
+			const glm::vec4& atten = light->light->attenuation;
 			{
-				float distTo95Percent = Light::CalcApproxDistFromAtten(0.95f, 0.01, 10000.0f, light->light->attenuation.x, light->light->attenuation.y, light->light->attenuation.z, 50);
+				float distTo95Percent = Light::CalcDistFromAtten(0.95f, atten.x, atten.y, atten.z);
 				glm::mat4 transform(1.0f);
 				transform *= translate;
 				transform *= glm::scale(glm::mat4(1.0f), glm::vec3(distTo95Percent, distTo95Percent, distTo95Percent));
 				Renderer::RenderMeshWithColorOverride(this->shader, this->lightMesh, transform, glm::vec3(1.0f, 0.0f, 0.0f), this->debugMode, true);
 			}
 			{
-				float distTo50Percent = Light::CalcApproxDistFromAtten(0.5f, 0.01, 10000.0f, light->light->attenuation.x, light->light->attenuation.y, light->light->attenuation.z, 50);
+				float distTo50Percent = Light::CalcDistFromAtten(0.5f, atten.x, atten.y, atten.z);
 				glm::mat4 transform(1.0f);
 				transform *= translate;
 				transform *= glm::scale(glm::mat4(1.0f), glm::vec3(distTo50Percent, distTo50Percent, distTo50Percent));
 				Renderer::RenderMeshWithColorOverride(this->shader, this->lightMesh, transform, glm::vec3(1.0f, 1.0f, 0.0f), this->debugMode, true);
 			}
 			{
-				float distTo25Percent = Light::CalcApproxDistFromAtten(0.25f, 0.01, 10000.0f, light->light->attenuation.x, light->light->attenuation.y, light->light->attenuation.z, 50);
+				float distTo25Percent = Light::CalcDistFromAtten(0.25f, atten.x, atten.y, atten.z);
 				glm::mat4 transform(1.0f);
 				transform *= translate;
 				transform *= glm::scale(glm::mat4(1.0f), glm::vec3(distTo25Percent, distTo25Percent, distTo25Percent));
 				Renderer::RenderMeshWithColorOverride(this->shader, this->lightMesh, transform, glm::vec3(0.0f, 1.0f, 0.0f), this->debugMode, true);
 			}
 			{
-				float distTo5Percent = Light::CalcApproxDistFromAtten(0.25f, 0.01, 10000.0f, light->light->attenuation.x, light->light->attenuation.y, light->light->attenuation.z, 50);
+				float distTo5Percent = Light::CalcDistFromAtten(0.05f, atten.x, atten.y, atten.z);
 				glm::mat4 transform(1.0f);
 				transform *= translate;
 				transform *= glm::scale(glm::mat4(1.0f), glm::vec3(distTo5Percent, distTo5Percent, distTo5Percent));
@@ -440,44 +437,140 @@ void Scene::OnUpdate(Ref<Camera> camera, float deltaTime)
 	scenePanel.OnUpdate(deltaTime);
 }
 
+Ref<SceneMeshData> Scene::GetMeshByTransform(TransformID id) const
+{
+	std::unordered_map<TransformID, Ref<SceneMeshData>>::const_iterator it = this->meshesByTransform.find(id);
+	return it != this->meshesByTransform.end() ? it->second : nullptr;
+}
+
+void Scene::RasterizeOccluders()
+{
+	for (const Ref<SceneMeshData>& meshData : this->meshVec)
+	{
+		if (!meshData->isOccluder || !this->frustumCuller.IsVisible(meshData->GetTransformID()) || meshData->IsTransparent())
+		{
+			continue;
+		}
+
+		// Anything that cuts holes in the surface or moves it can't be trusted to hide what's behind it
+		bool solid = true;
+		for (const Ref<SceneTextureData>& textureData : meshData->textures)
+		{
+			TextureType type = textureData->texture->GetType();
+			solid &= type != TextureType::Discard && type != TextureType::Heightmap && type != TextureType::Alpha;
+		}
+
+		if (solid)
+		{
+			this->occlusionCuller.AddOccluder(meshData->mesh, meshData->GetWorldMatrix());
+		}
+	}
+
+	this->occlusionCuller.Rasterize();
+}
+
+void Scene::SubmitMesh(const Ref<SceneMeshData>& meshData, bool transparent)
+{
+	const glm::mat4& transform = meshData->GetWorldMatrix();
+	if (meshData == this->scenePanel.GetEditMesh() && this->showCurrentEdit)
+	{
+		Renderer::RenderMeshWithColorOverride(shader, meshData->mesh, transform, glm::vec3(0.0f, 1.0f, 0.0f), this->debugMode, true, meshData->lod);
+	}
+	else // Sorted by state and drawn in batches once everything is submitted
+	{
+		ObjectLights lights;
+		if (Renderer::IsPerObjectLights())
+		{
+			lights = this->lightGrid.Query(meshData->GetWorldBounds());
+		}
+
+		this->renderQueue.Submit(shader, meshData->mesh, meshData->textures, transform, meshData->GetNormalMatrix(), meshData->alphaTransparency, transparent, meshData->lod, lights);
+	}
+}
+
+bool Scene::IsCulled(const Ref<SceneMeshData>& meshData)
+{
+	if (!this->frustumCuller.IsVisible(meshData->GetTransformID()))
+	{
+		return true;
+	}
+
+	return Renderer::IsOcclusionCulling() && this->occlusionCuller.IsOccluded(meshData->GetWorldBounds());
+}
+
+uint32_t Scene::SelectLOD(const Ref<SceneMeshData>& meshData, const glm::vec3& cameraPosition) const
+{
+	const Ref<Mesh>& mesh = meshData->mesh;
+	uint32_t lodCount = mesh->GetLODCount();
+	if (lodCount <= 1)
+	{
+		return 0;
+	}
+
+	// Project the mesh's bounding box diagonal onto the screen. LOD errors are stored relative to that diagonal.
+	const AABB& bounds = mesh->GetBoundingBox();
+	glm::vec3 scale = meshData->GetScale();
+	float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+	float diagonal = glm::length(bounds.max - bounds.min) * maxScale;
+
+	// Measured to the nearest point of the world bounds, the origin can be far from the geometry of a mesh that wasn't modelled around it
+	AABB worldBounds = meshData->GetWorldBounds();
+	glm::vec3 nearest = glm::clamp(cameraPosition, worldBounds.min, worldBounds.max);
+	float distance = std::max(glm::length(cameraPosition - nearest), Renderer::GetNearPlane()); // Clamped to the near plane
+	float diagonalPixels = diagonal * Renderer::GetViewportHeight() / (2.0f * distance * tan(Renderer::GetFieldOfView() * 0.5f));
+
+	uint32_t lod = std::min(meshData->lod, lodCount - 1);
+	while (lod > 0 && mesh->GetLODError(lod) * diagonalPixels > this->lodPixelError * (1.0f + this->lodHysteresis)) // Too coarse, step finer
+	{
+		lod--;
+	}
+
+	while (lod + 1 < lodCount && mesh->GetLODError(lod + 1) * diagonalPixels < this->lodPixelError * (1.0f - this->lodHysteresis)) // Next level is still fine, step coarser
+	{
+		lod++;
+	}
+
+	return lod;
+}
+
 void Scene::NextMesh()
 {
-	if (this->sortedMeshes.empty())
+	if (this->meshVec.empty())
 	{
 		this->scenePanel.SetMeshData(NULL);
 		return;
 	}
 
-	this->currentMeshIndex = std::min(this->currentMeshIndex + 1, (int)(this->sortedMeshes.size() - 1));
-	this->scenePanel.SetMeshData(sortedMeshes[currentMeshIndex]);
+	this->currentMeshIndex = std::min(this->currentMeshIndex + 1, (int)(this->meshVec.size() - 1));
+	this->scenePanel.SetMeshData(meshVec[currentMeshIndex]);
 }
 
 void Scene::PreviousMesh()
 {
-	if (this->sortedMeshes.empty())
+	if (this->meshVec.empty())
 	{
 		this->scenePanel.SetMeshData(NULL);
 		return;
 	}
 
 	this->currentMeshIndex = std::max(this->currentMeshIndex - 1, 0);
-	this->scenePanel.SetMeshData(sortedMeshes[currentMeshIndex]);
+	this->scenePanel.SetMeshData(meshVec[currentMeshIndex]);
 }
 
 void Scene::LastMesh()
 {
-	if (this->sortedMeshes.empty())
+	if (this->meshVec.empty())
 	{
 		this->scenePanel.SetMeshData(NULL);
 		return;
 	}
 
-	this->currentMeshIndex = this->sortedMeshes.size() - 1;
+	this->currentMeshIndex = this->meshVec.size() - 1;
 }
 
 void Scene::FirstMesh()
 {
-	if (this->sortedMeshes.empty())
+	if (this->meshVec.empty())
 	{
 		this->scenePanel.SetMeshData(NULL);
 		return;
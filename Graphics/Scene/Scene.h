@@ -8,6 +8,12 @@
 #include "ScenePanel.h"
 #include "SceneLight.h"
 #include "DiffuseTexture.h"
+#include "RenderQueue.h"
+#include "FrustumCuller.h"
+#include "SceneBVH.h"
+#include "OcclusionCuller.h"
+#include "LightClusters.h"
+#include "LightGrid.h"
 
 #include <glm/glm.hpp>
 
@@ -43,14 +49,50 @@ public:
 	void StartMossSpread();
 	void StartNightCycle();
 
+	// Visible and culled mesh counts of the last frame
+	inline const FrustumCuller& GetFrustumCuller() const { return this->frustumCuller; }
+	inline const OcclusionCuller& GetOcclusionCuller() const { return this->occlusionCuller; }
+	inline const LightClusters& GetLightClusters() const { return this->lightClusters; }
+	inline const LightGrid& GetLightGrid() const { return this->lightGrid; }
+
+	// Spatial queries over the world bounds of every mesh, as of the last OnUpdate(). Results are TransformIDs, GetMeshByTransform() turns them back into meshes.
+	inline const SceneBVH& GetBVH() const { return this->bvh; }
+	Ref<SceneMeshData> GetMeshByTransform(TransformID id) const;
+
 	bool showCurrentEdit;
 	bool debugMode;
 	Ref<Camera> camera;
 
+	float lodPixelError; // How many pixels of simplification error we accept on screen before switching to a finer LOD
+	float lodHysteresis; // Fraction around lodPixelError where a mesh keeps its current LOD, so it doesn't flicker between two
+
 private:
+	// Picks the coarsest LOD whose projected error stays within lodPixelError
+	uint32_t SelectLOD(const Ref<SceneMeshData>& meshData, const glm::vec3& cameraPosition) const;
+
+	// Rasterizes the opaque occluders that made it through frustum culling
+	void RasterizeOccluders();
+
+	// Outside the view frustum or behind the occluders
+	bool IsCulled(const Ref<SceneMeshData>& meshData);
+
+	// Draws the mesh highlighted if it's the one being edited, otherwise queues it with the lights that reach it most
+	void SubmitMesh(const Ref<SceneMeshData>& meshData, bool transparent);
+
 	std::unordered_map<UUID, Ref<SceneMeshData>> meshes;
-	std::vector<Ref<SceneMeshData>> sortedMeshes;
-	int transparentEnd;
+	std::vector<Ref<SceneMeshData>> meshVec; // In the order they were added, for stepping through them in the editor
+	std::unordered_map<TransformID, Ref<SceneMeshData>> meshesByTransform;
+
+	// The visible transparent meshes of the frame, rebuilt every frame. Keyed by the inverted view depth of their bounds centers and radix sorted back to front.
+	std::vector<RenderQueue::SortItem> transparentItems; // Indices into meshVec
+	std::vector<RenderQueue::SortItem> transparentScratch;
+
+	RenderQueue renderQueue;
+	FrustumCuller frustumCuller;
+	OcclusionCuller occlusionCuller;
+	SceneBVH bvh;
+	LightClusters lightClusters;
+	LightGrid lightGrid; // Only built while Renderer::IsPerObjectLights()
 
 	int currentMeshIndex;
 	int currentLightIndex;
@@ -63,8 +105,6 @@ private:
 
 	Ref<Mesh> lightMesh;
 
-	static const unsigned int MAX_LIGHTS = 100; // This must match the value in the fragment shader
-
 	ScenePanel scenePanel;
 
 	Ref<DiffuseTexture> vineTexture;
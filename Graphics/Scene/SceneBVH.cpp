@@ -0,0 +1,613 @@
+#include "SceneBVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+
+namespace
+{
+	enum class Overlap
+	{
+		Outside,
+		Partial,
+		Inside // Everything under the node passes without being tested
+	};
+
+	void GetWorldBounds(TransformID id, glm::vec3& min, glm::vec3& max)
+	{
+		const BoundsArrays& bounds = TransformComponent::GetWorldBoundsArrays();
+		glm::vec3 center(bounds.centerX[id], bounds.centerY[id], bounds.centerZ[id]);
+		glm::vec3 extent(bounds.extentX[id], bounds.extentY[id], bounds.extentZ[id]);
+		min = center - extent;
+		max = center + extent;
+	}
+
+	// Half the surface area, empty boxes have none
+	float GetArea(const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 size = max - min;
+		if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f)
+		{
+			return 0.0f;
+		}
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	Overlap TestFrustum(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+	{
+		Overlap result = Overlap::Inside;
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& plane = frustum.planes[i];
+
+			// Furthest corner along the normal decides whether it's outside, the nearest one whether it's all the way in
+			glm::vec3 furthest(plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z);
+			glm::vec3 nearest(plane.x > 0.0f ? min.x : max.x, plane.y > 0.0f ? min.y : max.y, plane.z > 0.0f ? min.z : max.z);
+			if (glm::dot(glm::vec3(plane), furthest) + plane.w < 0.0f)
+			{
+				return Overlap::Outside;
+			}
+			if (glm::dot(glm::vec3(plane), nearest) + plane.w < 0.0f)
+			{
+				result = Overlap::Partial;
+			}
+		}
+		return result;
+	}
+
+	Overlap TestSphere(const glm::vec3& center, float radius, const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 closest = glm::clamp(center, min, max) - center;
+		if (glm::dot(closest, closest) > radius * radius)
+		{
+			return Overlap::Outside;
+		}
+
+		glm::vec3 furthest = glm::max(glm::abs(min - center), glm::abs(max - center));
+		return glm::dot(furthest, furthest) <= radius * radius ? Overlap::Inside : Overlap::Partial;
+	}
+
+	Overlap TestAABB(const AABB& box, const glm::vec3& min, const glm::vec3& max)
+	{
+		if (max.x < box.min.x || max.y < box.min.y || max.z < box.min.z || min.x > box.max.x || min.y > box.max.y || min.z > box.max.z)
+		{
+			return Overlap::Outside;
+		}
+
+		bool inside = min.x >= box.min.x && min.y >= box.min.y && min.z >= box.min.z && max.x <= box.max.x && max.y <= box.max.y && max.z <= box.max.z;
+		return inside ? Overlap::Inside : Overlap::Partial;
+	}
+
+	// Slab test, entry is where the ray enters the box (0 if it starts inside)
+	bool TestRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const glm::vec3& min, const glm::vec3& max, float& entry)
+	{
+		glm::vec3 t0 = (min - origin) * inverseDirection;
+		glm::vec3 t1 = (max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		return entry <= exit;
+	}
+}
+
+SceneBVH::SceneBVH()
+	: removedSinceBuild(0)
+{
+
+}
+
+SceneBVH::~SceneBVH()
+{
+	if (this->rebuild.valid()) // The build only holds its own copies, but don't leave it running for nothing
+	{
+		this->rebuild.wait();
+	}
+}
+
+void SceneBVH::Insert(TransformID id)
+{
+	if (id >= this->members.size())
+	{
+		this->members.resize(id + 1, 0);
+	}
+
+	if (this->members[id])
+	{
+		return;
+	}
+	this->members[id] = 1;
+
+	if (this->tree && id < this->tree->itemLeaves.size() && this->tree->itemLeaves[id] != Invalid) // Removed and added back before a rebuild, its old leaf still has it
+	{
+		for (uint32_t node = this->tree->itemLeaves[id]; node != Invalid && RefitNode(node); node = this->tree->parents[node]);
+		this->removedSinceBuild--;
+		return;
+	}
+
+	this->pending.push_back(id);
+}
+
+void SceneBVH::Remove(TransformID id)
+{
+	if (!IsMember(id))
+	{
+		return;
+	}
+	this->members[id] = 0;
+
+	std::vector<TransformID>::iterator it = std::find(this->pending.begin(), this->pending.end(), id);
+	if (it != this->pending.end())
+	{
+		this->pending.erase(it);
+	}
+	else
+	{
+		this->removedSinceBuild++;
+	}
+}
+
+void SceneBVH::Update()
+{
+	if (this->rebuild.valid() && this->rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		SwapIn(this->rebuild.get());
+	}
+
+	if (!this->tree)
+	{
+		if (!this->pending.empty()) // First build, nothing to query in the meantime so don't wait for a worker
+		{
+			Build();
+		}
+		return;
+	}
+
+	// Refit from each moved item's leaf upwards, stopping once a node comes out the same
+	const std::vector<uint32_t>& itemLeaves = this->tree->itemLeaves;
+	for (TransformID id : TransformComponent::GetUpdated())
+	{
+		if (id < itemLeaves.size() && itemLeaves[id] != Invalid && IsMember(id))
+		{
+			for (uint32_t node = itemLeaves[id]; node != Invalid && RefitNode(node); node = this->tree->parents[node]);
+		}
+	}
+
+	if (this->rebuild.valid())
+	{
+		return;
+	}
+
+	size_t itemCount = this->tree->items.size();
+	bool tooManyPending = this->pending.size() > std::max<size_t>(64, itemCount / 8);
+	bool tooManyRemoved = this->removedSinceBuild > std::max<size_t>(64, itemCount / 4);
+	if (GetQuality() > RebuildThreshold || tooManyPending || tooManyRemoved)
+	{
+		std::vector<BuildItem> items;
+		Snapshot(items); // The pending items stay in the list until the new tree is swapped in
+		this->rebuild = ThreadPool::Get().Submit([items = std::move(items)]() mutable { return BuildTree(std::move(items)); });
+	}
+}
+
+void SceneBVH::Build()
+{
+	if (this->rebuild.valid()) // Its snapshot is older than what we're about to take
+	{
+		this->rebuild.get();
+	}
+
+	std::vector<BuildItem> items;
+	Snapshot(items);
+	SwapIn(BuildTree(std::move(items)));
+}
+
+void SceneBVH::QueryFrustum(const Frustum& frustum, std::vector<TransformID>& results) const
+{
+	Traverse([&frustum](const glm::vec3& min, const glm::vec3& max) { return TestFrustum(frustum, min, max); },
+		[&frustum](TransformID id) { glm::vec3 min, max; GetWorldBounds(id, min, max); return TestFrustum(frustum, min, max) != Overlap::Outside; },
+		results);
+}
+
+void SceneBVH::QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<TransformID>& results) const
+{
+	glm::vec3 inverseDirection = 1.0f / direction;
+	std::vector<std::pair<float, TransformID>> hits;
+	Traverse([&](const glm::vec3& min, const glm::vec3& max) { float entry; return TestRay(origin, inverseDirection, maxDistance, min, max, entry) ? Overlap::Partial : Overlap::Outside; },
+		[&](TransformID id)
+		{
+			glm::vec3 min, max;
+			GetWorldBounds(id, min, max);
+			float entry;
+			if (TestRay(origin, inverseDirection, maxDistance, min, max, entry))
+			{
+				hits.push_back(std::make_pair(entry, id));
+			}
+			return false; // Added below once sorted
+		},
+		results);
+
+	std::sort(hits.begin(), hits.end());
+	for (const std::pair<float, TransformID>& hit : hits)
+	{
+		results.push_back(hit.second);
+	}
+}
+
+void SceneBVH::QuerySphere(const glm::vec3& center, float radius, std::vector<TransformID>& results) const
+{
+	Traverse([&](const glm::vec3& min, const glm::vec3& max) { return TestSphere(center, radius, min, max); },
+		[&](TransformID id) { glm::vec3 min, max; GetWorldBounds(id, min, max); return TestSphere(center, radius, min, max) != Overlap::Outside; },
+		results);
+}
+
+void SceneBVH::QueryAABB(const AABB& box, std::vector<TransformID>& results) const
+{
+	Traverse([&box](const glm::vec3& min, const glm::vec3& max) { return TestAABB(box, min, max); },
+		[&box](TransformID id) { glm::vec3 min, max; GetWorldBounds(id, min, max); return TestAABB(box, min, max) != Overlap::Outside; },
+		results);
+}
+
+float SceneBVH::GetQuality() const
+{
+	if (!this->tree || this->tree->builtCost <= 0.0f)
+	{
+		return 1.0f;
+	}
+
+	const Node& root = this->tree->nodes[0];
+	float rootArea = GetArea(root.min, root.max);
+	return rootArea > 0.0f ? (this->tree->cost / rootArea) / this->tree->builtCost : 1.0f;
+}
+
+Ref<SceneBVH::Tree> SceneBVH::BuildTree(std::vector<BuildItem> items)
+{
+	if (items.empty())
+	{
+		return nullptr;
+	}
+
+	Ref<Tree> tree = CreateRef<Tree>();
+	uint32_t itemCount = (uint32_t)items.size();
+
+	tree->nodes.reserve(itemCount * 2 - 1);
+	tree->parents.reserve(tree->nodes.capacity());
+
+	Node root;
+	root.leftFirst = 0;
+	root.count = itemCount;
+	tree->nodes.push_back(root);
+	tree->parents.push_back(Invalid);
+
+	// Items are partitioned in place so every pass over a node reads them in order
+	std::vector<uint32_t> stack(1, 0);
+	while (!stack.empty())
+	{
+		uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+
+		// Bounds of the items and of their centers, splits are picked along the centers
+		uint32_t first = tree->nodes[nodeIndex].leftFirst;
+		uint32_t count = tree->nodes[nodeIndex].count;
+		glm::vec3 nodeMin(FLT_MAX), nodeMax(-FLT_MAX), centerMin(FLT_MAX), centerMax(-FLT_MAX);
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const BuildItem& item = items[i];
+			nodeMin = glm::min(nodeMin, item.min);
+			nodeMax = glm::max(nodeMax, item.max);
+			centerMin = glm::min(centerMin, item.min + item.max); // Centers are kept doubled, only their order matters
+			centerMax = glm::max(centerMax, item.min + item.max);
+		}
+		tree->nodes[nodeIndex].min = nodeMin;
+		tree->nodes[nodeIndex].max = nodeMax;
+
+		if (count <= 2)
+		{
+			continue;
+		}
+
+		// Binned SAH, all three axes binned in the same pass over the items
+		glm::vec3 binScale;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float axisExtent = centerMax[axis] - centerMin[axis];
+			binScale[axis] = axisExtent > 0.0f ? BinCount / axisExtent : 0.0f;
+		}
+
+		uint32_t binCounts[3][BinCount] = {};
+		glm::vec3 binMins[3][BinCount], binMaxs[3][BinCount];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			for (uint32_t bin = 0; bin < BinCount; bin++)
+			{
+				binMins[axis][bin] = glm::vec3(FLT_MAX);
+				binMaxs[axis][bin] = glm::vec3(-FLT_MAX);
+			}
+		}
+
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const BuildItem& item = items[i];
+			glm::vec3 center = item.min + item.max;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				uint32_t bin = std::min((uint32_t)((center[axis] - centerMin[axis]) * binScale[axis]), BinCount - 1);
+				binCounts[axis][bin]++;
+				binMins[axis][bin] = glm::min(binMins[axis][bin], item.min);
+				binMaxs[axis][bin] = glm::max(binMaxs[axis][bin], item.max);
+			}
+		}
+
+		// Traversal costs 1, testing an item costs 1
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		uint32_t bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (binScale[axis] == 0.0f)
+			{
+				continue;
+			}
+
+			// Sweep from the right to get the cost of everything past each split, then from the left
+			float rightCosts[BinCount];
+			glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+			uint32_t sweepCount = 0;
+			for (uint32_t bin = BinCount - 1; bin > 0; bin--)
+			{
+				sweepMin = glm::min(sweepMin, binMins[axis][bin]);
+				sweepMax = glm::max(sweepMax, binMaxs[axis][bin]);
+				sweepCount += binCounts[axis][bin];
+				rightCosts[bin] = GetArea(sweepMin, sweepMax) * sweepCount;
+			}
+
+			sweepMin = glm::vec3(FLT_MAX);
+			sweepMax = glm::vec3(-FLT_MAX);
+			sweepCount = 0;
+			for (uint32_t split = 1; split < BinCount; split++) // Bins [0, split) go left
+			{
+				sweepMin = glm::min(sweepMin, binMins[axis][split - 1]);
+				sweepMax = glm::max(sweepMax, binMaxs[axis][split - 1]);
+				sweepCount += binCounts[axis][split - 1];
+				if (sweepCount == 0 || sweepCount == count)
+				{
+					continue;
+				}
+
+				float cost = GetArea(sweepMin, sweepMax) * sweepCount + rightCosts[split];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		float nodeArea = GetArea(nodeMin, nodeMax);
+		bestCost = nodeArea > 0.0f ? 1.0f + bestCost / nodeArea : FLT_MAX;
+		uint32_t middle;
+		if (bestAxis != -1 && (bestCost < count || count > MaxLeafSize))
+		{
+			float axisMin = centerMin[bestAxis];
+			float axisScale = binScale[bestAxis];
+			middle = (uint32_t)(std::partition(items.begin() + first, items.begin() + first + count, [&](const BuildItem& item)
+			{
+				return std::min((uint32_t)((item.min[bestAxis] + item.max[bestAxis] - axisMin) * axisScale), BinCount - 1) < bestSplit;
+			}) - items.begin());
+		}
+		else if (count > MaxLeafSize) // Every center in the same spot, split down the middle so leaves stay small
+		{
+			middle = first + count / 2;
+		}
+		else
+		{
+			continue; // Cheaper as a leaf
+		}
+
+		uint32_t left = (uint32_t)tree->nodes.size();
+		Node child;
+		child.leftFirst = first;
+		child.count = middle - first;
+		tree->nodes.push_back(child);
+		child.leftFirst = middle;
+		child.count = first + count - middle;
+		tree->nodes.push_back(child);
+		tree->parents.push_back(nodeIndex);
+		tree->parents.push_back(nodeIndex);
+
+		tree->nodes[nodeIndex].leftFirst = left;
+		tree->nodes[nodeIndex].count = 0;
+		stack.push_back(left);
+		stack.push_back(left + 1);
+	}
+
+	TransformID maxID = 0;
+	tree->items.resize(itemCount);
+	for (uint32_t i = 0; i < itemCount; i++)
+	{
+		tree->items[i] = items[i].id;
+		maxID = std::max(maxID, items[i].id);
+	}
+
+	tree->itemLeaves.assign(maxID + 1, Invalid);
+	tree->cost = 0.0f;
+	for (uint32_t nodeIndex = 0; nodeIndex < tree->nodes.size(); nodeIndex++)
+	{
+		const Node& node = tree->nodes[nodeIndex];
+		tree->cost += GetArea(node.min, node.max) * (node.count > 0 ? node.count : 1);
+		for (uint32_t i = node.leftFirst; node.count > 0 && i < node.leftFirst + node.count; i++)
+		{
+			tree->itemLeaves[tree->items[i]] = nodeIndex;
+		}
+	}
+
+	float rootArea = GetArea(tree->nodes[0].min, tree->nodes[0].max);
+	tree->builtCost = rootArea > 0.0f ? tree->cost / rootArea : 0.0f;
+	return tree;
+}
+
+void SceneBVH::Snapshot(std::vector<BuildItem>& items)
+{
+	items.clear();
+	if (this->tree)
+	{
+		for (TransformID id : this->tree->items)
+		{
+			if (IsMember(id))
+			{
+				items.push_back(BuildItem{ glm::vec3(0.0f), id, glm::vec3(0.0f) });
+			}
+		}
+	}
+	for (TransformID id : this->pending)
+	{
+		items.push_back(BuildItem{ glm::vec3(0.0f), id, glm::vec3(0.0f) });
+	}
+
+	for (BuildItem& item : items)
+	{
+		GetWorldBounds(item.id, item.min, item.max);
+	}
+}
+
+void SceneBVH::SwapIn(Ref<Tree> newTree)
+{
+	this->tree = newTree;
+
+	// Whatever was added or removed while it was building: removed items are still in the tree, added ones go in the pending list
+	this->pending.clear();
+	for (TransformID id = 0; id < this->members.size(); id++)
+	{
+		if (this->members[id] && (!this->tree || id >= this->tree->itemLeaves.size() || this->tree->itemLeaves[id] == Invalid))
+		{
+			this->pending.push_back(id);
+		}
+	}
+
+	this->removedSinceBuild = 0;
+	if (!this->tree)
+	{
+		return;
+	}
+
+	for (TransformID id : this->tree->items)
+	{
+		if (!IsMember(id))
+		{
+			this->removedSinceBuild++;
+		}
+	}
+
+	RefitAll(); // Anything could have moved since the snapshot
+}
+
+void SceneBVH::RefitAll()
+{
+	for (uint32_t nodeIndex = (uint32_t)this->tree->nodes.size(); nodeIndex-- > 0;) // Children always come after their parent
+	{
+		RefitNode(nodeIndex);
+	}
+
+	// Recount from scratch so the incremental updates don't drift
+	this->tree->cost = 0.0f;
+	for (const Node& node : this->tree->nodes)
+	{
+		this->tree->cost += GetArea(node.min, node.max) * (node.count > 0 ? node.count : 1);
+	}
+}
+
+bool SceneBVH::RefitNode(uint32_t nodeIndex)
+{
+	Node& node = this->tree->nodes[nodeIndex];
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX); // Stays inverted if every item in a leaf was removed, which no query can hit
+	if (node.count == 0)
+	{
+		const Node& left = this->tree->nodes[node.leftFirst];
+		const Node& right = this->tree->nodes[node.leftFirst + 1];
+		min = glm::min(left.min, right.min);
+		max = glm::max(left.max, right.max);
+	}
+	else
+	{
+		for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+		{
+			TransformID id = this->tree->items[i];
+			if (IsMember(id))
+			{
+				glm::vec3 itemMin, itemMax;
+				GetWorldBounds(id, itemMin, itemMax);
+				min = glm::min(min, itemMin);
+				max = glm::max(max, itemMax);
+			}
+		}
+	}
+
+	if (min == node.min && max == node.max)
+	{
+		return false;
+	}
+
+	this->tree->cost += (GetArea(min, max) - GetArea(node.min, node.max)) * (node.count > 0 ? node.count : 1);
+	node.min = min;
+	node.max = max;
+	return true;
+}
+
+template<typename NodeTest, typename ItemTest>
+void SceneBVH::Traverse(NodeTest nodeTest, ItemTest itemTest, std::vector<TransformID>& results) const
+{
+	if (this->tree)
+	{
+		std::vector<std::pair<uint32_t, bool>> stack; // Node, whether an ancestor was found to be fully inside
+		stack.reserve(64);
+		stack.push_back(std::make_pair(0u, false));
+		while (!stack.empty())
+		{
+			uint32_t nodeIndex = stack.back().first;
+			bool inside = stack.back().second;
+			stack.pop_back();
+
+			const Node& node = this->tree->nodes[nodeIndex];
+			if (node.min.x > node.max.x) // Emptied by removals
+			{
+				continue;
+			}
+
+			if (!inside)
+			{
+				Overlap overlap = nodeTest(node.min, node.max);
+				if (overlap == Overlap::Outside)
+				{
+					continue;
+				}
+				inside = overlap == Overlap::Inside;
+			}
+
+			if (node.count == 0)
+			{
+				stack.push_back(std::make_pair(node.leftFirst, inside));
+				stack.push_back(std::make_pair(node.leftFirst + 1, inside));
+				continue;
+			}
+
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+			{
+				TransformID id = this->tree->items[i];
+				if (IsMember(id) && (inside || itemTest(id)))
+				{
+					results.push_back(id);
+				}
+			}
+		}
+	}
+
+	for (TransformID id : this->pending)
+	{
+		if (itemTest(id))
+		{
+			results.push_back(id);
+		}
+	}
+}
\ No newline at end of file
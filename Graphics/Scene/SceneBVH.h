@@ -0,0 +1,103 @@
+#pragma once
+
+#include "pch.h"
+#include "AABB.h"
+#include "Frustum.h"
+#include "TransformComponent.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <future>
+
+// Bounding volume hierarchy over the world bounds of TransformComponent entities.
+// Built top down with binned SAH, refit bottom up every Update() for the entities that moved, and rebuilt on a worker thread once refitting has made it too loose.
+// Queries return TransformIDs and see the bounds as of the last Update().
+class SceneBVH
+{
+public:
+	SceneBVH();
+	virtual ~SceneBVH();
+
+	// Entities added after the last build are kept in a list that every query scans, until the next rebuild folds them in
+	void Insert(TransformID id);
+	void Remove(TransformID id);
+
+	// Refits the nodes of everything TransformComponent::UpdateDirty() just rebuilt, swaps in a finished background build and starts a new one if needed.
+	// Call once per frame after UpdateDirty().
+	void Update();
+
+	// Rebuilds from scratch on the calling thread
+	void Build();
+
+	void QueryFrustum(const Frustum& frustum, std::vector<TransformID>& results) const;
+
+	// Everything whose bounds the ray enters within maxDistance, nearest entry first. direction doesn't need to be normalized, distances are in units of it.
+	void QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<TransformID>& results) const;
+
+	void QuerySphere(const glm::vec3& center, float radius, std::vector<TransformID>& results) const;
+	void QueryAABB(const AABB& box, std::vector<TransformID>& results) const;
+
+	inline size_t GetNodeCount() const { return this->tree ? this->tree->nodes.size() : 0; }
+	inline size_t GetPendingCount() const { return this->pending.size(); }
+	inline bool IsRebuilding() const { return this->rebuild.valid(); }
+
+	// SAH cost of the tree as it is now, relative to its cost right after it was built
+	float GetQuality() const;
+
+	static const uint32_t BinCount = 16;
+	static const uint32_t MaxLeafSize = 8;
+	static constexpr float RebuildThreshold = 1.5f; // Relative SAH cost past which a background rebuild starts
+
+private:
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t leftFirst; // Left child for interior nodes (the right one follows it), first item for leaves
+		glm::vec3 max;
+		uint32_t count; // 0 for interior nodes
+	};
+
+	struct Tree
+	{
+		std::vector<Node> nodes; // Root first
+		std::vector<uint32_t> parents;
+		std::vector<TransformID> items; // Leaves point into this
+		std::vector<uint32_t> itemLeaves; // TransformID -> leaf holding it, or Invalid
+		float cost; // Sum of area * (1 or item count) over all nodes, divide by root area for the SAH cost
+		float builtCost; // cost / root area at build time
+	};
+
+	struct BuildItem
+	{
+		glm::vec3 min;
+		TransformID id;
+		glm::vec3 max;
+	};
+
+	static constexpr uint32_t Invalid = 0xFFFFFFFF;
+
+	// Runs on any thread, only touches what it's given. Returns nullptr for no items.
+	static Ref<Tree> BuildTree(std::vector<BuildItem> items);
+
+	// Copies the current bounds of the tree's items and the pending ones so a build doesn't touch TransformComponent
+	void Snapshot(std::vector<BuildItem>& items);
+
+	void SwapIn(Ref<Tree> newTree);
+	void RefitAll();
+
+	// Recomputes a node from its children or items, returns whether it changed
+	bool RefitNode(uint32_t nodeIndex);
+
+	inline bool IsMember(TransformID id) const { return id < this->members.size() && this->members[id] != 0; }
+
+	template<typename NodeTest, typename ItemTest>
+	void Traverse(NodeTest nodeTest, ItemTest itemTest, std::vector<TransformID>& results) const;
+
+	Ref<Tree> tree;
+	std::vector<TransformID> pending;
+	std::vector<uint8_t> members; // TransformID -> whether it was inserted, leaves of removed items stay in the tree until the next rebuild
+	uint32_t removedSinceBuild;
+
+	std::future<Ref<Tree>> rebuild;
+};
\ No newline at end of file
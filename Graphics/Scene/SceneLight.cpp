@@ -45,12 +45,12 @@ Ref<SceneLight> SceneLight::StaticLoad(const YAML::Node& node)
 	light->position = position;
 	light->diffuse = diffuse;
 	light->specular = specular;
-	light->attenuation = attenuation;
 	light->direction = direction;
 	light->lightType = lightType;
 	light->outerAngle = outerAngle;
 	light->innerAngle = innerAngle;
 	light->state = state;
+	light->EditAttenuation(attenuation.x, attenuation.y, attenuation.z, attenuation.w);
 
 	Ref<SceneLight> sceneLight = CreateRef<SceneLight>(light);
 	sceneLight->uuid = uuid;
@@ -4,18 +4,24 @@
 
 SceneMeshData::SceneMeshData(Ref<Mesh> mesh)
 	: mesh(mesh), 
-	position(0.0f), 
-	orientation(0.0f, 0.0f, 0.0f), 
-	scale(1.0f, 1.0f, 1.0f), 
+	lod(0), 
 	alphaTransparency(1.0f),
-	hasAlphaTransparentTexture(false)
+	hasAlphaTransparentTexture(false),
+	isOccluder(false),
+	transform(TransformComponent::Create())
 {
+	if (mesh)
+	{
+		TransformComponent::SetLocalBounds(this->transform, mesh->GetBoundingBox()); // Culled with these from now on
 
+		std::string file = mesh->GetPath().substr(mesh->GetPath().find_last_of("\\/") + 1);
+		this->isOccluder = file.find("Wall") != std::string::npos || file.find("Floor") != std::string::npos;
+	}
 }
 
 SceneMeshData::~SceneMeshData()
 {
-	
+	TransformComponent::Destroy(this->transform);
 }
 
 void SceneMeshData::Save(YAML::Emitter& emitter) const
@@ -24,10 +30,11 @@ void SceneMeshData::Save(YAML::Emitter& emitter) const
 
 	emitter << YAML::Key << "UUID" << YAML::Value << this->uuid;
 	emitter << YAML::Key << "Path" << YAML::Value << SerializeUtils::SavePath(this->mesh->GetPath());
-	emitter << YAML::Key << "Position" << YAML::Value << this->position;
-	emitter << YAML::Key << "Orientation" << YAML::Value << this->orientation;
-	emitter << YAML::Key << "Scale" << YAML::Value << this->scale;
+	emitter << YAML::Key << "Position" << YAML::Value << GetPosition();
+	emitter << YAML::Key << "Orientation" << YAML::Value << GetOrientation();
+	emitter << YAML::Key << "Scale" << YAML::Value << GetScale();
 	emitter << YAML::Key << "AlphaTransparency" << YAML::Value << this->alphaTransparency;
+	emitter << YAML::Key << "Occluder" << YAML::Value << this->isOccluder;
 
 	emitter << YAML::Key << "Textures" << YAML::Value << YAML::BeginSeq;
 	for (const Ref<SceneTextureData>& textureData : this->textures)
@@ -60,10 +67,14 @@ Ref<SceneMeshData> SceneMeshData::StaticLoad(const YAML::Node& node)
 	}
 
 	meshData->uuid = node["UUID"].as<uint64_t>();
-	meshData->position = node["Position"].as<glm::vec3>();
-	meshData->orientation = node["Orientation"].as<glm::vec3>();
-	meshData->scale = node["Scale"].as<glm::vec3>();
+	meshData->SetPosition(node["Position"].as<glm::vec3>());
+	meshData->SetOrientation(node["Orientation"].as<glm::vec3>());
+	meshData->SetScale(node["Scale"].as<glm::vec3>());
 	meshData->alphaTransparency = node["AlphaTransparency"].as<float>();
+	if (node["Occluder"]) // Older scenes go by the default
+	{
+		meshData->isOccluder = node["Occluder"].as<bool>();
+	}
 	return meshData;
 }
 
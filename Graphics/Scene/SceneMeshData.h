@@ -5,6 +5,7 @@
 #include "Mesh.h"
 #include "Serializable.h"
 #include "SceneTextureData.h"
+#include "TransformComponent.h"
 
 #include <glm/glm.hpp>
 
@@ -12,6 +13,7 @@ class SceneMeshData
 {
 public:
 	SceneMeshData(Ref<Mesh> mesh);
+	SceneMeshData(const SceneMeshData&) = delete; // Would share the transform
 	virtual ~SceneMeshData();
 
 	virtual void Save(YAML::Emitter& emitter) const;
@@ -21,14 +23,35 @@ public:
 
 	static Ref<SceneMeshData> StaticLoad(const YAML::Node& node);
 
+	// The transform lives in TransformComponent, setting any part of it queues the matrices for a rebuild
+	inline glm::vec3 GetPosition() const { return TransformComponent::GetPosition(this->transform); }
+	inline glm::vec3 GetOrientation() const { return TransformComponent::GetOrientation(this->transform); }
+	inline glm::vec3 GetScale() const { return TransformComponent::GetScale(this->transform); }
+	inline void SetPosition(const glm::vec3& position) { TransformComponent::SetPosition(this->transform, position); }
+	inline void SetOrientation(const glm::vec3& orientation) { TransformComponent::SetOrientation(this->transform, orientation); }
+	inline void SetScale(const glm::vec3& scale) { TransformComponent::SetScale(this->transform, scale); }
+
+	// As of the last TransformComponent::UpdateDirty()
+	inline const glm::mat4& GetWorldMatrix() const { return TransformComponent::GetWorldMatrix(this->transform); }
+	inline const glm::mat3& GetNormalMatrix() const { return TransformComponent::GetNormalMatrix(this->transform); }
+	inline AABB GetWorldBounds() const { return TransformComponent::GetWorldBounds(this->transform); }
+	inline TransformID GetTransformID() const { return this->transform; }
+
 	UUID uuid;
 	Ref<Mesh> mesh;
-	glm::vec3 position;
-	glm::vec3 orientation;
-	glm::vec3 scale;
+
+	uint32_t lod; // Level of detail to draw with, picked every frame by the Scene
 
 	float alphaTransparency;
 	bool hasAlphaTransparentTexture;
 
+	// Decides which pass the mesh is drawn in, checked every frame so editing the alpha moves it either way
+	inline bool IsTransparent() const { return this->alphaTransparency < 1.0f || this->hasAlphaTransparentTexture; }
+
+	bool isOccluder; // Rasterized into the occlusion buffer to hide what's behind it. Defaults to walls and floors by file name.
+
 	std::vector<Ref<SceneTextureData>> textures;
+
+private:
+	TransformID transform;
 };
\ No newline at end of file
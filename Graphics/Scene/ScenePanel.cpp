@@ -31,26 +31,40 @@ void ScenePanel::OnUpdate(float deltaTime)
 		ImGui::Text(file.c_str());
 
 		ImGui::NewLine();
-		ImGui::DragFloat3("Position", (float*)&this->meshData->position);
+		glm::vec3 position = this->meshData->GetPosition();
+		if (ImGui::DragFloat3("Position", (float*)&position)) // Only touch the transform when it's actually edited so it isn't rebuilt every frame
+		{
+			this->meshData->SetPosition(position);
+		}
 
 		ImGui::NewLine();
-		ImGui::DragFloat3("Orientation", (float*)&this->meshData->orientation, 0.01f);
+		glm::vec3 orientation = this->meshData->GetOrientation();
+		if (ImGui::DragFloat3("Orientation", (float*)&orientation, 0.01f))
+		{
+			this->meshData->SetOrientation(orientation);
+		}
 
 		ImGui::NewLine();
-		ImGui::DragFloat3("Scale", (float*)&this->meshData->scale, 0.01f);
+		glm::vec3 scale = this->meshData->GetScale();
+		if (ImGui::DragFloat3("Scale", (float*)&scale, 0.01f))
+		{
+			this->meshData->SetScale(scale);
+		}
 
 		ImGui::NewLine();
 		ImGui::DragFloat("Alpha Transparency", (float*) &this->meshData->alphaTransparency, 0.01f, 0.0f, 1.0f);
+		ImGui::Checkbox("Occluder", &this->meshData->isOccluder);
 
 		ImGui::NewLine();
 		if(ImGui::Button("Duplicate"))
 		{
 			Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(this->meshData->mesh);
-			meshData->position = this->meshData->position;
-			meshData->orientation = this->meshData->orientation;
-			meshData->scale = this->meshData->scale;
+			meshData->SetPosition(this->meshData->GetPosition());
+			meshData->SetOrientation(this->meshData->GetOrientation());
+			meshData->SetScale(this->meshData->GetScale());
 			meshData->alphaTransparency = this->meshData->alphaTransparency;
 			meshData->hasAlphaTransparentTexture = this->meshData->hasAlphaTransparentTexture;
+			meshData->isOccluder = this->meshData->isOccluder;
 			for(const Ref<SceneTextureData>& textureData : this->meshData->textures)
 			{
 				Ref<SceneTextureData> duplicatedData = CreateRef<SceneTextureData>(textureData->texture, textureData->ratio, textureData->texCoordScale);
@@ -148,7 +162,11 @@ void ScenePanel::OnUpdate(float deltaTime)
 		ImGui::DragFloat4("Specular", (float*)&this->light->light->specular, 0.01f);
 
 		ImGui::NewLine();
-		ImGui::DragFloat4("Attenuation", (float*)&this->light->light->attenuation, 0.001f);
+		glm::vec4 attenuation = this->light->light->attenuation;
+		if (ImGui::DragFloat4("Attenuation", (float*)&attenuation, 0.001f))
+		{
+			this->light->light->EditAttenuation(attenuation.x, attenuation.y, attenuation.z, attenuation.w);
+		}
 
 		ImGui::NewLine();
 		ImGui::DragFloat4("Direction", (float*)&this->light->light->direction, 0.01f);
@@ -0,0 +1,262 @@
+#include "TransformComponent.h"
+
+#include <xmmintrin.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+std::vector<float> TransformComponent::positionX, TransformComponent::positionY, TransformComponent::positionZ;
+std::vector<float> TransformComponent::orientationX, TransformComponent::orientationY, TransformComponent::orientationZ;
+std::vector<float> TransformComponent::scaleX, TransformComponent::scaleY, TransformComponent::scaleZ;
+
+std::vector<glm::mat4> TransformComponent::worldMatrices;
+std::vector<glm::mat3> TransformComponent::normalMatrices;
+
+BoundsArrays TransformComponent::localBounds;
+BoundsArrays TransformComponent::worldBounds;
+
+std::vector<uint8_t> TransformComponent::alive;
+std::vector<uint8_t> TransformComponent::dirty;
+std::vector<TransformID> TransformComponent::dirtyList;
+std::vector<TransformID> TransformComponent::updated;
+std::vector<TransformID> TransformComponent::freeIDs;
+
+TransformID TransformComponent::Create(const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale)
+{
+	TransformID id;
+	if (!freeIDs.empty())
+	{
+		id = freeIDs.back();
+		freeIDs.pop_back();
+	}
+	else
+	{
+		id = (TransformID)positionX.size();
+		positionX.push_back(0.0f); positionY.push_back(0.0f); positionZ.push_back(0.0f);
+		orientationX.push_back(0.0f); orientationY.push_back(0.0f); orientationZ.push_back(0.0f);
+		scaleX.push_back(1.0f); scaleY.push_back(1.0f); scaleZ.push_back(1.0f);
+		worldMatrices.push_back(glm::mat4(1.0f));
+		normalMatrices.push_back(glm::mat3(1.0f));
+		for (BoundsArrays* bounds : { &localBounds, &worldBounds })
+		{
+			bounds->centerX.push_back(0.0f); bounds->centerY.push_back(0.0f); bounds->centerZ.push_back(0.0f);
+			bounds->extentX.push_back(0.0f); bounds->extentY.push_back(0.0f); bounds->extentZ.push_back(0.0f);
+		}
+		alive.push_back(0);
+		dirty.push_back(0);
+	}
+
+	positionX[id] = position.x; positionY[id] = position.y; positionZ[id] = position.z;
+	orientationX[id] = orientation.x; orientationY[id] = orientation.y; orientationZ[id] = orientation.z;
+	scaleX[id] = scale.x; scaleY[id] = scale.y; scaleZ[id] = scale.z;
+	localBounds.centerX[id] = 0.0f; localBounds.centerY[id] = 0.0f; localBounds.centerZ[id] = 0.0f;
+	localBounds.extentX[id] = 0.0f; localBounds.extentY[id] = 0.0f; localBounds.extentZ[id] = 0.0f;
+	alive[id] = 1;
+	MarkDirty(id);
+	return id;
+}
+
+void TransformComponent::Destroy(TransformID id)
+{
+	alive[id] = 0;
+	freeIDs.push_back(id); // If it's still in the dirty list it just gets rebuilt for nothing
+}
+
+glm::vec3 TransformComponent::GetPosition(TransformID id)
+{
+	return glm::vec3(positionX[id], positionY[id], positionZ[id]);
+}
+
+glm::vec3 TransformComponent::GetOrientation(TransformID id)
+{
+	return glm::vec3(orientationX[id], orientationY[id], orientationZ[id]);
+}
+
+glm::vec3 TransformComponent::GetScale(TransformID id)
+{
+	return glm::vec3(scaleX[id], scaleY[id], scaleZ[id]);
+}
+
+void TransformComponent::SetPosition(TransformID id, const glm::vec3& position)
+{
+	positionX[id] = position.x; positionY[id] = position.y; positionZ[id] = position.z;
+	MarkDirty(id);
+}
+
+void TransformComponent::SetOrientation(TransformID id, const glm::vec3& orientation)
+{
+	orientationX[id] = orientation.x; orientationY[id] = orientation.y; orientationZ[id] = orientation.z;
+	MarkDirty(id);
+}
+
+void TransformComponent::SetScale(TransformID id, const glm::vec3& scale)
+{
+	scaleX[id] = scale.x; scaleY[id] = scale.y; scaleZ[id] = scale.z;
+	MarkDirty(id);
+}
+
+void TransformComponent::SetLocalBounds(TransformID id, const AABB& bounds)
+{
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+	localBounds.centerX[id] = center.x; localBounds.centerY[id] = center.y; localBounds.centerZ[id] = center.z;
+	localBounds.extentX[id] = extent.x; localBounds.extentY[id] = extent.y; localBounds.extentZ[id] = extent.z;
+	MarkDirty(id);
+}
+
+AABB TransformComponent::GetWorldBounds(TransformID id)
+{
+	glm::vec3 center(worldBounds.centerX[id], worldBounds.centerY[id], worldBounds.centerZ[id]);
+	glm::vec3 extent(worldBounds.extentX[id], worldBounds.extentY[id], worldBounds.extentZ[id]);
+	return AABB(center - extent, center + extent);
+}
+
+void TransformComponent::UpdateDirty()
+{
+	updated.swap(dirtyList);
+	dirtyList.clear();
+	if (updated.empty())
+	{
+		return;
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= updated.size(); i += 4)
+	{
+		Rebuild(&updated[i]);
+	}
+
+	if (i < updated.size()) // Pad the last batch with the last entity
+	{
+		TransformID ids[4];
+		for (size_t j = 0; j < 4; j++)
+		{
+			ids[j] = updated[std::min(i + j, updated.size() - 1)];
+		}
+		Rebuild(ids);
+	}
+
+	for (TransformID id : updated)
+	{
+		dirty[id] = 0;
+	}
+}
+
+void TransformComponent::MarkDirty(TransformID id)
+{
+	if (!dirty[id])
+	{
+		dirty[id] = 1;
+		dirtyList.push_back(id);
+	}
+}
+
+void TransformComponent::Rebuild(const TransformID ids[4])
+{
+	// SSE has no sin/cos, those are done per entity
+	alignas(16) float sinX[4], cosX[4], sinY[4], cosY[4], sinZ[4], cosZ[4];
+	for (int i = 0; i < 4; i++)
+	{
+		sinX[i] = std::sin(orientationX[ids[i]]); cosX[i] = std::cos(orientationX[ids[i]]);
+		sinY[i] = std::sin(orientationY[ids[i]]); cosY[i] = std::cos(orientationY[ids[i]]);
+		sinZ[i] = std::sin(orientationZ[ids[i]]); cosZ[i] = std::cos(orientationZ[ids[i]]);
+	}
+
+	__m128 sx = _mm_load_ps(sinX), cx = _mm_load_ps(cosX);
+	__m128 sy = _mm_load_ps(sinY), cy = _mm_load_ps(cosY);
+	__m128 sz = _mm_load_ps(sinZ), cz = _mm_load_ps(cosZ);
+
+	// Rx * Ry * Rz, r<row><column>
+	__m128 sxsy = _mm_mul_ps(sx, sy);
+	__m128 cxsy = _mm_mul_ps(cx, sy);
+	__m128 r00 = _mm_mul_ps(cy, cz);
+	__m128 r01 = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(cy, sz));
+	__m128 r02 = sy;
+	__m128 r10 = _mm_add_ps(_mm_mul_ps(cx, sz), _mm_mul_ps(sxsy, cz));
+	__m128 r11 = _mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz));
+	__m128 r12 = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(sx, cy));
+	__m128 r20 = _mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz));
+	__m128 r21 = _mm_add_ps(_mm_mul_ps(sx, cz), _mm_mul_ps(cxsy, sz));
+	__m128 r22 = _mm_mul_ps(cx, cy);
+
+	__m128 scale0 = _mm_set_ps(scaleX[ids[3]], scaleX[ids[2]], scaleX[ids[1]], scaleX[ids[0]]);
+	__m128 scale1 = _mm_set_ps(scaleY[ids[3]], scaleY[ids[2]], scaleY[ids[1]], scaleY[ids[0]]);
+	__m128 scale2 = _mm_set_ps(scaleZ[ids[3]], scaleZ[ids[2]], scaleZ[ids[1]], scaleZ[ids[0]]);
+	__m128 inverseScale0 = _mm_div_ps(_mm_set1_ps(1.0f), scale0);
+	__m128 inverseScale1 = _mm_div_ps(_mm_set1_ps(1.0f), scale1);
+	__m128 inverseScale2 = _mm_div_ps(_mm_set1_ps(1.0f), scale2);
+
+	// Each row holds one matrix element for all four entities, transposing turns a group of four rows into one column per entity
+	__m128 world[4][4] = {
+		{ _mm_mul_ps(r00, scale0), _mm_mul_ps(r10, scale0), _mm_mul_ps(r20, scale0), _mm_setzero_ps() },
+		{ _mm_mul_ps(r01, scale1), _mm_mul_ps(r11, scale1), _mm_mul_ps(r21, scale1), _mm_setzero_ps() },
+		{ _mm_mul_ps(r02, scale2), _mm_mul_ps(r12, scale2), _mm_mul_ps(r22, scale2), _mm_setzero_ps() },
+		{
+			_mm_set_ps(positionX[ids[3]], positionX[ids[2]], positionX[ids[1]], positionX[ids[0]]),
+			_mm_set_ps(positionY[ids[3]], positionY[ids[2]], positionY[ids[1]], positionY[ids[0]]),
+			_mm_set_ps(positionZ[ids[3]], positionZ[ids[2]], positionZ[ids[1]], positionZ[ids[0]]),
+			_mm_set1_ps(1.0f)
+		}
+	};
+
+	__m128 normal[3][4] = {
+		{ _mm_mul_ps(r00, inverseScale0), _mm_mul_ps(r10, inverseScale0), _mm_mul_ps(r20, inverseScale0), _mm_setzero_ps() },
+		{ _mm_mul_ps(r01, inverseScale1), _mm_mul_ps(r11, inverseScale1), _mm_mul_ps(r21, inverseScale1), _mm_setzero_ps() },
+		{ _mm_mul_ps(r02, inverseScale2), _mm_mul_ps(r12, inverseScale2), _mm_mul_ps(r22, inverseScale2), _mm_setzero_ps() }
+	};
+
+	// World bounds while the elements are still one per register. Center goes through the full transform, the extents through the absolute values of the upper 3x3.
+	{
+		__m128 localCenter[3] = {
+			_mm_set_ps(localBounds.centerX[ids[3]], localBounds.centerX[ids[2]], localBounds.centerX[ids[1]], localBounds.centerX[ids[0]]),
+			_mm_set_ps(localBounds.centerY[ids[3]], localBounds.centerY[ids[2]], localBounds.centerY[ids[1]], localBounds.centerY[ids[0]]),
+			_mm_set_ps(localBounds.centerZ[ids[3]], localBounds.centerZ[ids[2]], localBounds.centerZ[ids[1]], localBounds.centerZ[ids[0]])
+		};
+		__m128 localExtent[3] = {
+			_mm_set_ps(localBounds.extentX[ids[3]], localBounds.extentX[ids[2]], localBounds.extentX[ids[1]], localBounds.extentX[ids[0]]),
+			_mm_set_ps(localBounds.extentY[ids[3]], localBounds.extentY[ids[2]], localBounds.extentY[ids[1]], localBounds.extentY[ids[0]]),
+			_mm_set_ps(localBounds.extentZ[ids[3]], localBounds.extentZ[ids[2]], localBounds.extentZ[ids[1]], localBounds.extentZ[ids[0]])
+		};
+
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		alignas(16) float center[3][4], extent[3][4];
+		for (int row = 0; row < 3; row++)
+		{
+			__m128 c = world[3][row];
+			__m128 e = _mm_setzero_ps();
+			for (int column = 0; column < 3; column++)
+			{
+				c = _mm_add_ps(c, _mm_mul_ps(world[column][row], localCenter[column]));
+				e = _mm_add_ps(e, _mm_mul_ps(_mm_andnot_ps(signMask, world[column][row]), localExtent[column]));
+			}
+			_mm_store_ps(center[row], c);
+			_mm_store_ps(extent[row], e);
+		}
+
+		for (int i = 0; i < 4; i++)
+		{
+			worldBounds.centerX[ids[i]] = center[0][i]; worldBounds.centerY[ids[i]] = center[1][i]; worldBounds.centerZ[ids[i]] = center[2][i];
+			worldBounds.extentX[ids[i]] = extent[0][i]; worldBounds.extentY[ids[i]] = extent[1][i]; worldBounds.extentZ[ids[i]] = extent[2][i];
+		}
+	}
+
+	for (int column = 0; column < 4; column++)
+	{
+		_MM_TRANSPOSE4_PS(world[column][0], world[column][1], world[column][2], world[column][3]);
+		for (int i = 0; i < 4; i++)
+		{
+			_mm_storeu_ps(&worldMatrices[ids[i]][column][0], world[column][i]);
+		}
+	}
+
+	for (int column = 0; column < 3; column++)
+	{
+		_MM_TRANSPOSE4_PS(normal[column][0], normal[column][1], normal[column][2], normal[column][3]);
+		for (int i = 0; i < 4; i++)
+		{
+			alignas(16) float values[4];
+			_mm_store_ps(values, normal[column][i]);
+			std::memcpy(&normalMatrices[ids[i]][column][0], values, sizeof(float) * 3); // A mat3 column is only three floats wide
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "pch.h"
+#include "AABB.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+typedef uint32_t TransformID;
+
+// Boxes stored as a center and half extents per axis, one array per component
+struct BoundsArrays
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+};
+
+// Position, orientation (euler angles in radians, applied X then Y then Z) and scale of every scene entity, stored as SoA arrays.
+// World and normal matrices are cached and only rebuilt for entities touched since the last UpdateDirty(), four at a time with SSE.
+// Entities that never move cost nothing per frame.
+// Each entity can also carry local bounds, which are brought into world space along with the matrices.
+class TransformComponent
+{
+public:
+	static TransformID Create(const glm::vec3& position = glm::vec3(0.0f), const glm::vec3& orientation = glm::vec3(0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+	static void Destroy(TransformID id);
+
+	static glm::vec3 GetPosition(TransformID id);
+	static glm::vec3 GetOrientation(TransformID id);
+	static glm::vec3 GetScale(TransformID id);
+
+	// These flag the entity dirty
+	static void SetPosition(TransformID id, const glm::vec3& position);
+	static void SetOrientation(TransformID id, const glm::vec3& orientation);
+	static void SetScale(TransformID id, const glm::vec3& scale);
+
+	// translate * rotateX * rotateY * rotateZ * scale, as of the last UpdateDirty()
+	inline static const glm::mat4& GetWorldMatrix(TransformID id) { return worldMatrices[id]; }
+
+	// transpose(inverse(mat3(world))), which for rotation and scale only is rotation * inverse(scale)
+	inline static const glm::mat3& GetNormalMatrix(TransformID id) { return normalMatrices[id]; }
+
+	inline static bool IsDirty(TransformID id) { return dirty[id] != 0; }
+
+	// Model space bounds, flags the entity dirty. Entities without bounds are a point at their position.
+	static void SetLocalBounds(TransformID id, const AABB& bounds);
+
+	// The local bounds as a world space AABB, as of the last UpdateDirty()
+	static AABB GetWorldBounds(TransformID id);
+
+	// World bounds of every entity indexed by TransformID, for passes that walk all of them at once. Free ids are still in here, see IsAlive().
+	inline static const BoundsArrays& GetWorldBoundsArrays() { return worldBounds; }
+	inline static uint32_t GetCount() { return (uint32_t)positionX.size(); }
+	inline static bool IsAlive(TransformID id) { return alive[id] != 0; }
+
+	// Rebuilds the matrices and world bounds of every dirty entity
+	static void UpdateDirty();
+
+	// The entities rebuilt by the last UpdateDirty()
+	inline static const std::vector<TransformID>& GetUpdated() { return updated; }
+
+private:
+	static void MarkDirty(TransformID id);
+
+	// Rebuilds four entities at once, ids can repeat
+	static void Rebuild(const TransformID ids[4]);
+
+	static std::vector<float> positionX, positionY, positionZ;
+	static std::vector<float> orientationX, orientationY, orientationZ;
+	static std::vector<float> scaleX, scaleY, scaleZ;
+
+	static std::vector<glm::mat4> worldMatrices;
+	static std::vector<glm::mat3> normalMatrices;
+
+	static BoundsArrays localBounds;
+	static BoundsArrays worldBounds;
+
+	static std::vector<uint8_t> alive;
+	static std::vector<uint8_t> dirty;
+	static std::vector<TransformID> dirtyList;
+	static std::vector<TransformID> updated;
+	static std::vector<TransformID> freeIDs;
+};
\ No newline at end of file
@@ -1,10 +1,12 @@
 #include "Shader.h"
+#include "GLState.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 
 const unsigned int MAX_LINE_LENGTH = 65536;		// 16x1024
 
@@ -150,6 +152,28 @@ namespace ShaderUtils
 		return ID;
 	}
 
+	// The entry for the name, or nullptr. Only names sharing the hash get their strings compared.
+	template<typename T>
+	static const T* Find(const std::unordered_multimap<uint32_t, std::pair<std::string, T>>& table, const UniformName& name)
+	{
+		typedef typename std::unordered_multimap<uint32_t, std::pair<std::string, T>>::const_iterator Iterator;
+		std::pair<Iterator, Iterator> range = table.equal_range(name.hash);
+		for (Iterator it = range.first; it != range.second; it++)
+		{
+			if (it->second.first == name.name)
+			{
+				return &it->second.second;
+			}
+		}
+
+		return nullptr;
+	}
+
+	template<typename T>
+	static void Insert(std::unordered_multimap<uint32_t, std::pair<std::string, T>>& table, const std::string& name, const T& value)
+	{
+		table.insert({ HashUniformName(name.c_str()), { name, value } });
+	}
 }
 
 Shader::Shader(const std::string& name, const std::string& vertexPath, const std::string& fragmentPath)
@@ -161,6 +185,7 @@ Shader::Shader(const std::string& name, const std::string& vertexPath, const std
 	std::cout << "Compiling shader " << name << std::endl;
 	this->ID = ShaderUtils::CreateShader(vertexSource, fragmentSource, vertexPath, fragmentPath);
 	std::cout << "Shader " << name << " compiled successfully!" << std::endl;
+	Reflect();
 }
 
 Shader::Shader(const std::string& name, const std::vector<std::string>& vertexSrc, const std::vector<std::string>& fragmentSrc)
@@ -169,54 +194,212 @@ Shader::Shader(const std::string& name, const std::vector<std::string>& vertexSr
 	std::cout << "Compiling shader " << name << std::endl;
 	this->ID = ShaderUtils::CreateShader(vertexSrc, fragmentSrc);
 	std::cout << "Shader " << name << " compiled successfully!" << std::endl;
+	Reflect();
 }
 
 Shader::~Shader()
 {
+	GLState::ForgetProgram(this->ID);
 	glDeleteProgram(this->ID);
 }
 
 void Shader::Bind() const
 {
-	glUseProgram(this->ID);
+	GLState::UseProgram(this->ID);
 }
 
 void Shader::Unbind() const
 {
-	glUseProgram(0);
+	GLState::UseProgram(0);
+}
+
+GLint Shader::GetUniformLocation(const UniformName& name) const
+{
+	const GLint* location = ShaderUtils::Find(this->uniformLocations, name);
+	return location ? *location : -1;
+}
+
+const ShaderUniform* Shader::GetUniform(const UniformName& name) const
+{
+	const uint32_t* index = ShaderUtils::Find(this->uniformIndices, name);
+	return index ? &this->uniforms[*index] : nullptr;
+}
+
+const ShaderUniformBlock* Shader::GetUniformBlock(const UniformName& name) const
+{
+	const uint32_t* index = ShaderUtils::Find(this->uniformBlockIndices, name);
+	return index ? &this->uniformBlocks[*index] : nullptr;
+}
+
+void Shader::SetUniformBlockBinding(const UniformName& name, GLuint binding)
+{
+	const ShaderUniformBlock* block = GetUniformBlock(name);
+	if (block)
+	{
+		glUniformBlockBinding(this->ID, block->index, binding);
+	}
+}
+
+void Shader::SetStorageBlockBinding(const UniformName& name, GLuint binding)
+{
+	GLuint index = glGetProgramResourceIndex(this->ID, GL_SHADER_STORAGE_BLOCK, name.name); // Only looked up at startup, so not worth reflecting
+	if (index != GL_INVALID_INDEX)
+	{
+		glShaderStorageBlockBinding(this->ID, index, binding);
+	}
+}
+
+void Shader::SetInt(const UniformName& name, int value)
+{
+	SetInt(GetUniformLocation(name), value);
+}
+
+void Shader::SetIntArray(const UniformName& name, int* values, uint32_t count)
+{
+	SetIntArray(GetUniformLocation(name), values, count);
+}
+
+void Shader::SetFloat(const UniformName& name, float value)
+{
+	SetFloat(GetUniformLocation(name), value);
+}
+
+void Shader::SetFloat2(const UniformName& name, const glm::vec2& value)
+{
+	SetFloat2(GetUniformLocation(name), value);
+}
+
+void Shader::SetFloat3(const UniformName& name, const glm::vec3& value)
+{
+	SetFloat3(GetUniformLocation(name), value);
+}
+
+void Shader::SetFloat4(const UniformName& name, const glm::vec4& value)
+{
+	SetFloat4(GetUniformLocation(name), value);
+}
+
+void Shader::SetMat4x4(const UniformName& name, const glm::mat4& value)
+{
+	SetMat4x4(GetUniformLocation(name), value);
 }
 
-void Shader::SetInt(const std::string& name, int value)
+void Shader::SetInt(GLint location, int value)
 {
-	glUniform1i(glGetUniformLocation(this->ID, name.c_str()), value);
+	glProgramUniform1i(this->ID, location, value);
 }
 
-void Shader::SetIntArray(const std::string& name, int* values, uint32_t count)
+void Shader::SetIntArray(GLint location, int* values, uint32_t count)
 {
-	glUniform1iv(glGetUniformLocation(this->ID, name.c_str()), count, values);
+	glProgramUniform1iv(this->ID, location, count, values);
 }
 
-void Shader::SetFloat(const std::string& name, float value)
+void Shader::SetFloat(GLint location, float value)
 {
-	glUniform1f(glGetUniformLocation(this->ID, name.c_str()), value);
+	glProgramUniform1f(this->ID, location, value);
 }
 
-void Shader::SetFloat2(const std::string& name, const glm::vec2& value)
+void Shader::SetFloat2(GLint location, const glm::vec2& value)
 {
-	glUniform2f(glGetUniformLocation(this->ID, name.c_str()), value.x, value.y);
+	glProgramUniform2f(this->ID, location, value.x, value.y);
 }
 
-void Shader::SetFloat3(const std::string& name, const glm::vec3& value)
+void Shader::SetFloat3(GLint location, const glm::vec3& value)
 {
-	glUniform3f(glGetUniformLocation(this->ID, name.c_str()), value.x, value.y, value.z);
+	glProgramUniform3f(this->ID, location, value.x, value.y, value.z);
 }
 
-void Shader::SetFloat4(const std::string& name, const glm::vec4& value)
+void Shader::SetFloat4(GLint location, const glm::vec4& value)
 {
-	glUniform4f(glGetUniformLocation(this->ID, name.c_str()), value.x, value.y, value.z, value.w);
+	glProgramUniform4f(this->ID, location, value.x, value.y, value.z, value.w);
 }
 
-void Shader::SetMat4x4(const std::string& name, const glm::mat4& value)
+void Shader::SetMat4x4(GLint location, const glm::mat4& value)
 {
-	glUniformMatrix4fv(glGetUniformLocation(this->ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+	glProgramUniformMatrix4fv(this->ID, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void Shader::Reflect()
+{
+	this->uniforms.clear();
+	this->uniformBlocks.clear();
+	this->uniformLocations.clear();
+	this->uniformIndices.clear();
+	this->uniformBlockIndices.clear();
+
+	if (this->ID == 0) // Failed to compile, nothing to look at
+	{
+		return;
+	}
+
+	GLint uniformCount = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+	for (GLuint i = 0; i < (GLuint)uniformCount; i++)
+	{
+		ShaderUniform uniform;
+		GLsizei nameLength = 0;
+		glGetActiveUniform(this->ID, i, (GLsizei)nameBuffer.size(), &nameLength, &uniform.size, &uniform.type, nameBuffer.data());
+		uniform.name = std::string(nameBuffer.data(), nameLength);
+		glGetActiveUniformsiv(this->ID, 1, &i, GL_UNIFORM_BLOCK_INDEX, &uniform.blockIndex);
+		glGetActiveUniformsiv(this->ID, 1, &i, GL_UNIFORM_OFFSET, &uniform.offset);
+		uniform.location = uniform.blockIndex == -1 ? glGetUniformLocation(this->ID, uniform.name.c_str()) : -1;
+
+		uint32_t index = (uint32_t)this->uniforms.size();
+		this->uniforms.push_back(uniform);
+
+		std::string baseName = uniform.name;
+		bool isArray = baseName.size() > 3 && baseName.compare(baseName.size() - 3, 3, "[0]") == 0; // GL reports arrays as "name[0]"
+		if (isArray)
+		{
+			baseName.erase(baseName.size() - 3);
+		}
+
+		ShaderUtils::Insert(this->uniformIndices, uniform.name, index);
+		if (isArray)
+		{
+			ShaderUtils::Insert(this->uniformIndices, baseName, index);
+		}
+
+		if (uniform.location == -1)
+		{
+			continue;
+		}
+
+		ShaderUtils::Insert(this->uniformLocations, uniform.name, uniform.location);
+		if (isArray)
+		{
+			ShaderUtils::Insert(this->uniformLocations, baseName, uniform.location);
+			for (GLint element = 1; element < uniform.size; element++) // Element locations aren't guaranteed to be consecutive, so ask for each
+			{
+				std::string elementName = baseName + "[" + std::to_string(element) + "]";
+				GLint elementLocation = glGetUniformLocation(this->ID, elementName.c_str());
+				ShaderUtils::Insert(this->uniformLocations, elementName, elementLocation);
+			}
+		}
+	}
+
+	GLint blockCount = 0;
+	glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+	for (GLuint i = 0; i < (GLuint)blockCount; i++)
+	{
+		GLint blockNameLength = 0;
+		glGetActiveUniformBlockiv(this->ID, i, GL_UNIFORM_BLOCK_NAME_LENGTH, &blockNameLength);
+
+		std::vector<char> blockName(std::max(blockNameLength, 1));
+		glGetActiveUniformBlockName(this->ID, i, (GLsizei)blockName.size(), nullptr, blockName.data());
+
+		ShaderUniformBlock block;
+		block.name = blockName.data();
+		block.index = i;
+		glGetActiveUniformBlockiv(this->ID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+
+		ShaderUtils::Insert(this->uniformBlockIndices, block.name, (uint32_t)this->uniformBlocks.size());
+		this->uniformBlocks.push_back(block);
+	}
+
+	std::cout << "Shader " << this->name << " has " << this->uniforms.size() << " active uniforms and " << this->uniformBlocks.size() << " uniform blocks" << std::endl;
 }
\ No newline at end of file
@@ -5,10 +5,53 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+
+// FNV-1a hash of a uniform name. Shader looks uniforms up by this instead of by string.
+constexpr uint32_t HashUniformName(const char* name)
+{
+	uint32_t hash = 2166136261u;
+	while (*name)
+	{
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+	return hash;
+}
+
+// A uniform name with its hash. String literals convert implicitly, but the hash is only computed at compile time when the UniformName is a constexpr variable
+// (constexpr UniformName SpreadDataUniform("spreadData")). Anywhere else it's hashed at runtime, which is fine for lookups done once at startup.
+struct UniformName
+{
+	template<size_t N>
+	constexpr UniformName(const char (&name)[N]) : name(name), hash(HashUniformName(name)) {}
+	explicit UniformName(const std::string& name) : name(name.c_str()), hash(HashUniformName(name.c_str())) {}
+
+	const char* name;
+	uint32_t hash;
+};
+
+// An active uniform, as reported by GL when the program was linked
+struct ShaderUniform
+{
+	std::string name;
+	GLenum type;
+	GLint size; // Array length, 1 for non arrays
+	GLint location; // -1 for uniforms inside a block
+	GLint blockIndex; // -1 for uniforms in the default block
+	GLint offset; // Byte offset inside the block
+};
+
+// An active uniform block
+struct ShaderUniformBlock
+{
+	std::string name;
+	GLuint index;
+	GLint dataSize;
+};
 
 class Shader
 {
-public:		
+public:
 	Shader(const std::string& name, const std::string& vertexPath, const std::string& fragmentPath);
 	Shader(const std::string& name, const std::vector<std::string>& vertexSrc, const std::vector<std::string>& fragmentSrc);
 	virtual ~Shader();
@@ -17,17 +60,50 @@ public:
 	virtual void Bind() const;
 	virtual void Unbind() const;
 
-	virtual void SetInt(const std::string & name, int value);
-	virtual void SetIntArray(const std::string & name, int* values, uint32_t count);
-	virtual void SetFloat(const std::string & name, float value);
-	virtual void SetFloat2(const std::string & name, const glm::vec2 & value);
-	virtual void SetFloat3(const std::string & name, const glm::vec3 & value);
-	virtual void SetFloat4(const std::string & name, const glm::vec4 & value);
-	virtual void SetMat4x4(const std::string & name, const glm::mat4 & value);
+	// The location of a uniform, or -1 (which glUniform* ignores) if the shader doesn't use it. Meant to be looked up once and kept.
+	GLint GetUniformLocation(const UniformName& name) const;
+	const ShaderUniform* GetUniform(const UniformName& name) const;
+	const ShaderUniformBlock* GetUniformBlock(const UniformName& name) const;
+
+	// Attaches a uniform block to a uniform buffer binding point. Does nothing if the shader doesn't have the block.
+	void SetUniformBlockBinding(const UniformName& name, GLuint binding);
+
+	// Attaches a shader storage block to a storage buffer binding point. Does nothing if the shader doesn't have the block.
+	void SetStorageBlockBinding(const UniformName& name, GLuint binding);
+
+	inline const std::vector<ShaderUniform>& GetUniforms() const { return this->uniforms; }
+	inline const std::vector<ShaderUniformBlock>& GetUniformBlocks() const { return this->uniformBlocks; }
+
+	// These don't need the shader to be bound
+	virtual void SetInt(const UniformName& name, int value);
+	virtual void SetIntArray(const UniformName& name, int* values, uint32_t count);
+	virtual void SetFloat(const UniformName& name, float value);
+	virtual void SetFloat2(const UniformName& name, const glm::vec2& value);
+	virtual void SetFloat3(const UniformName& name, const glm::vec3& value);
+	virtual void SetFloat4(const UniformName& name, const glm::vec4& value);
+	virtual void SetMat4x4(const UniformName& name, const glm::mat4& value);
+
+	virtual void SetInt(GLint location, int value);
+	virtual void SetIntArray(GLint location, int* values, uint32_t count);
+	virtual void SetFloat(GLint location, float value);
+	virtual void SetFloat2(GLint location, const glm::vec2& value);
+	virtual void SetFloat3(GLint location, const glm::vec3& value);
+	virtual void SetFloat4(GLint location, const glm::vec4& value);
+	virtual void SetMat4x4(GLint location, const glm::mat4& value);
 
 	inline virtual const std::string& GetName() const { return this->name; };
 
 private:
+	// Fills the uniform and block tables from the linked program
+	void Reflect();
+
 	GLuint ID;
 	std::string name;
+
+	std::vector<ShaderUniform> uniforms;
+	std::vector<ShaderUniformBlock> uniformBlocks;
+	// Keyed by name hash, with the name kept alongside and compared on lookup so two names with the same hash still find their own entry
+	std::unordered_multimap<uint32_t, std::pair<std::string, GLint>> uniformLocations; // Location, array elements get an entry each ("a[2]") and the array name maps to element 0
+	std::unordered_multimap<uint32_t, std::pair<std::string, uint32_t>> uniformIndices; // Index into uniforms
+	std::unordered_multimap<uint32_t, std::pair<std::string, uint32_t>> uniformBlockIndices; // Index into uniformBlocks
 };
\ No newline at end of file
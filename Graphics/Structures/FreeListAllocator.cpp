@@ -0,0 +1,84 @@
+#include "FreeListAllocator.h"
+
+FreeListAllocator::FreeListAllocator(uint32_t capacity)
+	: capacity(capacity), used(0)
+{
+	if (capacity > 0)
+	{
+		this->freeRanges.insert(std::make_pair(0, capacity));
+	}
+}
+
+bool FreeListAllocator::Allocate(uint32_t size, uint32_t& offset)
+{
+	if (size == 0)
+	{
+		offset = 0;
+		return true;
+	}
+
+	for (std::map<uint32_t, uint32_t>::iterator it = this->freeRanges.begin(); it != this->freeRanges.end(); it++)
+	{
+		if (it->second < size)
+		{
+			continue;
+		}
+
+		offset = it->first;
+		uint32_t remaining = it->second - size;
+		this->freeRanges.erase(it);
+		if (remaining > 0) // Give back what we didn't use
+		{
+			this->freeRanges.insert(std::make_pair(offset + size, remaining));
+		}
+
+		this->used += size;
+		return true;
+	}
+
+	return false;
+}
+
+void FreeListAllocator::Free(uint32_t offset, uint32_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	this->used -= size;
+
+	std::map<uint32_t, uint32_t>::iterator next = this->freeRanges.lower_bound(offset);
+	if (next != this->freeRanges.end() && offset + size == next->first) // Merge with the range after us
+	{
+		size += next->second;
+		next = this->freeRanges.erase(next);
+	}
+
+	if (next != this->freeRanges.begin())
+	{
+		std::map<uint32_t, uint32_t>::iterator previous = std::prev(next);
+		if (previous->first + previous->second == offset) // Merge with the range before us
+		{
+			previous->second += size;
+			return;
+		}
+	}
+
+	this->freeRanges.insert(std::make_pair(offset, size));
+}
+
+void FreeListAllocator::Grow(uint32_t capacity)
+{
+	if (capacity <= this->capacity)
+	{
+		return;
+	}
+
+	uint32_t oldCapacity = this->capacity;
+	this->capacity = capacity;
+
+	// Freeing the new space merges it with a free range at the old end if there is one
+	this->used += capacity - oldCapacity;
+	Free(oldCapacity, capacity - oldCapacity);
+}
\ No newline at end of file
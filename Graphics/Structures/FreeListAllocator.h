@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+// Hands out ranges of an address space (in whatever unit the owner wants, vertices, indices, bytes...)
+// Allocations are first fit and freed ranges are merged with their neighbours so the space doesn't fragment into slivers
+class FreeListAllocator
+{
+public:
+	FreeListAllocator(uint32_t capacity);
+
+	// Returns false if there is no free range big enough, the caller can Grow() and try again
+	bool Allocate(uint32_t size, uint32_t& offset);
+	void Free(uint32_t offset, uint32_t size);
+
+	// Adds room to the end of the address space
+	void Grow(uint32_t capacity);
+
+	inline uint32_t GetCapacity() const { return this->capacity; }
+	inline uint32_t GetUsed() const { return this->used; }
+
+private:
+	std::map<uint32_t, uint32_t> freeRanges; // Offset -> size, sorted by offset so neighbours are easy to find
+	uint32_t capacity;
+	uint32_t used;
+};
\ No newline at end of file
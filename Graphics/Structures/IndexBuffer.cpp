@@ -1,12 +1,11 @@
 #include "IndexBuffer.h"
 
-IndexBuffer::IndexBuffer(uint32_t* indices, uint32_t count)
-	: count(count)
+IndexBuffer::IndexBuffer(const void* indices, uint32_t count, uint32_t indexSize, bool dynamic)
+	: count(count), indexSize(indexSize)
 {
-	// WARNING: A valid VAO needs to be bound before using GL_ELEMENT_ARRAY_BUFFER
+	// Created through DSA so no VAO has to be bound, the VAO picks it up in SetIndexBuffer()
 	glCreateBuffers(1, &this->ID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+	glNamedBufferStorage(this->ID, count * indexSize, indices, dynamic ? GL_DYNAMIC_STORAGE_BIT : 0);
 }
 
 IndexBuffer::~IndexBuffer()
@@ -14,6 +13,16 @@ IndexBuffer::~IndexBuffer()
 	glDeleteBuffers(1, &this->ID);
 }
 
+void IndexBuffer::SetData(const void* indices, uint32_t count, uint32_t firstIndex)
+{
+	glNamedBufferSubData(this->ID, firstIndex * this->indexSize, count * this->indexSize, indices);
+}
+
+void IndexBuffer::GetData(void* data, uint32_t count, uint32_t firstIndex) const
+{
+	glGetNamedBufferSubData(this->ID, firstIndex * this->indexSize, count * this->indexSize, data);
+}
+
 void IndexBuffer::Bind() const
 {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ID);
@@ -7,15 +7,27 @@
 class IndexBuffer
 {
 public:
-	IndexBuffer(uint32_t* indices, uint32_t count);
+	// indexSize is the size of a single index in bytes, either 2 (GL_UNSIGNED_SHORT) or 4 (GL_UNSIGNED_INT)
+	// Like VertexBuffer the storage is immutable, only dynamic buffers can use SetData()
+	IndexBuffer(const void* indices, uint32_t count, uint32_t indexSize = sizeof(uint32_t), bool dynamic = false);
 	virtual ~IndexBuffer();
 
 	void Bind() const;;
 	void Unbind() const;
 
+	// Offsets and counts are in indices
+	void SetData(const void* indices, uint32_t count, uint32_t firstIndex = 0);
+
+	// Reads indices back from the GPU, data must have room for count * GetIndexSize() bytes
+	void GetData(void* data, uint32_t count, uint32_t firstIndex = 0) const;
+
+	inline GLuint GetID() const { return this->ID; }
 	inline uint32_t GetCount() const { return this->count; }
+	inline uint32_t GetIndexSize() const { return this->indexSize; }
+	inline GLenum GetIndexType() const { return this->indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
 
 private:
 	GLuint ID;
-	GLuint count; // Number of faces
+	GLuint count; // Number of indices
+	uint32_t indexSize;
 };
\ No newline at end of file
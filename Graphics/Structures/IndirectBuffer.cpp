@@ -0,0 +1,28 @@
+#include "IndirectBuffer.h"
+
+IndirectBuffer::IndirectBuffer(uint32_t size)
+	: size(size)
+{
+	glCreateBuffers(1, &this->ID);
+	glNamedBufferStorage(this->ID, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+IndirectBuffer::~IndirectBuffer()
+{
+	glDeleteBuffers(1, &this->ID);
+}
+
+void IndirectBuffer::Bind() const
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->ID);
+}
+
+void IndirectBuffer::Unbind() const
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectBuffer::SetData(const void* data, uint32_t size, uint32_t offset)
+{
+	glNamedBufferSubData(this->ID, offset, size, data);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "pch.h"
+#include "GLCommon.h"
+
+// Holds the commands of glMultiDrawElementsIndirect, which reads them from whatever is bound to GL_DRAW_INDIRECT_BUFFER
+class IndirectBuffer
+{
+public:
+	IndirectBuffer(uint32_t size);
+	virtual ~IndirectBuffer();
+
+	void Bind() const;
+	void Unbind() const;
+
+	// Offsets and sizes are in bytes
+	void SetData(const void* data, uint32_t size, uint32_t offset = 0);
+
+	inline GLuint GetID() const { return this->ID; }
+	inline uint32_t GetSize() const { return this->size; }
+
+private:
+	GLuint ID;
+	uint32_t size;
+};
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "StorageBuffer.h"
+
+StorageBuffer::StorageBuffer(uint32_t size, uint32_t binding)
+	: size(size), binding(binding)
+{
+	glCreateBuffers(1, &this->ID);
+	glNamedBufferStorage(this->ID, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+StorageBuffer::~StorageBuffer()
+{
+	glDeleteBuffers(1, &this->ID);
+}
+
+void StorageBuffer::Bind() const
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->binding, this->ID);
+}
+
+void StorageBuffer::SetData(const void* data, uint32_t size, uint32_t offset)
+{
+	glNamedBufferSubData(this->ID, offset, size, data);
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch.h"
+#include "GLCommon.h"
+
+// A shader storage block's backing buffer. Like UniformBuffer the layout is up to whoever fills it, here following std430 rules.
+class StorageBuffer
+{
+public:
+	// Binding is the shader storage binding point the shader's block is attached to
+	StorageBuffer(uint32_t size, uint32_t binding);
+	virtual ~StorageBuffer();
+
+	// Attaches the buffer to its binding point. Has to be done again whenever the buffer is replaced by a bigger one.
+	void Bind() const;
+
+	// Offsets and sizes are in bytes
+	void SetData(const void* data, uint32_t size, uint32_t offset = 0);
+
+	inline GLuint GetID() const { return this->ID; }
+	inline uint32_t GetSize() const { return this->size; }
+	inline uint32_t GetBinding() const { return this->binding; }
+
+private:
+	GLuint ID;
+	uint32_t size;
+	uint32_t binding;
+};
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "UniformBuffer.h"
+
+UniformBuffer::UniformBuffer(uint32_t size, uint32_t binding)
+	: size(size), binding(binding)
+{
+	glCreateBuffers(1, &this->ID);
+	glNamedBufferStorage(this->ID, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers(1, &this->ID);
+}
+
+void UniformBuffer::Bind() const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->ID);
+}
+
+void UniformBuffer::SetData(const void* data, uint32_t size, uint32_t offset)
+{
+	glNamedBufferSubData(this->ID, offset, size, data);
+}
\ No newline at end of file
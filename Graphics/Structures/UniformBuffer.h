@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch.h"
+#include "GLCommon.h"
+
+// A std140 uniform block's backing buffer. The layout is up to whoever fills it, structs written into it have to follow std140 padding rules.
+class UniformBuffer
+{
+public:
+	// Binding is the uniform buffer binding point the shader's block is attached to
+	UniformBuffer(uint32_t size, uint32_t binding);
+	virtual ~UniformBuffer();
+
+	// Attaches the buffer to its binding point. Stays attached until something else is bound there, so this only needs to happen once.
+	void Bind() const;
+
+	// Offsets and sizes are in bytes
+	void SetData(const void* data, uint32_t size, uint32_t offset = 0);
+
+	inline GLuint GetID() const { return this->ID; }
+	inline uint32_t GetSize() const { return this->size; }
+	inline uint32_t GetBinding() const { return this->binding; }
+
+private:
+	GLuint ID;
+	uint32_t size;
+	uint32_t binding;
+};
\ No newline at end of file
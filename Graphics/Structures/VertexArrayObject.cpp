@@ -1,4 +1,7 @@
 #include "VertexArrayObject.h"
+#include "GLState.h"
+
+#include <algorithm>
 
 VertexArrayObject::VertexArrayObject()
 	: VBOIndex(0)
@@ -8,17 +11,18 @@ VertexArrayObject::VertexArrayObject()
 
 VertexArrayObject::~VertexArrayObject()
 {
+	GLState::ForgetVertexArray(this->ID);
 	glDeleteVertexArrays(1, &this->ID);
 }
 
 void VertexArrayObject::Bind() const
 {
-	glBindVertexArray(this->ID);
+	GLState::BindVertexArray(this->ID);
 }
 
 void VertexArrayObject::Unbind() const
 {
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
 
 void VertexArrayObject::AddVertexBuffer(const Ref<VertexBuffer>& vertexBuffer)
@@ -29,10 +33,32 @@ void VertexArrayObject::AddVertexBuffer(const Ref<VertexBuffer>& vertexBuffer)
 		return;
 	}
 
-	Bind();
-	vertexBuffer->Bind();
+	SetupAttributes(vertexBuffer);
+	this->vertexBuffers.push_back(vertexBuffer);
+}
+
+void VertexArrayObject::AddInstanceBuffer(const Ref<VertexBuffer>& vertexBuffer, uint32_t firstAttribute)
+{
+	if (vertexBuffer->GetLayout().GetElements().empty())
+	{
+		std::cout << "VBO doesn't have a layout!" << std::endl;
+		return;
+	}
+
+	GLuint bindingIndex = (GLuint)this->vertexBuffers.size();
+	this->VBOIndex = std::max<GLuint>(this->VBOIndex, firstAttribute);
+	SetupAttributes(vertexBuffer);
+	glVertexArrayBindingDivisor(this->ID, bindingIndex, 1); // Advance once per instance instead of once per vertex
+	this->vertexBuffers.push_back(vertexBuffer);
+}
 
+void VertexArrayObject::SetupAttributes(const Ref<VertexBuffer>& vertexBuffer)
+{
+	// Set up through DSA so nothing gets bound. Each VBO gets its own binding point that its attributes read from, which lets ReplaceVertexBuffer() swap the buffer out later.
+	GLuint bindingIndex = (GLuint)this->vertexBuffers.size();
 	const BufferLayout& layout = vertexBuffer->GetLayout();
+	glVertexArrayVertexBuffer(this->ID, bindingIndex, vertexBuffer->GetID(), 0, layout.GetStride());
+
 	for (const BufferElement& element : layout)
 	{
 		switch (element.shaderDataType)
@@ -42,14 +68,14 @@ void VertexArrayObject::AddVertexBuffer(const Ref<VertexBuffer>& vertexBuffer)
 		case ShaderDataType::Float3:
 		case ShaderDataType::Float4:
 		{
-			glEnableVertexAttribArray(this->VBOIndex); // Bind the current VBO
+			glEnableVertexArrayAttrib(this->ID, this->VBOIndex);
 			// Tell OpenGL about the layout of our data
-			glVertexAttribPointer(this->VBOIndex,
+			glVertexArrayAttribFormat(this->ID, this->VBOIndex,
 				element.NumberOfComponents(), // How many components do we have.
 				GL_FLOAT, // The type of data we are passing
 				element.normalized ? GL_TRUE : GL_FALSE, // Should the data be normalized?
-				layout.GetStride(), // The offset between vertex attributes
-				(GLvoid*)element.offset); // The offset of the first component of the vertex attribute
+				(GLuint)element.offset); // The offset of the first component of the vertex attribute
+			glVertexArrayAttribBinding(this->ID, this->VBOIndex, bindingIndex);
 			this->VBOIndex++;
 			break;
 		}
@@ -59,34 +85,71 @@ void VertexArrayObject::AddVertexBuffer(const Ref<VertexBuffer>& vertexBuffer)
 		case ShaderDataType::Int4:
 		case ShaderDataType::Bool:
 		{
-			glEnableVertexAttribArray(this->VBOIndex); // Bind the current VBO
+			glEnableVertexArrayAttrib(this->ID, this->VBOIndex);
 			// Tell OpenGL about the layout of our data
-			glVertexAttribPointer(this->VBOIndex,
+			glVertexArrayAttribFormat(this->ID, this->VBOIndex,
 				element.NumberOfComponents(), // How many components do we have. In most cases this will be 3 because we like to draw triangles
 				GL_INT, // The type of data we are passing
 				GL_FALSE, // We can't normalize integers
-				layout.GetStride(), // The offset between vertex attributes
-				(GLvoid*)element.offset); // The offset of the first component of the vertex attribute
+				(GLuint)element.offset); // The offset of the first component of the vertex attribute
+			glVertexArrayAttribBinding(this->ID, this->VBOIndex, bindingIndex);
+			this->VBOIndex++;
+			break;
+		}
+		case ShaderDataType::Half2:
+		case ShaderDataType::Half4:
+		case ShaderDataType::Byte4Norm:
+		case ShaderDataType::Short2Norm:
+		case ShaderDataType::Short4Norm:
+		case ShaderDataType::UShort2Norm:
+		case ShaderDataType::UShort4Norm:
+		{
+			bool isHalf = element.shaderDataType == ShaderDataType::Half2 || element.shaderDataType == ShaderDataType::Half4;
+			GLenum type = isHalf ? GL_HALF_FLOAT
+				: element.shaderDataType == ShaderDataType::Byte4Norm ? GL_BYTE
+				: (element.shaderDataType == ShaderDataType::Short2Norm || element.shaderDataType == ShaderDataType::Short4Norm) ? GL_SHORT
+				: GL_UNSIGNED_SHORT;
+
+			glEnableVertexArrayAttrib(this->ID, this->VBOIndex);
+			// Tell OpenGL about the layout of our data
+			glVertexArrayAttribFormat(this->ID, this->VBOIndex,
+				element.NumberOfComponents(), // How many components do we have.
+				type, // The type of data we are passing
+				isHalf ? GL_FALSE : GL_TRUE, // Integers get mapped to [-1, 1] (signed) or [0, 1] (unsigned)
+				(GLuint)element.offset); // The offset of the first component of the vertex attribute
+			glVertexArrayAttribBinding(this->ID, this->VBOIndex, bindingIndex);
 			this->VBOIndex++;
 			break;
 		}
 		case ShaderDataType::Mat3x3:
 		case ShaderDataType::Mat4x4:
 		{
-			std::cout << "Matrices have no implementation." << std::endl; // Do this later. It really isn't important to me right now because I feel like I will never use this
+			// A matrix takes up one attribute per column
+			GLint columns = (GLint)element.NumberOfComponents();
+			for (GLint column = 0; column < columns; column++)
+			{
+				glEnableVertexArrayAttrib(this->ID, this->VBOIndex);
+				glVertexArrayAttribFormat(this->ID, this->VBOIndex, columns, GL_FLOAT, GL_FALSE, (GLuint)(element.offset + column * columns * sizeof(float)));
+				glVertexArrayAttribBinding(this->ID, this->VBOIndex, bindingIndex);
+				this->VBOIndex++;
+			}
 			break;
 		}
 		default:
 			std::cout << "Invalid ShaderDataType!" << std::endl;;
 		}
 	}
+}
 
-	this->vertexBuffers.push_back(vertexBuffer);
+void VertexArrayObject::ReplaceVertexBuffer(uint32_t index, const Ref<VertexBuffer>& vertexBuffer)
+{
+	// The attribute formats stay the same, only the buffer behind the binding point changes
+	glVertexArrayVertexBuffer(this->ID, index, vertexBuffer->GetID(), 0, vertexBuffer->GetLayout().GetStride());
+	this->vertexBuffers[index] = vertexBuffer;
 }
 
 void VertexArrayObject::SetIndexBuffer(const Ref<IndexBuffer>& indexBuffer)
 {
-	Bind();
-	indexBuffer->Bind();
+	glVertexArrayElementBuffer(this->ID, indexBuffer->GetID());
 	this->indexBuffer = indexBuffer;
 }
\ No newline at end of file
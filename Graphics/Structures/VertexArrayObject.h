@@ -14,13 +14,23 @@ public:
 	void Bind() const;
 	void Unbind() const ;
 
+	inline GLuint GetID() const { return this->ID; }
+
 	void AddVertexBuffer(const Ref<VertexBuffer>& vbo);
 	void SetIndexBuffer(const Ref<IndexBuffer>& ebo);
 
+	// Adds a VBO that advances once per instance. Its attributes start at firstAttribute so shaders can use fixed locations whatever the vertex layout is.
+	void AddInstanceBuffer(const Ref<VertexBuffer>& vbo, uint32_t firstAttribute);
+
+	// Points the attributes of a previously added VBO at a different buffer with the same layout
+	void ReplaceVertexBuffer(uint32_t index, const Ref<VertexBuffer>& vbo);
+
 	inline virtual const std::vector<Ref<VertexBuffer>>& GetVertexBuffers() const { return this->vertexBuffers; }
 	inline virtual const Ref<IndexBuffer>& GetIndexBuffer() const { return this->indexBuffer; }
 
 private:
+	void SetupAttributes(const Ref<VertexBuffer>& vbo);
+
 	GLuint ID; // Holds the ID to our VAO
 	GLuint VBOIndex; // Holds the current index of out VBO
 
@@ -1,10 +1,10 @@
 #include "VertexBuffer.h"
 
-VertexBuffer::VertexBuffer(float* vertices, uint32_t size)
+VertexBuffer::VertexBuffer(const void* vertices, uint32_t size, bool dynamic)
+	: size(size)
 {
 	glCreateBuffers(1, &this->ID);
-	glBindBuffer(GL_ARRAY_BUFFER, this->ID);
-	glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+	glNamedBufferStorage(this->ID, size, vertices, dynamic ? GL_DYNAMIC_STORAGE_BIT : 0);
 }
 
 VertexBuffer::~VertexBuffer()
@@ -22,8 +22,12 @@ void VertexBuffer::Unbind() const
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void VertexBuffer::SetData(const void* data, uint32_t size)
+void VertexBuffer::SetData(const void* data, uint32_t size, uint32_t offset)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, this->ID);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data); // Redefines the data in the VBO
+	glNamedBufferSubData(this->ID, offset, size, data); // Redefines the data in the VBO
+}
+
+void VertexBuffer::GetData(void* data, uint32_t size, uint32_t offset) const
+{
+	glGetNamedBufferSubData(this->ID, offset, size, data);
 }
\ No newline at end of file
@@ -7,18 +7,27 @@
 class VertexBuffer
 {
 public:
-	VertexBuffer(float* vertices, uint32_t size);
+	// The buffer's storage is immutable and filled straight from the given pointer. Only dynamic buffers can use SetData().
+	VertexBuffer(const void* vertices, uint32_t size, bool dynamic = false);
 	virtual ~VertexBuffer();
 
 	void Bind() const;
 	void Unbind() const;
 
-	void SetData(const void* data, uint32_t size);
+	// Offsets and sizes are in bytes
+	void SetData(const void* data, uint32_t size, uint32_t offset = 0);
+
+	// Reads the buffer's contents back from the GPU
+	void GetData(void* data, uint32_t size, uint32_t offset = 0) const;
+
+	inline GLuint GetID() const { return this->ID; }
+	inline uint32_t GetSize() const { return this->size; }
 
 	inline const BufferLayout& GetLayout() const { return this->layout; }
 	inline void SetLayout(const BufferLayout& layout) { this->layout = layout; }
 
 private:
 	GLuint ID;
+	uint32_t size;
 	BufferLayout layout;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "DiffuseTexture.h"
 #include "YAMLOverloads.h"
+#include "GLState.h"
 
 #include <SOIL2.h>
 #include <iostream>
@@ -17,7 +18,7 @@ DiffuseTexture::DiffuseTexture(const std::string& path, TextureFilterType filter
 	if (data)
 	{
 		glCreateTextures(GL_TEXTURE_2D, 1, &this->ID);
-		glBindTexture(GL_TEXTURE_2D, this->ID);
+		GLState::BindTexture(GL_TEXTURE_2D, this->ID);
 
 		// Filtering parameters (We use linear whichif a UV coord doesn't correspond to to a color value in the texture, it will take the average of colors from its neighbours)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterType == TextureFilterType::Linear ? genMipMaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR : GL_NEAREST);
@@ -46,6 +47,7 @@ DiffuseTexture::DiffuseTexture(const std::string& path, TextureFilterType filter
 
 DiffuseTexture::~DiffuseTexture()
 {
+	GLState::ForgetTexture(this->ID);
 	glDeleteTextures(1, &this->ID);
 }
 
@@ -57,7 +59,7 @@ void DiffuseTexture::Bind(uint32_t slot) const
 		return;
 	}
 
-	glBindTextureUnit(slot, this->ID);
+	GLState::BindTextureUnit(slot, this->ID);
 	glUniform1i(DiffuseTexture::diffuseTextureUniforms[slot], slot);
 }
 
@@ -69,7 +71,7 @@ void DiffuseTexture::UnBind(uint32_t slot) const
 		return;
 	}
 
-	glBindTextureUnit(slot, 0);
+	GLState::BindTextureUnit(slot, 0);
 }
 
 void DiffuseTexture::InitializeUniforms(Ref<Shader> shader)
@@ -79,6 +81,6 @@ void DiffuseTexture::InitializeUniforms(Ref<Shader> shader)
 	{
 		std::stringstream ss;
 		ss << "texture" << i;
-		DiffuseTexture::diffuseTextureUniforms[i] = glGetUniformLocation(shader->GetID(), ss.str().c_str());
+		DiffuseTexture::diffuseTextureUniforms[i] = shader->GetUniformLocation(UniformName(ss.str()));
 	}
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "DiscardTexture.h"
+#include "GLState.h"
 
 #include <SOIL2.h>
 
@@ -16,7 +17,7 @@ DiscardTexture::DiscardTexture(const std::string& path, TextureFilterType filter
 	if (data)
 	{
 		glCreateTextures(GL_TEXTURE_2D, 1, &this->ID);
-		glBindTexture(GL_TEXTURE_2D, this->ID);
+		GLState::BindTexture(GL_TEXTURE_2D, this->ID);
 
 		// Filtering parameters (We use linear whichif a UV coord doesn't correspond to to a color value in the texture, it will take the average of colors from its neighbours)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterType == TextureFilterType::Linear ? genMipMaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR : GL_NEAREST);
@@ -35,7 +36,7 @@ DiscardTexture::DiscardTexture(const std::string& path, TextureFilterType filter
 			glGenerateMipmap(GL_TEXTURE_2D);
 		}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::BindTexture(GL_TEXTURE_2D, 0);
 
 		std::cout << "Texture '" << path << "' loaded successfully!" << std::endl;
 	}
@@ -47,24 +48,25 @@ DiscardTexture::DiscardTexture(const std::string& path, TextureFilterType filter
 
 DiscardTexture::~DiscardTexture()
 {
+	GLState::ForgetTexture(this->ID);
 	glDeleteTextures(1, &this->ID);
 }
 
 void DiscardTexture::Bind(uint32_t slot) const
 {
 	glUniform1f(isDiscardTextureUniform, (GLfloat)GL_TRUE);
-	glBindTextureUnit(slot, this->ID);
+	GLState::BindTextureUnit(slot, this->ID);
 	glUniform1i(discardTextureUniform, slot);
 }
 
 void DiscardTexture::UnBind(uint32_t slot) const
 {
 	glUniform1f(isDiscardTextureUniform, (GLfloat)GL_FALSE);
-	glBindTextureUnit(slot, 0);
+	GLState::BindTextureUnit(slot, 0);
 }
 
 void DiscardTexture::InitializeUniforms(Ref<Shader>shader)
 {
-	DiscardTexture::isDiscardTextureUniform = glGetUniformLocation(shader->GetID(), "isDiscardTexture");
-	DiscardTexture::discardTextureUniform = glGetUniformLocation(shader->GetID(), "discardTexture");
+	DiscardTexture::isDiscardTextureUniform = shader->GetUniformLocation("isDiscardTexture");
+	DiscardTexture::discardTextureUniform = shader->GetUniformLocation("discardTexture");
 }
\ No newline at end of file
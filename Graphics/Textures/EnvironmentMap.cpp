@@ -1,5 +1,7 @@
 #include "EnvironmentMap.h"
 #include "MeshManager.h"
+#include "Renderer.h"
+#include "GLState.h"
 
 #include <SOIL2.h>
 #include <glm/glm.hpp>
@@ -23,7 +25,7 @@ EnvironmentMap::EnvironmentMap(Ref<Mesh> mesh, const std::string& posXFile, cons
 	loadedUniforms(false)
 {
 	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &this->ID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, this->ID);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, this->ID);
 
 	// Wrapping
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -146,7 +148,7 @@ EnvironmentMap::EnvironmentMap(Ref<Mesh> mesh, const std::string& posXFile, cons
 		glGenerateMipmap(this->ID);
 	}
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
 	SOIL_free_image_data(posXData);
 	SOIL_free_image_data(negXData);
@@ -160,6 +162,7 @@ EnvironmentMap::EnvironmentMap(Ref<Mesh> mesh, const std::string& posXFile, cons
 
 EnvironmentMap::~EnvironmentMap()
 {
+	GLState::ForgetTexture(this->ID);
 	glDeleteTextures(1, &this->ID);
 }
 
@@ -178,34 +181,29 @@ void EnvironmentMap::Draw(Ref<Shader> shader, const glm::vec3& position, const g
 	glm::mat4 matModel = glm::mat4(1.0f);
 	matModel *= glm::translate(glm::mat4(1.0f), position);
 	matModel *= glm::scale(glm::mat4(1.0f), scale);
-	glm::mat4 matInvTransposeModel = glm::inverse(glm::transpose(matModel));
-
-	shader->SetMat4x4("matModel", matModel);
-	shader->SetMat4x4("matModelInverseTranspose", matInvTransposeModel);
+	Renderer::SetVertexFormat(this->mesh->GetVertexFormat());
 	
 	GLuint textureUnit = 40; // Quick hack to ensure that our cube map doesn't clash with 2d textures
 
-	glBindTextureUnit(textureUnit, this->ID);
+	GLState::BindTextureUnit(textureUnit, this->ID);
 
 	glUniform1i(this->cubeSamplerUniform0, textureUnit);
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	GLState::SetPolygonMode(GL_FILL);
 
-	this->mesh->GetVertexArray()->Bind();
-	glDrawElements(GL_TRIANGLES, this->mesh->GetFaces().size() * 3, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	Renderer::DrawMesh(shader, this->mesh, matModel); // Sets matModel for each submesh
 
 	glUniform1f(this->isSkyBoxUniform, (GLfloat) GL_FALSE);
 }
 
 void EnvironmentMap::LoadUniforms(Ref<Shader> shader)
 {
-	this->isSkyBoxUniform = glGetUniformLocation(shader->GetID(), "isSkyBox");
-	this->cubeMapRatiosUniform = glGetUniformLocation(shader->GetID(), "cubeMapRatios");
-	this->cubeSamplerUniform0 = glGetUniformLocation(shader->GetID(), "cubeMap0");
-	this->cubeSamplerUniform1 = glGetUniformLocation(shader->GetID(), "cubeMap1");
-	this->cubeSamplerUniform2 = glGetUniformLocation(shader->GetID(), "cubeMap2");
-	this->cubeSamplerUniform3 = glGetUniformLocation(shader->GetID(), "cubeMap3");
+	this->isSkyBoxUniform = shader->GetUniformLocation("isSkyBox");
+	this->cubeMapRatiosUniform = shader->GetUniformLocation("cubeMapRatios");
+	this->cubeSamplerUniform0 = shader->GetUniformLocation("cubeMap0");
+	this->cubeSamplerUniform1 = shader->GetUniformLocation("cubeMap1");
+	this->cubeSamplerUniform2 = shader->GetUniformLocation("cubeMap2");
+	this->cubeSamplerUniform3 = shader->GetUniformLocation("cubeMap3");
 	this->loadedUniforms = true;
 }
 
@@ -1,5 +1,6 @@
 #include "HeightMapTexture.h"
 #include "YAMLOverloads.h"
+#include "GLState.h"
 
 #include <SOIL2.h>
 #include <iostream>
@@ -18,7 +19,7 @@ HeightMapTexture::HeightMapTexture(const std::string& path, TextureFilterType fi
 	if (data)
 	{
 		glCreateTextures(GL_TEXTURE_2D, 1, &this->ID);
-		glBindTexture(GL_TEXTURE_2D, this->ID);
+		GLState::BindTexture(GL_TEXTURE_2D, this->ID);
 
 		// Filtering parameters (We use linear whichif a UV coord doesn't correspond to to a color value in the texture, it will take the average of colors from its neighbours)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterType == TextureFilterType::Linear ?  GL_LINEAR : GL_NEAREST);
@@ -32,7 +33,7 @@ HeightMapTexture::HeightMapTexture(const std::string& path, TextureFilterType fi
 
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data); // Tell OpenGL about our image (passes in the width, height and image data (pixels))
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::BindTexture(GL_TEXTURE_2D, 0);
 	}
 	else
 	{
@@ -42,12 +43,13 @@ HeightMapTexture::HeightMapTexture(const std::string& path, TextureFilterType fi
 
 HeightMapTexture::~HeightMapTexture()
 {
+	GLState::ForgetTexture(this->ID);
 	glDeleteTextures(1, &this->ID);
 }
 
 void HeightMapTexture::Bind(uint32_t slot) const
 {
-	glBindTextureUnit(slot, this->ID);
+	GLState::BindTextureUnit(slot, this->ID);
 	glUniform1i(heightMapTextureUniform, slot);
 	glUniform1f(heightMapScaleUniform, this->scale);
 	glUniform3f(heightMapOffsetUniform, this->offset.x, this->offset.y, this->offset.z);
@@ -57,13 +59,13 @@ void HeightMapTexture::Bind(uint32_t slot) const
 void HeightMapTexture::UnBind(uint32_t slot) const
 {
 	glUniform1f(useHeightMapUniform, (GLfloat)GL_FALSE);
-	glBindTextureUnit(slot, 0);
+	GLState::BindTextureUnit(slot, 0);
 }
 
 void HeightMapTexture::InitializeUniforms(Ref<Shader> shader)
 {
-	HeightMapTexture::useHeightMapUniform = glGetUniformLocation(shader->GetID(), "useHeightMap");
-	HeightMapTexture::heightMapTextureUniform = glGetUniformLocation(shader->GetID(), "heightMapTexture");
-	HeightMapTexture::heightMapScaleUniform = glGetUniformLocation(shader->GetID(), "heightMapScale");
-	HeightMapTexture::heightMapOffsetUniform = glGetUniformLocation(shader->GetID(), "heightMapUVOffsetRotation");
+	HeightMapTexture::useHeightMapUniform = shader->GetUniformLocation("useHeightMap");
+	HeightMapTexture::heightMapTextureUniform = shader->GetUniformLocation("heightMapTexture");
+	HeightMapTexture::heightMapScaleUniform = shader->GetUniformLocation("heightMapScale");
+	HeightMapTexture::heightMapOffsetUniform = shader->GetUniformLocation("heightMapUVOffsetRotation");
 }
\ No newline at end of file
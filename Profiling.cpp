@@ -0,0 +1,59 @@
+#include "Profiling.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
+namespace Profiling
+{
+	uint64_t GetPeakMemoryUsage()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return 0;
+		}
+
+		return counters.PeakWorkingSetSize;
+#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+
+		return (uint64_t)usage.ru_maxrss * 1024; // Reported in kilobytes
+#endif
+	}
+
+	uint64_t GetCurrentMemoryUsage()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return 0;
+		}
+
+		return counters.WorkingSetSize;
+#else
+		std::ifstream statm("/proc/self/statm");
+		uint64_t totalPages = 0, residentPages = 0;
+		if (!(statm >> totalPages >> residentPages))
+		{
+			return 0;
+		}
+
+		return residentPages * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+}
\ No newline at end of file
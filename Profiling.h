@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Profiling
+{
+	// The most memory the process has had resident at once, in bytes
+	uint64_t GetPeakMemoryUsage();
+
+	// The memory the process currently has resident, in bytes
+	uint64_t GetCurrentMemoryUsage();
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+	: stopping(false)
+{
+	this->workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		this->workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->condition.notify_all();
+	for (std::thread& worker : this->workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->tasks.push(std::move(task));
+	}
+
+	this->condition.notify_one();
+}
+
+ThreadPool& ThreadPool::Get()
+{
+	unsigned int hardwareThreads = std::thread::hardware_concurrency(); // Can be 0 if it can't be detected
+	static ThreadPool pool(hardwareThreads > 1 ? hardwareThreads - 1 : 1);
+	return pool;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->condition.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+			if (this->stopping && this->tasks.empty()) // Finish whatever is still queued before shutting down
+			{
+				return;
+			}
+
+			task = std::move(this->tasks.front());
+			this->tasks.pop();
+		}
+
+		task();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.h"
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+// A fixed set of worker threads that pull tasks off a shared queue
+class ThreadPool
+{
+public:
+	ThreadPool(uint32_t threadCount);
+	virtual ~ThreadPool();
+
+	// Queues a task to be run on one of the worker threads
+	void Enqueue(std::function<void()> task);
+
+	// Queues a task and returns a future that will hold its result
+	template<typename F>
+	std::future<typename std::result_of<F()>::type> Submit(F&& task)
+	{
+		typedef typename std::result_of<F()>::type ReturnType;
+		Ref<std::packaged_task<ReturnType()>> packagedTask = CreateRef<std::packaged_task<ReturnType()>>(std::forward<F>(task)); // std::function needs something copyable
+		std::future<ReturnType> future = packagedTask->get_future();
+		Enqueue([packagedTask]() { (*packagedTask)(); });
+		return future;
+	}
+
+	inline uint32_t GetThreadCount() const { return (uint32_t)this->workers.size(); }
+
+	// The shared pool used by the engine. Leaves one hardware thread free for the GL thread.
+	static ThreadPool& Get();
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+};
\ No newline at end of file
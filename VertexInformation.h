@@ -13,7 +13,9 @@ enum class ShaderDataType
 	Float, Float2, Float3, Float4, // Float Types
 	Int, Int2, Int3, Int4, // Int Types
 	Mat3x3, Mat4x4, // Matrix Types,
-	Bool
+	Bool,
+	Half2, Half4, // Half float types
+	Byte4Norm, Short2Norm, Short4Norm, UShort2Norm, UShort4Norm // Normalized integer types (read as floats in the shader)
 };
 
 // Gets the size (in bytes) of a ShaderDataType
@@ -43,6 +45,18 @@ static size_t GetShaderDataTypeSize(ShaderDataType type)
 		return 4 * 4 * 4;
 	case ShaderDataType::Bool:
 		return 1;
+	case ShaderDataType::Half2:
+		return 2 * 2; // A half float is 2 bytes
+	case ShaderDataType::Half4:
+		return 2 * 4;
+	case ShaderDataType::Byte4Norm:
+		return 1 * 4;
+	case ShaderDataType::Short2Norm:
+	case ShaderDataType::UShort2Norm:
+		return 2 * 2;
+	case ShaderDataType::Short4Norm:
+	case ShaderDataType::UShort4Norm:
+		return 2 * 4;
 	default:
 		std::cout << "Invalid ShaderDataType!" << std::endl;
 		return 0;
@@ -54,7 +68,7 @@ struct BufferElement
 {
 	BufferElement() = default;
 	BufferElement(ShaderDataType dataType, const std::string& name, bool normalized = false)
-		: name(name), shaderDataType(dataType), size(GetShaderDataTypeSize(dataType)), offset(0), normalized(false) {}
+		: name(name), shaderDataType(dataType), size(GetShaderDataTypeSize(dataType)), offset(0), normalized(normalized) {}
 
 	size_t NumberOfComponents() const
 	{
@@ -83,6 +97,15 @@ struct BufferElement
 			return 4; // 4x Float3
 		case ShaderDataType::Bool:
 			return 1;
+		case ShaderDataType::Half2:
+		case ShaderDataType::Short2Norm:
+		case ShaderDataType::UShort2Norm:
+			return 2;
+		case ShaderDataType::Half4:
+		case ShaderDataType::Byte4Norm:
+		case ShaderDataType::Short4Norm:
+		case ShaderDataType::UShort4Norm:
+			return 4;
 		default:
 			std::cout << "Invalid ShaderDataType!" << std::endl;
 			return 0;
@@ -17,6 +17,8 @@
 #include <fstream>
 #include <sstream>
 #include <unordered_set>
+#include <chrono>
+#include <random>
 
 #include "vendor/imgui/imgui.h"
 #include "vendor/imgui/imgui_impl_opengl3.h"
@@ -29,9 +31,13 @@
 #include "Raycast.h"
 #include "Scene.h"
 #include "Renderer.h"
+#include "GLState.h"
 #include "MeshManager.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "TextureManager.h"
 #include "FlickerAttachment.h"
+#include "Profiling.h"
 
 const float windowWidth = 1700;
 const float windowHeight = 800;
@@ -139,6 +145,17 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 		scene->PreviousLight();
 	}
 
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+	{
+		bool sorted = Renderer::GetTransparencyMode() == TransparencyMode::Sorted;
+		Renderer::SetTransparencyMode(sorted ? TransparencyMode::WeightedBlended : TransparencyMode::Sorted);
+	}
+
+	if (key == GLFW_KEY_L && action == GLFW_PRESS)
+	{
+		Renderer::SetPerObjectLights(!Renderer::IsPerObjectLights());
+	}
+
 	if (key == GLFW_KEY_LEFT_SHIFT && action == GLFW_PRESS)
 	{
 		scene->showCurrentEdit = !scene->showCurrentEdit;
@@ -150,7 +167,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 		light->light->position = glm::vec4(camera->position, 1.0f);
 		light->light->diffuse = glm::vec4(1.0f, 0.9f, 0.0f, 1.0f);
 		light->light->specular = glm::vec4(1.0f, 0.9f, 0.0f, 1.0f);
-		light->light->attenuation = glm::vec4(0.0f, 0.10900525f, 0.0f, 100000.0f);
+		light->light->EditAttenuation(0.0f, 0.10900525f, 0.0f, 100000.0f);
 		light->attachements.push_back(CreateRef<FlickerAttachment>(light->light));
 		scene->AddLight(light);
 	}
@@ -189,18 +206,66 @@ static void drop_callback(GLFWwindow* window, int count, const char** paths)
 
 	Ref<Mesh> mesh = MeshManager::LoadMesh(path);
 	Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(mesh);
-	meshData->position = camera->position + (camera->direction * 10.0f);
+	meshData->SetPosition(camera->position + (camera->direction * 10.0f));
 	scene->AddMesh(meshData);
 }
 
 void LoadFile(const std::string& file, Ref<Scene> scene);
 void ParseDungeon(const std::string& file, Ref<Scene> scene);
 void ParseDoors(const std::string& file, Ref<Scene> scene);
+void BenchmarkMeshLoading(int iterations);
+void BenchmarkSceneLoading(Ref<Shader> shader);
+void BenchmarkBVH();
 
-int main(void)
+int main(int argc, char** argv)
 {
 	GLFWwindow* window;
 
+	for (int i = 1; i < argc; i++) // The vertex format and optimizer flags have to be picked before any meshes are loaded
+	{
+		std::string arg(argv[i]);
+		if (arg == "--compact-vertices")
+		{
+			Mesh::SetDefaultVertexFormat(VertexFormat::Compact);
+		}
+		else if (arg == "--quantized-vertices")
+		{
+			Mesh::SetDefaultVertexFormat(VertexFormat::CompactQuantized);
+		}
+		else if (arg == "--optimize-overdraw")
+		{
+			Mesh::SetDefaultOptimizerFlags(Mesh::GetDefaultOptimizerFlags() | MeshOptimizer_Overdraw);
+		}
+		else if (arg == "--no-mesh-optimization")
+		{
+			Mesh::SetDefaultOptimizerFlags(MeshOptimizer_None);
+		}
+		else if (arg == "--no-lods")
+		{
+			Mesh::SetDefaultLODErrorTargets({});
+		}
+		else if (arg == "--no-frustum-culling")
+		{
+			Renderer::SetFrustumCulling(false);
+		}
+		else if (arg == "--no-occlusion-culling")
+		{
+			Renderer::SetOcclusionCulling(false);
+		}
+		else if (arg == "--no-multi-draw-indirect")
+		{
+			Renderer::SetMultiDrawIndirect(false);
+		}
+		else if (arg == "--weighted-blended-oit")
+		{
+			Renderer::SetTransparencyMode(TransparencyMode::WeightedBlended);
+		}
+		else if (arg == "--per-object-lights")
+		{
+			Renderer::SetPerObjectLights(true);
+		}
+	}
+
 	glfwSetErrorCallback(error_callback);
 
 	if (!glfwInit())
@@ -254,6 +319,34 @@ int main(void)
 	DiscardTexture::InitializeUniforms(shader);
 	AlphaTexture::InitializeUniforms(shader);
 
+	if (argc > 1 && std::string(argv[1]) == "--bench-mesh-load")
+	{
+		BenchmarkMeshLoading(argc > 2 ? std::stoi(argv[2]) : 5);
+		MeshManager::Shutdown();
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		exit(EXIT_SUCCESS);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--bench-scene-load")
+	{
+		BenchmarkSceneLoading(shader);
+		MeshManager::Shutdown();
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		exit(EXIT_SUCCESS);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "--bench-bvh")
+	{
+		BenchmarkBVH();
+		MeshManager::Shutdown();
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		exit(EXIT_SUCCESS);
+	}
+
 	scene = CreateRef<Scene>(shader);
 	scene->camera = camera;
 
@@ -282,7 +375,13 @@ int main(void)
 			{
 				std::string fps = std::to_string(fpsFrameCount / fpsTimeElapsed);
 				std::string ms = std::to_string(1000.f * fpsTimeElapsed / fpsFrameCount);
-				std::string newTitle = "FPS: " + fps + "   MS: " + ms;
+				const FrameStatistics& stats = Renderer::GetFrameStatistics(); // Still holds the last frame since BeginFrame hasn't been called yet
+				std::string newTitle = "FPS: " + fps + "   MS: " + ms + "   Triangles: " + std::to_string(stats.triangles) + " (" + std::to_string(stats.fullDetailTriangles) + " full detail)   Draws: " + std::to_string(stats.drawCalls) + " (" + std::to_string(stats.instances) + " instances, " + std::to_string(stats.indirectCommands) + " indirect)" + "   VAO binds: " + std::to_string(stats.vertexArrayBinds)
+					+ "   Visible: " + std::to_string(scene->GetFrustumCuller().GetVisibleCount()) + " meshes   Culled: " + std::to_string(scene->GetFrustumCuller().GetCulledCount() + stats.culledMeshes) + " meshes (+" + std::to_string(scene->GetOcclusionCuller().GetOccludedCount()) + " occluded), " + std::to_string(stats.culledSubmeshes) + " submeshes"
+					+ "   State calls: " + std::to_string(GLState::GetStatistics().issuedCalls) + " (" + std::to_string(GLState::GetStatistics().droppedCalls) + " dropped, " + std::to_string(stats.textureSetsReused) + " texture sets reused)"
+					+ "   Cluster lights: " + std::to_string(scene->GetLightClusters().GetAssignmentCount()) + " (max " + std::to_string(scene->GetLightClusters().GetMaxClusterLightCount()) + " per cluster)"
+					+ "   Per object lights: " + (Renderer::IsPerObjectLights() ? std::to_string(scene->GetLightGrid().GetLightCount()) + " gridded (" + std::to_string(scene->GetLightGrid().GetLargeLightCount()) + " large)" : std::string("off"))
+					+ "   Transparency: " + (Renderer::GetTransparencyMode() == TransparencyMode::Sorted ? "sorted" : "weighted blended");
 				glfwSetWindowTitle(window, newTitle.c_str());
 
 	
@@ -304,6 +403,8 @@ int main(void)
 			deltaTime = 0.03f;
 		}
 
+		MeshManager::ProcessUploads(); // Finish any meshes that were imported in the background
+
 		scene->OnUpdate(camera, deltaTime);
 
 		// Render imGui
@@ -313,6 +414,10 @@ int main(void)
 		Renderer::EndFrame();
 	}
 
+	// Tear down while the GL context and the other statics are still alive, static destruction order across files isn't defined
+	scene = nullptr;
+	MeshManager::Shutdown();
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -394,9 +499,9 @@ void LoadFile(const std::string& file, Ref<Scene> scene)
 				Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(MeshManager::LoadMesh(ss.str()));
 				meshData->alphaTransparency = 1.0f;
 				meshData->AddTexture(textureData);
-				meshData->position = position;
-				meshData->orientation = orientation;
-				meshData->scale = scaleVec;
+				meshData->SetPosition(position);
+				meshData->SetOrientation(orientation);
+				meshData->SetScale(scaleVec);
 				scene->AddMesh(meshData);
 			}
 
@@ -411,10 +516,9 @@ void LoadFile(const std::string& file, Ref<Scene> scene)
 				Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(MeshManager::LoadMesh(ss.str()));
 				meshData->alphaTransparency = 1.0f;
 				meshData->AddTexture(textureData);
-				meshData->position = glm::vec3(height * wallOffset, 0.0f, width * wallOffset);
-				meshData->position.z += wallOffset;
-				meshData->orientation = glm::vec3(0.0f, 0.0f, 0.0f);
-				meshData->scale = scaleVec;
+				meshData->SetPosition(glm::vec3(height * wallOffset, 0.0f, width * wallOffset + wallOffset));
+				meshData->SetOrientation(glm::vec3(0.0f, 0.0f, 0.0f));
+				meshData->SetScale(scaleVec);
 				scene->AddMesh(meshData);
 			}
 		}
@@ -454,9 +558,9 @@ void ParseDungeon(const std::string& file, Ref<Scene> scene)
 		Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(MeshManager::LoadMesh(ss.str()));
 		meshData->alphaTransparency = 1.0f;
 		meshData->AddTexture(textureData);
-		meshData->position = position;
-		meshData->orientation = orien;
-		meshData->scale = scale;
+		meshData->SetPosition(position);
+		meshData->SetOrientation(orien);
+		meshData->SetScale(scale);
 		scene->AddMesh(meshData);
 	};
 
@@ -570,10 +674,9 @@ void ParseDungeon(const std::string& file, Ref<Scene> scene)
 				Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(MeshManager::LoadMesh(ss.str()));
 				meshData->alphaTransparency = 1.0f;
 				meshData->AddTexture(textureData);
-				meshData->position = glm::vec3(i * wallOffset, 0.0f, j * wallOffset);
-				meshData->position.z += (wallOffset * 2.0f);
-				meshData->orientation = glm::vec3(0.0f, 0.0f, 0.0f);
-				meshData->scale = scale;
+				meshData->SetPosition(glm::vec3(i * wallOffset, 0.0f, j * wallOffset + (wallOffset * 2.0f)));
+				meshData->SetOrientation(glm::vec3(0.0f, 0.0f, 0.0f));
+				meshData->SetScale(scale);
 				scene->AddMesh(meshData);
 			}
 		}
@@ -600,9 +703,9 @@ void ParseDoors(const std::string& file, Ref<Scene> scene)
 		Ref<SceneMeshData> meshData = CreateRef<SceneMeshData>(MeshManager::LoadMesh(ss.str()));
 		meshData->alphaTransparency = 1.0f;
 		//meshData->AddTexture(textureData);
-		meshData->position = position;
-		meshData->orientation = orien;
-		meshData->scale = scale;
+		meshData->SetPosition(position);
+		meshData->SetOrientation(orien);
+		meshData->SetScale(scale);
 		scene->AddMesh(meshData);
 	};
 
@@ -631,4 +734,211 @@ void ParseDoors(const std::string& file, Ref<Scene> scene)
 			}
 		}
 	}
+}
+
+// Compares cold loads (no mesh cache, full Assimp import) against warm loads (mapped mesh cache) for the meshes the dungeon is built from
+void BenchmarkMeshLoading(int iterations)
+{
+	std::vector<std::string> paths;
+	{
+		const std::string wallPaths[6] =
+		{
+			"SM_Env_Dwarf_Wall_01.ply",
+			"SM_Env_Dwarf_Wall_02.ply",
+			"SM_Env_Dwarf_Wall_03.ply",
+			"SM_Env_Dwarf_Wall_04.ply",
+			"SM_Env_Dwarf_Wall_05.ply",
+			"SM_Env_Dwarf_Wall_06.ply"
+		};
+
+		for (const std::string& wall : wallPaths)
+		{
+			std::stringstream ss;
+			ss << SOLUTION_DIR << "Extern\\assets\\models\\Walls\\" << wall;
+			paths.push_back(ss.str());
+		}
+
+		std::stringstream ss;
+		ss << SOLUTION_DIR << "Extern\\assets\\models\\Floors\\SM_Env_Dwarf_Floor_06.ply";
+		paths.push_back(ss.str());
+		ss.str("");
+
+		ss << SOLUTION_DIR << "Extern\\assets\\models\\Stairs\\SM_Env_Dwarf_Stairs_01.ply";
+		paths.push_back(ss.str());
+		ss.str("");
+
+		ss << SOLUTION_DIR << "Extern\\assets\\models\\ISO_Sphere.ply";
+		paths.push_back(ss.str());
+	}
+
+	float coldTotal = 0.0f;
+	float warmTotal = 0.0f;
+	for (int i = 0; i < iterations; i++)
+	{
+		// Cold: throw away the cache so every mesh goes through Assimp (this also rebuilds the cache for the warm pass)
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (const std::string& path : paths)
+		{
+			MeshCache::Invalidate(path);
+			Mesh mesh(path);
+		}
+		std::chrono::duration<float, std::milli> coldTime = std::chrono::high_resolution_clock::now() - start;
+		coldTotal += coldTime.count();
+
+		// Warm: everything comes out of the cache
+		start = std::chrono::high_resolution_clock::now();
+		for (const std::string& path : paths)
+		{
+			Mesh mesh(path);
+		}
+		std::chrono::duration<float, std::milli> warmTime = std::chrono::high_resolution_clock::now() - start;
+		warmTotal += warmTime.count();
+	}
+
+	std::cout << "Mesh load benchmark (" << paths.size() << " meshes, " << iterations << " iterations)" << std::endl;
+	std::cout << "Cold start: " << coldTotal / iterations << "ms" << std::endl;
+	std::cout << "Warm start: " << warmTotal / iterations << "ms" << std::endl;
+	std::cout << "Peak memory: " << Profiling::GetPeakMemoryUsage() / (1024 * 1024) << "MB" << std::endl;
+}
+
+// Loads scene.yaml once and reports the load time and memory high-water mark. Peak memory is per process, so run it once per build to compare.
+void BenchmarkSceneLoading(Ref<Shader> shader)
+{
+	uint64_t startMemory = Profiling::GetCurrentMemoryUsage();
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	Ref<Scene> benchmarkScene = CreateRef<Scene>(shader);
+	benchmarkScene->camera = camera;
+	benchmarkScene->Load("scene.yaml");
+
+	std::chrono::duration<float, std::milli> loadTime = std::chrono::high_resolution_clock::now() - start;
+
+	std::cout << "Scene load benchmark" << std::endl;
+	std::cout << "Load time: " << loadTime.count() << "ms" << std::endl;
+	std::cout << "Resident before load: " << startMemory / (1024 * 1024) << "MB" << std::endl;
+	std::cout << "Resident after load: " << Profiling::GetCurrentMemoryUsage() / (1024 * 1024) << "MB" << std::endl;
+	std::cout << "Held by meshes: " << MeshManager::GetResidentCPUBytes() / 1024 << "KB" << std::endl;
+	std::cout << "Peak memory: " << Profiling::GetPeakMemoryUsage() / (1024 * 1024) << "MB" << std::endl;
+
+	MeshManager::PrintMemoryReport();
+}
+
+// Builds a SceneBVH over 10k, 100k and 1M unit boxes scattered at a constant density and times building, each kind of query, and refitting after 1% of them move.
+// The sphere queries are also run as a linear scan over every box for comparison.
+void BenchmarkBVH()
+{
+	const uint32_t counts[3] = { 10000, 100000, 1000000 };
+	const uint32_t queryCount = 1000;
+
+	std::mt19937 random(1234);
+	for (uint32_t count : counts)
+	{
+		float worldSize = std::cbrt((float)count) * 10.0f;
+		std::uniform_real_distribution<float> position(0.0f, worldSize);
+		std::uniform_real_distribution<float> angle(0.0f, glm::pi<float>() * 2.0f);
+
+		std::vector<TransformID> ids(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			ids[i] = TransformComponent::Create(glm::vec3(position(random), position(random), position(random)), glm::vec3(angle(random), angle(random), angle(random)));
+			TransformComponent::SetLocalBounds(ids[i], AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+		}
+		TransformComponent::UpdateDirty();
+
+		SceneBVH bvh;
+		for (TransformID id : ids)
+		{
+			bvh.Insert(id);
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		bvh.Build();
+		std::chrono::duration<float, std::milli> buildTime = std::chrono::high_resolution_clock::now() - start;
+
+		std::vector<TransformID> results;
+		size_t frustumResults = 0, rayResults = 0, sphereResults = 0, boxResults = 0;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < queryCount; i++)
+		{
+			glm::vec3 eye(position(random), position(random), position(random));
+			glm::mat4 view = glm::lookAt(eye, glm::vec3(position(random), position(random), position(random)), glm::vec3(0.0f, 1.0f, 0.0f));
+			glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.5f, worldSize * 0.25f);
+			results.clear();
+			bvh.QueryFrustum(Frustum(projection * view), results);
+			frustumResults += results.size();
+		}
+		std::chrono::duration<float, std::micro> frustumTime = std::chrono::high_resolution_clock::now() - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < queryCount; i++)
+		{
+			glm::vec3 origin(position(random), position(random), position(random));
+			glm::vec3 direction = glm::vec3(position(random), position(random), position(random)) - origin;
+			results.clear();
+			bvh.QueryRay(origin, direction, 1.0f, results);
+			rayResults += results.size();
+		}
+		std::chrono::duration<float, std::micro> rayTime = std::chrono::high_resolution_clock::now() - start;
+
+		std::vector<glm::vec3> sphereCenters(queryCount);
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < queryCount; i++)
+		{
+			sphereCenters[i] = glm::vec3(position(random), position(random), position(random));
+			results.clear();
+			bvh.QuerySphere(sphereCenters[i], 20.0f, results);
+			sphereResults += results.size();
+		}
+		std::chrono::duration<float, std::micro> sphereTime = std::chrono::high_resolution_clock::now() - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < queryCount; i++)
+		{
+			glm::vec3 corner(position(random), position(random), position(random));
+			results.clear();
+			bvh.QueryAABB(AABB(corner, corner + glm::vec3(40.0f)), results);
+			boxResults += results.size();
+		}
+		std::chrono::duration<float, std::micro> boxTime = std::chrono::high_resolution_clock::now() - start;
+
+		size_t linearResults = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (const glm::vec3& center : sphereCenters)
+		{
+			for (TransformID id : ids)
+			{
+				AABB bounds = TransformComponent::GetWorldBounds(id);
+				glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max) - center;
+				linearResults += glm::dot(closest, closest) <= 400.0f ? 1 : 0;
+			}
+		}
+		std::chrono::duration<float, std::micro> linearTime = std::chrono::high_resolution_clock::now() - start;
+
+		// Move 1% of the boxes a little and refit
+		std::uniform_real_distribution<float> nudge(-2.0f, 2.0f);
+		for (uint32_t i = 0; i < count / 100; i++)
+		{
+			TransformID id = ids[random() % count];
+			TransformComponent::SetPosition(id, TransformComponent::GetPosition(id) + glm::vec3(nudge(random), nudge(random), nudge(random)));
+		}
+		TransformComponent::UpdateDirty();
+
+		start = std::chrono::high_resolution_clock::now();
+		bvh.Update();
+		std::chrono::duration<float, std::milli> refitTime = std::chrono::high_resolution_clock::now() - start;
+
+		std::cout << "BVH benchmark (" << count << " instances, " << bvh.GetNodeCount() << " nodes)" << std::endl;
+		std::cout << "Build: " << buildTime.count() << "ms" << std::endl;
+		std::cout << "Frustum query: " << frustumTime.count() / queryCount << "us (" << frustumResults / queryCount << " results)" << std::endl;
+		std::cout << "Ray query: " << rayTime.count() / queryCount << "us (" << rayResults / queryCount << " results)" << std::endl;
+		std::cout << "Sphere query: " << sphereTime.count() / queryCount << "us (" << sphereResults / queryCount << " results), linear scan: " << linearTime.count() / queryCount << "us (" << linearResults / queryCount << " results)" << std::endl;
+		std::cout << "AABB query: " << boxTime.count() / queryCount << "us (" << boxResults / queryCount << " results)" << std::endl;
+		std::cout << "Refit after moving 1%: " << refitTime.count() << "ms (quality " << bvh.GetQuality() << ")" << std::endl;
+
+		for (TransformID id : ids)
+		{
+			TransformComponent::Destroy(id);
+		}
+	}
 }
\ No newline at end of file